@@ -17,6 +17,33 @@ namespace ESurfaceMapping
 	};
 }
 
+UENUM(BlueprintType)
+namespace EUITextureFormat
+{
+	enum Type
+	{
+		/** 32 bits per pixel */
+		Uncompressed,
+
+		/** 16 bits per pixel, transparency is lost */
+		RGB565,
+
+		/** DXT1 for opaque views and DXT5 for transparent ones, size should be divisible by 4 */
+		Compressed,
+	};
+}
+
+UENUM(BlueprintType)
+namespace EUICompressionQuality
+{
+	enum Type
+	{
+		Fast,
+		Normal,
+		High,
+	};
+}
+
 /**
  * Class that handles view of one web page
  */
@@ -36,6 +63,14 @@ public:
 	UPROPERTY(EditAnywhere, Category = "View")
 	TEnumAsByte<ESurfaceMapping::Type> SurfaceMapping;
 
+	/** Format of the texture, compact ones save video memory and upload bandwidth (not used in zero-copy mode) */
+	UPROPERTY(EditAnywhere, Category = "View")
+	TEnumAsByte<EUITextureFormat::Type> OutputFormat;
+
+	/** Compression speed and quality balance, compression is made by Qt thread */
+	UPROPERTY(EditAnywhere, Category = "View")
+	TEnumAsByte<EUICompressionQuality::Type> CompressionQuality;
+
 
 	//////////////////////////////////////////////////////////////////////////
 	// View control
@@ -60,6 +95,12 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "UI|VaQuoleUI|SceneUI")
 	bool MouseMoveFromHitResult(const FHitResult& HitResult);
 
+protected:
+	// Begin UVaQuoleUIComponent Interface
+	virtual VaQuole::EPixelFormat::Type GetTextureFormat() const override;
+	virtual VaQuole::ECompressionQuality::Type GetCompressionQuality() const override;
+	// End UVaQuoleUIComponent Interface
+
 
 	//////////////////////////////////////////////////////////////////////////
 	// Input control data
@@ -126,6 +126,11 @@ public:
 	UPROPERTY(EditAnywhere, Category = "View", meta = (ClampMin = "0", UIMin = "0", UIMax = "4096"))
 	int32 Height;
 
+	/** Should view paint directly into texture upload buffer? Saves two full frame copies per update,
+	 * but the whole texture is uploaded on each change */
+	UPROPERTY(EditAnywhere, Category = "View")
+	bool bZeroCopy;
+
 	/** URL that will be opened on startup */
 	UPROPERTY(EditAnywhere, Category = "View")
 	FString DefaultURL;
@@ -263,9 +268,33 @@ protected:
 	/** Update Texture with WebView cached data */
 	void UpdateUITexture();
 
+	/** Recreate host buffer the view paints into in zero-copy mode */
+	void ResetFramebuffer();
+
+	/** Pixel format the texture should have now (zero-copy mode supports 32-bit ones only) */
+	virtual VaQuole::EPixelFormat::Type GetTextureFormat() const;
+
+	/** How hard Qt thread should try when texture format is block compressed */
+	virtual VaQuole::ECompressionQuality::Type GetCompressionQuality() const;
+
 	/** Texture that stores current widget UI */
 	UTexture2D* Texture;
 
+	/** Pixel format of the current texture */
+	VaQuole::EPixelFormat::Type TextureFormat;
+
+	/** Texture was recreated, so it should be updated with the whole view */
+	bool bFullTextureUpdate;
+
+	/** Serial of the last frame uploaded to texture */
+	uint32 TextureFrameSerial;
+
+	/** Host memory the view paints into in zero-copy mode */
+	TSharedPtr<TArray<uint32>, ESPMode::ThreadSafe> Framebuffer;
+
+	/** Buffers that can still be used by Qt thread until it switches to the new one */
+	TArray<TSharedPtr<TArray<uint32>, ESPMode::ThreadSafe>> RetiredFramebuffers;
+
 	/** Material instance that contains texture inside it */
 	UMaterialInstanceDynamic* MaterialInstance;
 
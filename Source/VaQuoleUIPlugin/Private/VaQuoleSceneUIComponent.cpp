@@ -15,6 +15,8 @@ UVaQuoleSceneUIComponent::UVaQuoleSceneUIComponent()
 	TextureParameterName = TEXT("VaQuoleUITexture");
 
 	SurfaceMapping = ESurfaceMapping::Planar;
+	OutputFormat = EUITextureFormat::Uncompressed;
+	CompressionQuality = EUICompressionQuality::Normal;
 
 	bRegisteredUI = false;
 }
@@ -28,6 +30,43 @@ void UVaQuoleSceneUIComponent::BeginDestroy()
 }
 
 
+//////////////////////////////////////////////////////////////////////////
+// Materials setup
+
+VaQuole::EPixelFormat::Type UVaQuoleSceneUIComponent::GetTextureFormat() const
+{
+	// View paints into texture memory itself in zero-copy mode
+	if (bZeroCopy)
+	{
+		return VaQuole::EPixelFormat::BGRA8;
+	}
+
+	switch (OutputFormat)
+	{
+	case EUITextureFormat::RGB565:
+		return VaQuole::EPixelFormat::RGB565;
+
+	case EUITextureFormat::Compressed:
+		// Blocks can't cover the texture partially
+		if (Width % 4 != 0 || Height % 4 != 0)
+		{
+			UE_LOG(LogVaQuole, Warning, TEXT("UI size %dx%d isn't divisible by 4, texture won't be compressed"), Width, Height);
+			return VaQuole::EPixelFormat::BGRA8;
+		}
+
+		return bTransparent ? VaQuole::EPixelFormat::BC3 : VaQuole::EPixelFormat::BC1;
+
+	default:
+		return VaQuole::EPixelFormat::BGRA8;
+	}
+}
+
+VaQuole::ECompressionQuality::Type UVaQuoleSceneUIComponent::GetCompressionQuality() const
+{
+	return (VaQuole::ECompressionQuality::Type)CompressionQuality.GetValue();
+}
+
+
 //////////////////////////////////////////////////////////////////////////
 // View control
 
@@ -2,6 +2,32 @@
 
 #include "VaQuoleUIPluginPrivatePCH.h"
 
+/** Engine pixel format that has the same memory layout as view frames */
+static EPixelFormat GetTexturePixelFormat(VaQuole::EPixelFormat::Type Format)
+{
+	switch (Format)
+	{
+	case VaQuole::EPixelFormat::RGBA8:
+	case VaQuole::EPixelFormat::RGBA8_Premultiplied:
+		return PF_R8G8B8A8;
+
+	case VaQuole::EPixelFormat::RGB565:
+		return PF_R5G6B5_UNORM;
+
+	case VaQuole::EPixelFormat::A8:
+		return PF_A8;
+
+	case VaQuole::EPixelFormat::BC1:
+		return PF_DXT1;
+
+	case VaQuole::EPixelFormat::BC3:
+		return PF_DXT5;
+
+	default:
+		return PF_B8G8R8A8;
+	}
+}
+
 UVaQuoleUIComponent::UVaQuoleUIComponent()
 {
 	bAutoActivate = true;
@@ -11,9 +37,13 @@ UVaQuoleUIComponent::UVaQuoleUIComponent()
 
 	WebUI = NULL;
 	bPageLoaded = false;
+	bFullTextureUpdate = true;
+	TextureFrameSerial = 0;
+	TextureFormat = VaQuole::EPixelFormat::BGRA8;
 
 	bEnabled = true;
 	bTransparent = true;
+	bZeroCopy = false;
 
 	bInputEnabled = true;
 	bConsumeMouseInput = false;
@@ -58,6 +88,16 @@ void UVaQuoleUIComponent::BeginDestroy()
 	// Clear web view widget
 	if (WebUI)
 	{
+		if (Framebuffer.IsValid())
+		{
+			// Keep Qt thread away from the memory we're going to free
+			FlushRenderingCommands();
+			while (!WebUI->LockExternalFramebuffer())
+			{
+				FPlatformProcess::Sleep(0.f);
+			}
+		}
+
 		WebUI->Destroy();
 	}
 
@@ -88,13 +128,52 @@ void UVaQuoleUIComponent::ResetUITexture()
 {
 	DestroyUITexture();
 
-	Texture = UTexture2D::CreateTransient(Width, Height);
+	TextureFormat = GetTextureFormat();
+	Texture = UTexture2D::CreateTransient(Width, Height, GetTexturePixelFormat(TextureFormat));
 	Texture->AddToRoot();
 	Texture->UpdateResource();
+	bFullTextureUpdate = true;
 
+	// Qt thread converts frames into texture format itself
+	if (WebUI)
+	{
+		WebUI->SetOutputFormat(TextureFormat);
+		WebUI->SetCompressionQuality(GetCompressionQuality());
+	}
+
+	ResetFramebuffer();
 	ResetMaterialInstance();
 }
 
+void UVaQuoleUIComponent::ResetFramebuffer()
+{
+	if (!bZeroCopy || WebUI == NULL)
+	{
+		return;
+	}
+
+	// Qt thread can still paint into the old one
+	if (Framebuffer.IsValid())
+	{
+		RetiredFramebuffers.Add(Framebuffer);
+	}
+
+	Framebuffer = MakeShareable(new TArray<uint32>);
+	Framebuffer->SetNumZeroed(Width * Height);
+
+	WebUI->SetExternalFramebuffer(Framebuffer->GetData(), Width * sizeof(uint32), Width, Height);
+}
+
+VaQuole::EPixelFormat::Type UVaQuoleUIComponent::GetTextureFormat() const
+{
+	return VaQuole::EPixelFormat::BGRA8;
+}
+
+VaQuole::ECompressionQuality::Type UVaQuoleUIComponent::GetCompressionQuality() const
+{
+	return VaQuole::ECompressionQuality::Normal;
+}
+
 void UVaQuoleUIComponent::ResetMaterialInstance()
 {
 	if (!Texture || !BaseMaterial || TextureParameterName.IsNone())
@@ -145,6 +224,16 @@ void UVaQuoleUIComponent::UpdateUITexture()
 		return;
 	}
 
+	// Qt thread has switched to the current framebuffer
+	RetiredFramebuffers.Empty();
+
+	// Nothing was painted since the last upload
+	const uint32 FrameSerial = WebUI->GetFrameSerial();
+	if (!bFullTextureUpdate && FrameSerial == TextureFrameSerial)
+	{
+		return;
+	}
+
 	if (Texture && Texture->Resource)
 	{
 		// Check that texture is prepared
@@ -154,35 +243,115 @@ void UVaQuoleUIComponent::UpdateUITexture()
 			return;
 		}
 
-		// Load data from view
-		const UCHAR* my_data = WebUI->GrabView();
-		const size_t size = Width * Height * sizeof(uint32);
+		// Zero-copy mode: upload host buffer the view has painted into
+		if (Framebuffer.IsValid())
+		{
+			// Qt is painting into it right now, we'll try again next tick
+			if (!WebUI->LockExternalFramebuffer())
+			{
+				return;
+			}
+
+			bFullTextureUpdate = false;
+			TextureFrameSerial = FrameSerial;
+
+			ENQUEUE_RENDER_COMMAND(CopyFramebufferData)
+			(
+				[TargetTexture = rhiRef, Bits = Framebuffer, UI = WebUI, TextureWidth = Width, TextureHeight = Height](FRHICommandListImmediate& RHICmdList)
+				{
+					check(IsInRenderingThread());
+					uint32 stride = 0;
+					uint8* MipData = static_cast<uint8*>(RHILockTexture2D(TargetTexture, 0, RLM_WriteOnly, stride, false));
+					for (int32 Line = 0; Line < TextureHeight; Line++)
+					{
+						FMemory::Memcpy(MipData + Line * stride, Bits->GetData() + Line * TextureWidth, TextureWidth * sizeof(uint32));
+					}
+					RHIUnlockTexture2D(TargetTexture, 0, false);
+
+					// Let Qt thread paint again
+					UI->UnlockExternalFramebuffer();
+				}
+			);
 
-		// @TODO This is a bit heavy to keep reallocating/deallocating, but not a big deal. Maybe we can ping pong between buffers instead.
-		TArray<uint32> ViewBuffer;
-		ViewBuffer.Init(0, Width * Height);
-		FMemory::Memcpy(ViewBuffer.GetData(), my_data, size);
+			return;
+		}
 
-		// This will be passed off to the render thread, which will delete it when it has finished with it
-		FVaQuoleTextureDataPtr DataPtr = MakeShareable(new FVaQuoleTextureData);
-		DataPtr->SetRawData(Width, Height, sizeof(uint32), ViewBuffer);
+		// Changed parts of the view since the last update
+		std::vector<VaQuole::DirtyRect> DirtyRects;
+		std::vector<uchar> DirtyBits;
+		bool bViewChanged = WebUI->GrabDirtyRegions(DirtyRects, DirtyBits);
+		TextureFrameSerial = FrameSerial;
 
-		// Cleanup
-		ViewBuffer.Empty();
-		my_data = nullptr;
+		// Compressed formats are stored by lines of 4x4 blocks
+		const int32 BlockSize = VaQuole::GetPixelFormatBlockSize(TextureFormat);
+		const int32 BlockBytes = VaQuole::GetPixelFormatBlockBytes(TextureFormat);
 
-		ENQUEUE_RENDER_COMMAND(CopyTextureData)
-		(
-			[TargetTexture = rhiRef, ImageData = DataPtr](FRHICommandListImmediate& RHICmdList) mutable
-			{
-				check(IsInRenderingThread());
-				uint32 stride = 0;
-				uint8* MipData = static_cast<uint8*>(RHILockTexture2D(TargetTexture, 0, RLM_WriteOnly, stride, false));
-				FMemory::Memcpy(MipData, ImageData->GetRawBytesPtr(), ImageData->GetDataSize());
-				RHIUnlockTexture2D(TargetTexture, 0, false);
-				ImageData.Reset();
-			}
-		);
+		if (bFullTextureUpdate)
+		{
+			bFullTextureUpdate = false;
+
+			// Load data from view
+			const UCHAR* my_data = WebUI->GrabView();
+			const int32 LineSize = FMath::DivideAndRoundUp(Width, BlockSize) * BlockBytes;
+			const int32 LinesNum = FMath::DivideAndRoundUp(Height, BlockSize);
+
+			// This will be passed off to the render thread, which will delete it when it has finished with it
+			TArray<uint8> ViewBuffer;
+			ViewBuffer.Append(my_data, LineSize * LinesNum);
+			my_data = nullptr;
+
+			ENQUEUE_RENDER_COMMAND(CopyTextureData)
+			(
+				[TargetTexture = rhiRef, ViewBuffer = MoveTemp(ViewBuffer), LineSize, LinesNum](FRHICommandListImmediate& RHICmdList)
+				{
+					check(IsInRenderingThread());
+					uint32 stride = 0;
+					uint8* MipData = static_cast<uint8*>(RHILockTexture2D(TargetTexture, 0, RLM_WriteOnly, stride, false));
+					for (int32 Line = 0; Line < LinesNum; Line++)
+					{
+						FMemory::Memcpy(MipData + Line * stride, ViewBuffer.GetData() + Line * LineSize, LineSize);
+					}
+					RHIUnlockTexture2D(TargetTexture, 0, false);
+				}
+			);
+		}
+		else if (bViewChanged)
+		{
+			// Upload only repainted rects (they're aligned to blocks already)
+			TArray<FUpdateTextureRegion2D> Regions;
+			TArray<uint32> RegionOffsets;
+			TArray<uint32> RegionPitches;
+			uint32 Offset = 0;
+			for (const VaQuole::DirtyRect& Rect : DirtyRects)
+			{
+				const uint32 Pitch = FMath::DivideAndRoundUp(Rect.Width, BlockSize) * BlockBytes;
+
+				// Skip data that doesn't fit the texture (view is not resized yet)
+				if (Rect.X + Rect.Width <= Width && Rect.Y + Rect.Height <= Height)
+				{
+					Regions.Add(FUpdateTextureRegion2D(Rect.X, Rect.Y, 0, 0, Rect.Width, Rect.Height));
+					RegionOffsets.Add(Offset);
+					RegionPitches.Add(Pitch);
+				}
+
+				Offset += Pitch * FMath::DivideAndRoundUp(Rect.Height, BlockSize);
+			}
+
+			TArray<uint8> RegionBits;
+			RegionBits.Append(DirtyBits.data(), DirtyBits.size());
+
+			ENQUEUE_RENDER_COMMAND(CopyTextureRegions)
+			(
+				[TargetTexture = rhiRef, Regions = MoveTemp(Regions), RegionOffsets = MoveTemp(RegionOffsets), RegionPitches = MoveTemp(RegionPitches), RegionBits = MoveTemp(RegionBits)](FRHICommandListImmediate& RHICmdList)
+				{
+					check(IsInRenderingThread());
+					for (int32 i = 0; i < Regions.Num(); i++)
+					{
+						RHIUpdateTexture2D(TargetTexture, 0, Regions[i], RegionPitches[i], RegionBits.GetData() + RegionOffsets[i]);
+					}
+				}
+			);
+		}
 	}
 }
 
@@ -313,6 +482,12 @@ void UVaQuoleUIComponent::SetTransparent(bool Transparent)
 	{
 		WebUI->SetTransparent(bTransparent);
 	}
+
+	// Texture format can depend on transparency
+	if (Texture && GetTextureFormat() != TextureFormat)
+	{
+		ResetUITexture();
+	}
 }
 
 void UVaQuoleUIComponent::SetInputEnabled(bool EnableInput)
@@ -350,7 +525,11 @@ FString UVaQuoleUIComponent::EvaluateJavaScript(const FString& ScriptSource)
 		return TEXT("");
 	}
 
-	return WebUI->EvaluateJavaScript(*ScriptSource);
+	// Take own copy of uuid, page storage is shared with other callers
+	TCHAR ScriptUuid[VaQuole::VaQuoleWebUI::ScriptUuidLength];
+	WebUI->EvaluateJavaScript(*ScriptSource, ScriptUuid);
+
+	return FString(ScriptUuid);
 }
 
 void UVaQuoleUIComponent::OpenURL(const FString& URL)
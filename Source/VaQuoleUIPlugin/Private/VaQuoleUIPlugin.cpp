@@ -14,8 +14,23 @@ class VAQUOLEUIPLUGIN_API FVaQuoleUIPlugin : public IVaQuoleUIPlugin
 		UVaQuoleHUDComponent::StaticClass();
 		UVaQuoleSceneUIComponent::StaticClass();
 
-		// Start QApplication thread
-		VaQuole::Init();
+		// Start QApplication thread, or renderer host process if it's enabled
+		bool bOutOfProcess = false;
+		GConfig->GetBool(TEXT("VaQuoleUI"), TEXT("bOutOfProcess"), bOutOfProcess, GGameIni);
+
+		// Pages are spread between several hosts to use more cores
+		int32 HostsNum = 1;
+		GConfig->GetInt(TEXT("VaQuoleUI"), TEXT("HostsNum"), HostsNum, GGameIni);
+
+		FString HostExecutable;
+		if (bOutOfProcess && GConfig->GetString(TEXT("VaQuoleUI"), TEXT("HostExecutable"), HostExecutable, GGameIni))
+		{
+			VaQuole::InitOutOfProcess(*HostExecutable, FMath::Max(HostsNum, 1));
+		}
+		else
+		{
+			VaQuole::Init();
+		}
 	}
 
 	virtual void ShutdownModule() override
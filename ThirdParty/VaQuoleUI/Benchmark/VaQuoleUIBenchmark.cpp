@@ -0,0 +1,577 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#include "../Include/VaQuoleUILib.h"
+
+#include <QByteArray>
+#include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QList>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+#include <QTemporaryDir>
+#include <QUrl>
+
+#include <chrono>
+#include <ctime>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+
+using namespace VaQuole;
+
+typedef std::chrono::steady_clock BenchmarkClock;
+
+/** How long we wait for pages to load */
+static const int LoadTimeoutMs = 15000;
+
+/** Time to let pages settle before measurement */
+static const int WarmupMs = 1000;
+
+/** How often the game polls for frames */
+static const int PollIntervalUs = 1000;
+
+/** Idle pages are polled once per game frame, so polling doesn't hide their own CPU use */
+static const int IdlePollIntervalUs = 16667;
+
+/** How often input is sent to pages */
+static const int InputIntervalMs = 50;
+
+/**
+ * Bundled page and the input it's driven by
+ */
+struct Workload
+{
+	const char* Name;
+	const TCHAR* URL;
+
+	/** Type text instead of moving mouse */
+	bool bKeyboardInput;
+};
+
+static const Workload Workloads[] =
+{
+	{ "menu",		L"qrc:/Workloads/menu.html",		false },
+	{ "list",		L"qrc:/Workloads/list.html",		false },
+	{ "animation",	L"qrc:/Workloads/animation.html",	false },
+	{ "canvas",		L"qrc:/Workloads/canvas.html",		false },
+	{ "input",		L"qrc:/Workloads/input.html",		true },
+};
+
+/**
+ * Benchmark settings
+ */
+struct BenchmarkOptions
+{
+	QStringList Workloads;
+	int MaxPages;
+	QList<QSize> Sizes;
+	int DurationMs;
+	bool bHeadless;
+	QString OutputPath;
+	QString TracePath;
+
+	/** Don't send input and run with MaxPages only, so CPU use of idle pages is measured */
+	bool bIdle;
+
+	/** Render pages in host processes */
+	QString HostPath;
+	int HostsNum;
+
+	BenchmarkOptions()
+	{
+		MaxPages = 4;
+		Sizes << QSize(512, 512) << QSize(1280, 720) << QSize(1920, 1080);
+		DurationMs = 5000;
+		bHeadless = false;
+		bIdle = false;
+		HostsNum = 1;
+	}
+};
+
+/**
+ * Game side state of one page during the run
+ */
+struct BenchmarkPage
+{
+	VaQuoleWebUI* UI;
+
+	/** Schedule stats before measurement */
+	PageScheduleStats BaseStats;
+
+	BenchmarkPage()
+	{
+		UI = NULL;
+	}
+};
+
+/**
+ * Measurement of one workload/pages/size combination
+ */
+struct BenchmarkResult
+{
+	QString Workload;
+	int Pages;
+	QSize Size;
+	bool bLoaded;
+
+	double Seconds;
+	unsigned long long Frames;
+	unsigned long long BytesCopied;
+	unsigned long long QtLoopUs;
+	unsigned long long EventLoopUs;
+	double ProcessCpuMs;
+	double HostsCpuMs;
+	InputLatencyStats InputLatency;
+	unsigned long long ResidentBytes;
+	unsigned long long FramePoolBytes;
+
+	BenchmarkResult()
+	{
+		Pages = 0;
+		bLoaded = false;
+		Seconds = 0.0;
+		Frames = 0;
+		BytesCopied = 0;
+		QtLoopUs = 0;
+		EventLoopUs = 0;
+		ProcessCpuMs = 0.0;
+		HostsCpuMs = 0.0;
+		ResidentBytes = 0;
+		FramePoolBytes = 0;
+	}
+};
+
+static long long ElapsedUs(BenchmarkClock::time_point From, BenchmarkClock::time_point To)
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(To - From).count();
+}
+
+/** Nearest-rank percentile of sorted samples */
+/** Memory of the whole process */
+static unsigned long long GetResidentBytes()
+{
+#ifdef Q_OS_LINUX
+	QFile Status("/proc/self/statm");
+	if (Status.open(QIODevice::ReadOnly))
+	{
+		const QList<QByteArray> Fields = Status.readAll().split(' ');
+		if (Fields.size() > 1)
+		{
+			return Fields[1].toULongLong() * sysconf(_SC_PAGESIZE);
+		}
+	}
+#endif
+
+	return 0;
+}
+
+/** CPU time of renderer hosts, they are the only children of the process (milliseconds) */
+static double GetHostsCpuMs()
+{
+	double CpuMs = 0.0;
+
+#ifdef Q_OS_LINUX
+	const int ProcessId = (int)getpid();
+
+	foreach (const QString& Entry, QDir("/proc").entryList(QDir::Dirs | QDir::NoDotAndDotDot))
+	{
+		bool bProcess = false;
+		Entry.toInt(&bProcess);
+		if (!bProcess)
+		{
+			continue;
+		}
+
+		QFile Stat(QString("/proc/%1/stat").arg(Entry));
+		if (!Stat.open(QIODevice::ReadOnly))
+		{
+			continue;
+		}
+
+		// Command name can have spaces, so fields are counted from its closing bracket: state, ppid, ... utime (12th), stime (13th)
+		const QByteArray Data = Stat.readAll();
+		const QList<QByteArray> Fields = Data.mid(Data.lastIndexOf(')') + 2).split(' ');
+		if (Fields.size() > 12 && Fields[1].toInt() == ProcessId)
+		{
+			CpuMs += (Fields[11].toULongLong() + Fields[12].toULongLong()) * 1000.0 / sysconf(_SC_CLK_TCK);
+		}
+	}
+#endif
+
+	return CpuMs;
+}
+
+static void SendInput(BenchmarkPage& Page, const Workload& Load, const QSize& Size, int Step)
+{
+	if (Load.bKeyboardInput)
+	{
+		static const TCHAR* Keys[] = { L"A", L"B", L"C", L"D", L"E", L"F", L"G", L"H" };
+		const TCHAR* Key = Keys[Step % 8];
+
+		Page.UI->InputKey(Key, Key[0], true);
+		Page.UI->InputKey(Key, Key[0], false);
+	}
+	else
+	{
+		// Sweep across the page, so hover state changes
+		const int X = (Step * 37) % Size.width();
+		const int Y = (Step * 53) % Size.height();
+		Page.UI->InputMouse(X, Y);
+	}
+}
+
+static BenchmarkResult RunBenchmark(const Workload& Load, const QString& URL, int PagesNum, const QSize& Size, int DurationMs, bool bIdle)
+{
+	BenchmarkResult Result;
+	Result.Workload = Load.Name;
+	Result.Pages = PagesNum;
+	Result.Size = Size;
+
+	std::vector<BenchmarkPage> Pages(PagesNum);
+	for (int i = 0; i < PagesNum; i++)
+	{
+		Pages[i].UI = ConstructNewUI();
+		Pages[i].UI->Resize(Size.width(), Size.height());
+		Pages[i].UI->OpenURL(URL.toStdWString().c_str());
+	}
+
+	// Wait for pages to load
+	const BenchmarkClock::time_point LoadStart = BenchmarkClock::now();
+	Result.bLoaded = false;
+	while (!Result.bLoaded && ElapsedUs(LoadStart, BenchmarkClock::now()) < LoadTimeoutMs * 1000LL)
+	{
+		Result.bLoaded = true;
+		for (int i = 0; i < PagesNum; i++)
+		{
+			Result.bLoaded = Result.bLoaded && Pages[i].UI->IsPageLoaded();
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(WarmupMs));
+
+	std::vector<DirtyRect> Rects;
+	std::vector<uchar> Bits;
+
+	for (int i = 0; i < PagesNum; i++)
+	{
+		Pages[i].UI->GrabDirtyRegions(Rects, Bits);
+		Pages[i].UI->GetScheduleStats(Pages[i].BaseStats);
+	}
+
+	UIThreadStats BaseThreadStats;
+	GetUIThreadStats(BaseThreadStats);
+
+	// Measure
+	const std::clock_t CpuStart = std::clock();
+	const double HostsCpuStartMs = GetHostsCpuMs();
+	const BenchmarkClock::time_point Start = BenchmarkClock::now();
+	BenchmarkClock::time_point NextInput = Start;
+	int InputStep = 0;
+
+	while (ElapsedUs(Start, BenchmarkClock::now()) < DurationMs * 1000LL)
+	{
+		const BenchmarkClock::time_point Now = BenchmarkClock::now();
+		const bool bSendInput = (!bIdle && Now >= NextInput);
+		if (bSendInput)
+		{
+			NextInput += std::chrono::milliseconds(InputIntervalMs);
+			InputStep++;
+		}
+
+		for (int i = 0; i < PagesNum; i++)
+		{
+			BenchmarkPage& Page = Pages[i];
+
+			if (Page.UI->GrabDirtyRegions(Rects, Bits))
+			{
+				Result.Frames++;
+				Result.BytesCopied += Bits.size();
+			}
+
+			if (bSendInput)
+			{
+				SendInput(Page, Load, Size, InputStep);
+			}
+		}
+
+		std::this_thread::sleep_for(std::chrono::microseconds(bIdle ? IdlePollIntervalUs : PollIntervalUs));
+	}
+
+	Result.Seconds = ElapsedUs(Start, BenchmarkClock::now()) / 1000000.0;
+	Result.ProcessCpuMs = (std::clock() - CpuStart) * 1000.0 / CLOCKS_PER_SEC;
+	Result.HostsCpuMs = GetHostsCpuMs() - HostsCpuStartMs;
+
+	for (int i = 0; i < PagesNum; i++)
+	{
+		PageScheduleStats Stats;
+		Pages[i].UI->GetScheduleStats(Stats);
+		Result.QtLoopUs += Stats.TotalServiceUs - Pages[i].BaseStats.TotalServiceUs;
+
+		// Frame serials can't tell which frame input has caused (animations repaint anyway),
+		// so latency is taken from the library that tracks input ids up to the published frame.
+		// The slowest page is reported
+		InputLatencyStats Latency;
+		Pages[i].UI->GetInputLatencyStats(Latency);
+		if (i == 0 || Latency.P99Us > Result.InputLatency.P99Us)
+		{
+			Result.InputLatency = Latency;
+		}
+	}
+
+	UIThreadStats ThreadStats;
+	GetUIThreadStats(ThreadStats);
+	Result.EventLoopUs = ThreadStats.EventLoopUs - BaseThreadStats.EventLoopUs;
+
+	FramePoolStats PoolStats;
+	GetFramePoolStats(PoolStats);
+	Result.FramePoolBytes = PoolStats.AllocatedBytes;
+	Result.ResidentBytes = GetResidentBytes();
+
+	for (int i = 0; i < PagesNum; i++)
+	{
+		Pages[i].UI->Destroy();
+	}
+
+	// Let UI thread delete views before the next run
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+	return Result;
+}
+
+static QJsonObject ResultToJson(const BenchmarkResult& Result)
+{
+	QJsonObject Json;
+	Json["workload"] = Result.Workload;
+	Json["pages"] = Result.Pages;
+	Json["width"] = Result.Size.width();
+	Json["height"] = Result.Size.height();
+	Json["loaded"] = Result.bLoaded;
+	Json["seconds"] = Result.Seconds;
+	Json["frames"] = (double)Result.Frames;
+	Json["frames_per_second"] = Result.Frames / Result.Seconds;
+	Json["frames_per_second_per_page"] = Result.Frames / Result.Seconds / Result.Pages;
+	Json["bytes_per_frame"] = Result.Frames ? (double)Result.BytesCopied / Result.Frames : 0.0;
+	Json["qt_loop_ms_per_second"] = Result.QtLoopUs / 1000.0 / Result.Seconds;
+	Json["qt_event_loop_ms_per_second"] = Result.EventLoopUs / 1000.0 / Result.Seconds;
+	Json["process_cpu_ms_per_second"] = Result.ProcessCpuMs / Result.Seconds;
+	Json["hosts_cpu_ms_per_second"] = Result.HostsCpuMs / Result.Seconds;
+	QJsonObject Latency;
+	Latency["delivered"] = (double)Result.InputLatency.Delivered;
+	Latency["presented"] = (double)Result.InputLatency.Presented;
+	Latency["no_response"] = (double)Result.InputLatency.NoResponse;
+	Latency["delivery_p50_us"] = (double)Result.InputLatency.DeliveryP50Us;
+	Latency["delivery_p99_us"] = (double)Result.InputLatency.DeliveryP99Us;
+	Latency["p50_us"] = (double)Result.InputLatency.P50Us;
+	Latency["p95_us"] = (double)Result.InputLatency.P95Us;
+	Latency["p99_us"] = (double)Result.InputLatency.P99Us;
+	Latency["max_us"] = (double)Result.InputLatency.MaxUs;
+	Json["input_latency"] = Latency;
+	Json["resident_bytes"] = (double)Result.ResidentBytes;
+	Json["frame_pool_bytes"] = (double)Result.FramePoolBytes;
+
+	return Json;
+}
+
+static void PrintUsage()
+{
+	fprintf(stderr,
+		"Usage: VaQuoleUIBenchmark [options]\n"
+		"  --workloads=menu,list,animation,canvas,input  Workloads to run (all by default)\n"
+		"  --pages=N                                     Run with 1..N pages (4 by default), N only when idle\n"
+		"  --sizes=WxH,...                               Page sizes (512x512,1280x720,1920x1080 by default)\n"
+		"  --duration=MS                                 Measurement time of each run (5000 by default)\n"
+		"  --headless                                    Render on offscreen platform\n"
+		"  --idle                                        Send no input, measure CPU use of pages that do nothing\n"
+		"  --host=PATH                                   Render pages in VaQuoleUIHost processes (POSIX only)\n"
+		"  --hosts=N                                     Number of host processes (1 by default)\n"
+		"  --output=FILE                                 Write JSON results to the file\n"
+		"  --trace=FILE                                  Write Chrome trace of UI thread work to the file\n");
+}
+
+static bool ParseOptions(int argc, char *argv[], BenchmarkOptions& Options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		const QString Arg = QString::fromLocal8Bit(argv[i]);
+		const QString Value = Arg.section('=', 1);
+
+		if (Arg.startsWith("--workloads="))
+		{
+			Options.Workloads = Value.split(',', QString::SkipEmptyParts);
+		}
+		else if (Arg.startsWith("--pages="))
+		{
+			Options.MaxPages = qMax(1, Value.toInt());
+		}
+		else if (Arg.startsWith("--sizes="))
+		{
+			Options.Sizes.clear();
+			foreach (const QString& SizeStr, Value.split(',', QString::SkipEmptyParts))
+			{
+				const QSize Size(SizeStr.section('x', 0, 0).toInt(), SizeStr.section('x', 1, 1).toInt());
+				if (Size.isEmpty())
+				{
+					return false;
+				}
+
+				Options.Sizes.append(Size);
+			}
+		}
+		else if (Arg.startsWith("--duration="))
+		{
+			Options.DurationMs = qMax(100, Value.toInt());
+		}
+		else if (Arg == "--headless")
+		{
+			Options.bHeadless = true;
+		}
+		else if (Arg == "--idle")
+		{
+			Options.bIdle = true;
+		}
+		else if (Arg.startsWith("--host="))
+		{
+			Options.HostPath = Value;
+		}
+		else if (Arg.startsWith("--hosts="))
+		{
+			Options.HostsNum = qMax(1, Value.toInt());
+		}
+		else if (Arg.startsWith("--output="))
+		{
+			Options.OutputPath = Value;
+		}
+		else if (Arg.startsWith("--trace="))
+		{
+			Options.TracePath = Value;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	return !Options.Sizes.isEmpty();
+}
+
+int main(int argc, char *argv[])
+{
+	BenchmarkOptions Options;
+	if (!ParseOptions(argc, argv, Options))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	if (!Options.HostPath.isEmpty())
+	{
+		InitOutOfProcess(Options.HostPath.toStdWString().c_str(), Options.HostsNum);
+	}
+	else if (Options.bHeadless)
+	{
+		InitHeadless();
+	}
+
+	// Hosts can't read our resources, so they get workloads from files
+	QTemporaryDir WorkloadsDir;
+
+	InitAsync().wait();
+
+	StartupTiming Timing;
+	GetStartupTiming(Timing);
+
+	if (!Options.TracePath.isEmpty())
+	{
+		StartTracing();
+	}
+
+	printf("%-10s %5s %10s %8s %12s %10s %10s %10s %10s %10s %10s\n",
+		"workload", "pages", "size", "fps", "bytes/frame", "qt ms/s", "cpu ms/s", "host ms/s", "in p50 us", "in p99 us", "rss MB");
+
+	QJsonArray Runs;
+	for (size_t w = 0; w < sizeof(Workloads) / sizeof(Workloads[0]); w++)
+	{
+		const Workload& Load = Workloads[w];
+		if (!Options.Workloads.isEmpty() && !Options.Workloads.contains(Load.Name))
+		{
+			continue;
+		}
+
+		QString URL = QString::fromWCharArray(Load.URL);
+		if (!Options.HostPath.isEmpty())
+		{
+			const QString FilePath = WorkloadsDir.path() + QString("/%1.html").arg(Load.Name);
+			QFile::copy(QString(":") + QUrl(URL).path(), FilePath);
+			URL = QUrl::fromLocalFile(FilePath).toString();
+		}
+
+		foreach (const QSize& Size, Options.Sizes)
+		{
+			// Idle pages cost is measured at the desired number of pages only
+			for (int PagesNum = Options.bIdle ? Options.MaxPages : 1; PagesNum <= Options.MaxPages; PagesNum++)
+			{
+				const BenchmarkResult Result = RunBenchmark(Load, URL, PagesNum, Size, Options.DurationMs, Options.bIdle);
+				Runs.append(ResultToJson(Result));
+
+				printf("%-10s %5d %5dx%-4d %8.1f %12.0f %10.2f %10.2f %10.2f %10llu %10llu %10.1f%s\n",
+					Load.Name, PagesNum, Size.width(), Size.height(),
+					Result.Frames / Result.Seconds,
+					Result.Frames ? (double)Result.BytesCopied / Result.Frames : 0.0,
+					Result.QtLoopUs / 1000.0 / Result.Seconds,
+					Result.ProcessCpuMs / Result.Seconds,
+					Result.HostsCpuMs / Result.Seconds,
+					Result.InputLatency.P50Us,
+					Result.InputLatency.P99Us,
+					Result.ResidentBytes / (1024.0 * 1024.0),
+					Result.bLoaded ? "" : " (not loaded)");
+				fflush(stdout);
+			}
+		}
+	}
+
+	if (!Options.TracePath.isEmpty())
+	{
+		StopTracing();
+		SaveTrace(Options.TracePath.toStdWString().c_str());
+	}
+
+	if (!Options.OutputPath.isEmpty())
+	{
+		QJsonObject Startup;
+		Startup["qapplication_us"] = (double)Timing.QApplicationUs;
+		Startup["webkit_settings_us"] = (double)Timing.WebKitSettingsUs;
+		Startup["ready_us"] = (double)Timing.ReadyUs;
+
+		QJsonObject Report;
+		Report["headless"] = Options.bHeadless;
+		Report["idle"] = Options.bIdle;
+		Report["hosts"] = Options.HostPath.isEmpty() ? 0 : Options.HostsNum;
+		Report["duration_ms"] = Options.DurationMs;
+		Report["startup"] = Startup;
+		Report["runs"] = Runs;
+
+		QFile Output(Options.OutputPath);
+		if (!Output.open(QIODevice::WriteOnly | QIODevice::Truncate))
+		{
+			fprintf(stderr, "Can't write results to %s\n", qPrintable(Options.OutputPath));
+			return 1;
+		}
+
+		Output.write(QJsonDocument(Report).toJson());
+	}
+
+	Cleanup();
+
+	return 0;
+}
@@ -0,0 +1,38 @@
+#-------------------------------------------------
+#
+# Command-to-pixels benchmark with bundled workloads
+#
+#-------------------------------------------------
+
+QT       += network webkit webkitwidgets
+
+TARGET = VaQuoleUIBenchmark
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+DEFINES += UNICODE _UNICODE NOT_UE
+
+INCLUDEPATH += $$PWD/../Include \
+    $$PWD/../Private
+
+SOURCES += VaQuoleUIBenchmark.cpp
+
+RESOURCES += VaQuoleUIBenchmark.qrc
+
+win32 {
+    !contains(QMAKE_TARGET.arch, x86_64) {
+	DESTDIR = $$PWD/../Lib/Win32
+    } else {
+	DESTDIR = $$PWD/../Lib/Win64
+    }
+
+    LIBS += -L$$DESTDIR -lVaQuoleUILib
+}
+
+unix {
+    DESTDIR = $$PWD/../Lib/Linux
+
+    LIBS += -L$$DESTDIR -lVaQuoleUILib -lrt
+    PRE_TARGETDEPS += $$DESTDIR/libVaQuoleUILib.a
+}
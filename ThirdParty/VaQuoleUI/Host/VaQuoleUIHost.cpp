@@ -0,0 +1,496 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#include "../Include/VaQuoleUILib.h"
+#include "VaQuoleAppThread.h"
+#include "VaQuoleRemoteProtocol.h"
+
+#include <QByteArray>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QHash>
+#include <QRect>
+#include <QSocketNotifier>
+#include <QTimer>
+#include <QVector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace VaQuole;
+
+/** How often page load is reported to game */
+static const int LoadReportIntervalMs = 1000;
+
+/** UI thread writes to it after each tick, so we publish page data only when it could be changed */
+static int TickPipe[2] = { -1, -1 };
+
+static void SignalTick()
+{
+	// Pipe is full when we have a lot of ticks to handle already, so result doesn't matter
+	const char Signal = 0;
+	ssize_t Written = write(TickPipe[1], &Signal, 1);
+	Q_UNUSED(Written);
+}
+
+/**
+ * Host side state of the page
+ */
+struct HostPage
+{
+	/** Page rendered by in-process library */
+	VaQuoleWebUI* UI;
+
+	/** Number of URLs opened to let game skip state of previous ones */
+	quint32 URLSerial;
+
+	/** Last state sent to game */
+	bool bStateSent;
+	bool bPageLoaded;
+	bool bTransparent;
+	int Width;
+	int Height;
+
+	/** Memory to pass frames through */
+	SharedFrameMemory FrameMemory;
+	quint32 FrameGeneration;
+	bool bAwaitingAck;
+
+	/** Time since last load report and page work reported so far */
+	QElapsedTimer LoadTimer;
+	quint64 ReportedPaintUs;
+	quint64 ReportedScriptUs;
+
+	/** Defaults */
+	HostPage()
+	{
+		UI = NULL;
+		URLSerial = 0;
+
+		bStateSent = false;
+		bPageLoaded = false;
+		bTransparent = false;
+		Width = 0;
+		Height = 0;
+
+		FrameGeneration = 0;
+		bAwaitingAck = false;
+
+		LoadTimer.start();
+		ReportedPaintUs = 0;
+		ReportedScriptUs = 0;
+	}
+};
+
+/** Apply game command to the page */
+static void HandleGameMessage(const RemoteMessageHeader& Header, const QByteArray& Payload, QHash<quint32, HostPage*>& Pages)
+{
+	if (Header.Command == ERemoteCommand::CreatePage)
+	{
+		if (!Pages.contains(Header.PageId))
+		{
+			HostPage* Page = new HostPage();
+			Page->UI = ConstructNewUI();
+			Pages.insert(Header.PageId, Page);
+		}
+
+		return;
+	}
+
+	HostPage* Page = Pages.value(Header.PageId, NULL);
+	if (Page == NULL)
+	{
+		return;
+	}
+
+	if (Header.Command == ERemoteCommand::DestroyPage)
+	{
+		Page->UI->Destroy();
+		Pages.remove(Header.PageId);
+		delete Page;
+
+		return;
+	}
+
+	if (Header.Command == ERemoteCommand::FrameAck)
+	{
+		Page->bAwaitingAck = false;
+		return;
+	}
+
+	QDataStream Stream(Payload);
+	UIDataKeeper* ExtComm = Page->UI->GetData();
+
+	std::lock_guard<std::mutex> guard(Page->UI->mutex);
+
+	switch (Header.Command)
+	{
+	case ERemoteCommand::OpenURL:
+		{
+			QString URL;
+			Stream >> URL;
+			ExtComm->Commands.PushURL(URL);
+			Page->URLSerial++;
+		}
+		break;
+
+	case ERemoteCommand::Resize:
+		{
+			qint32 Width = 0;
+			qint32 Height = 0;
+			Stream >> Width >> Height;
+
+			ExtComm->DesiredWidth = Width;
+			ExtComm->DesiredHeight = Height;
+		}
+		break;
+
+	case ERemoteCommand::SetTransparent:
+		Stream >> ExtComm->bDesiredTransparency;
+		break;
+
+	case ERemoteCommand::SetEnabled:
+		Stream >> ExtComm->bEnabled;
+		break;
+
+	case ERemoteCommand::SetOutputFormat:
+		{
+			qint32 Format = 0;
+			Stream >> Format;
+			ExtComm->OutputFormat = (EPixelFormat::Type)Format;
+		}
+		break;
+
+	case ERemoteCommand::SetPriority:
+		{
+			qint32 Priority = 0;
+			Stream >> Priority;
+			ExtComm->Priority = Priority;
+		}
+		break;
+
+	case ERemoteCommand::SetTargetFrameRate:
+		{
+			qint32 FrameRate = 0;
+			Stream >> FrameRate;
+			ExtComm->TargetFrameRate = FrameRate;
+		}
+		break;
+
+	case ERemoteCommand::InputMouse:
+		{
+			MouseEvent Event;
+			Stream >> Event;
+			ExtComm->Commands.PushMouseEvent(Event);
+		}
+		break;
+
+	case ERemoteCommand::InputKey:
+		{
+			KeyEvent Event;
+			Stream >> Event;
+			ExtComm->Commands.PushKeyEvent(Event);
+		}
+		break;
+
+	case ERemoteCommand::EvaluateJavaScript:
+		{
+			QString ScriptUuid;
+			QString ScriptSource;
+			Stream >> ScriptUuid >> ScriptSource;
+			ExtComm->Commands.PushScript(ScriptUuid, ScriptSource);
+		}
+		break;
+
+	case ERemoteCommand::EvaluateJavaScriptBatch:
+		{
+			quint32 FirstCallId = 0;
+			QStringList ScriptSources;
+			Stream >> FirstCallId >> ScriptSources;
+			ExtComm->Commands.PushScriptBatch(FirstCallId, ScriptSources);
+		}
+		break;
+
+	default:
+		qDebug() << "Unknown game command:" << Header.Command;
+		break;
+	}
+}
+
+/** Send page state and script data to game */
+static void PublishPageState(quint32 PageId, HostPage* Page, QByteArray& Outgoing)
+{
+	UIDataKeeper* ExtComm = Page->UI->GetData();
+
+	QList< QPair<QString, QString> > ScriptResults;
+	QList< QPair<QString, QString> > ScriptEvents;
+	QList< QPair<quint32, ScriptValue> > ScriptCallResults;
+
+	bool bPageLoaded, bTransparent;
+	int Width, Height;
+
+	const bool bReportLoad = Page->LoadTimer.elapsed() >= LoadReportIntervalMs;
+	qint64 PaintTimeUs = 0;
+	qint64 ScriptTimeUs = 0;
+
+	{
+		std::lock_guard<std::mutex> guard(Page->UI->mutex);
+
+		if (bReportLoad)
+		{
+			PaintTimeUs = ExtComm->Stats.PaintUs - Page->ReportedPaintUs;
+			ScriptTimeUs = ExtComm->Stats.ScriptUs - Page->ReportedScriptUs;
+			Page->ReportedPaintUs = ExtComm->Stats.PaintUs;
+			Page->ReportedScriptUs = ExtComm->Stats.ScriptUs;
+		}
+
+		bPageLoaded = ExtComm->bPageLoaded;
+		bTransparent = ExtComm->bTransparent;
+		Width = ExtComm->Width;
+		Height = ExtComm->Height;
+
+		ScriptResults.swap(ExtComm->ScriptResults);
+		ScriptEvents.swap(ExtComm->ScriptEvents);
+		ScriptCallResults.swap(ExtComm->ScriptCallResults);
+	}
+
+	if (!Page->bStateSent || bPageLoaded != Page->bPageLoaded || bTransparent != Page->bTransparent ||
+		Width != Page->Width || Height != Page->Height)
+	{
+		QByteArray Payload;
+		QDataStream Stream(&Payload, QIODevice::WriteOnly);
+		Stream << Page->URLSerial << bPageLoaded << bTransparent << (qint32)Width << (qint32)Height;
+		AppendRemoteMessage(Outgoing, PageId, ERemoteCommand::PageState, Payload);
+
+		Page->bStateSent = true;
+		Page->bPageLoaded = bPageLoaded;
+		Page->bTransparent = bTransparent;
+		Page->Width = Width;
+		Page->Height = Height;
+	}
+
+	// Game balances pages between hosts with it
+	if (bReportLoad)
+	{
+		QByteArray Payload;
+		QDataStream Stream(&Payload, QIODevice::WriteOnly);
+		Stream << (qint32)Page->LoadTimer.restart() << PaintTimeUs << ScriptTimeUs;
+		AppendRemoteMessage(Outgoing, PageId, ERemoteCommand::PageLoad, Payload);
+	}
+
+	typedef QPair<QString, QString> ScriptPair;
+	foreach (const ScriptPair& Result, ScriptResults)
+	{
+		QByteArray Payload;
+		QDataStream Stream(&Payload, QIODevice::WriteOnly);
+		Stream << Result.first << Result.second;
+		AppendRemoteMessage(Outgoing, PageId, ERemoteCommand::ScriptResult, Payload);
+	}
+
+	// Batched results are sent together, as they were evaluated
+	if (!ScriptCallResults.isEmpty())
+	{
+		QByteArray Payload;
+		QDataStream Stream(&Payload, QIODevice::WriteOnly);
+		Stream << ScriptCallResults;
+		AppendRemoteMessage(Outgoing, PageId, ERemoteCommand::ScriptCallResults, Payload);
+	}
+
+	foreach (const ScriptPair& Event, ScriptEvents)
+	{
+		QByteArray Payload;
+		QDataStream Stream(&Payload, QIODevice::WriteOnly);
+		Stream << Event.first << Event.second;
+		AppendRemoteMessage(Outgoing, PageId, ERemoteCommand::ScriptEvent, Payload);
+	}
+}
+
+/** Put changed rects of the latest frame into shared memory and inform game about it */
+static void PublishFrame(quint32 PageId, HostPage* Page, QByteArray& Outgoing)
+{
+	// Game is still reading previous frame
+	if (Page->bAwaitingAck)
+	{
+		return;
+	}
+
+	UIDataKeeper* ExtComm = Page->UI->GetData();
+
+	std::lock_guard<std::mutex> guard(Page->UI->FrameMutex);
+
+	const FrameSlot& Frame = ExtComm->Frames.AcquireFrame();
+	if (Frame.Bits == NULL)
+	{
+		return;
+	}
+
+	// Game asks hosts for 32-bit formats only and compresses frames itself
+	const int FrameWidth = Frame.Width;
+	const int FrameHeight = Frame.Height;
+
+	QRegion DirtyRegion = ExtComm->Frames.TakeDirtyRegion().intersected(QRect(0, 0, FrameWidth, FrameHeight));
+	if (DirtyRegion.isEmpty())
+	{
+		return;
+	}
+
+	QVector<QRect> Rects = DirtyRegion.rects();
+	if (Rects.size() > MaxDirtyRects)
+	{
+		Rects.clear();
+		Rects.append(DirtyRegion.boundingRect());
+	}
+
+	// Game has acknowledged the old segment already, so it's safe to replace it
+	const int SegmentSize = FrameWidth * FrameHeight * 4;
+	if (Page->FrameMemory.GetSize() != SegmentSize)
+	{
+		Page->FrameGeneration++;
+		if (!Page->FrameMemory.Create(GetSharedFrameName(getpid(), PageId, Page->FrameGeneration), SegmentSize))
+		{
+			return;
+		}
+	}
+
+	// Pack rects one after another
+	uchar* Dst = Page->FrameMemory.GetData();
+	foreach (const QRect& Rect, Rects)
+	{
+		const int LineSize = Rect.width() * 4;
+		for (int Line = 0; Line < Rect.height(); Line++)
+		{
+			memcpy(Dst, Frame.Bits + (Rect.y() + Line) * Frame.Stride + Rect.x() * 4, LineSize);
+			Dst += LineSize;
+		}
+	}
+
+	QByteArray Payload;
+	QDataStream Stream(&Payload, QIODevice::WriteOnly);
+	Stream << Page->FrameGeneration << (qint32)SegmentSize << (qint32)FrameWidth << (qint32)FrameHeight << Rects;
+	AppendRemoteMessage(Outgoing, PageId, ERemoteCommand::FrameReady, Payload);
+
+	Page->bAwaitingAck = true;
+}
+
+int main(int argc, char *argv[])
+{
+	int Socket = -1;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strncmp(argv[i], "--socket-fd=", 12) == 0)
+		{
+			Socket = atoi(argv[i] + 12);
+		}
+	}
+
+	if (Socket < 0)
+	{
+		fprintf(stderr, "VaQuoleUIHost is started by VaQuoleUILib. Usage: VaQuoleUIHost --socket-fd=N\n");
+		return 1;
+	}
+
+	if (pipe(TickPipe) != 0)
+	{
+		fprintf(stderr, "VaQuoleUIHost can't create tick pipe: %s\n", strerror(errno));
+		return 1;
+	}
+
+	for (int i = 0; i < 2; i++)
+	{
+		fcntl(TickPipe[i], F_SETFL, fcntl(TickPipe[i], F_GETFL) | O_NONBLOCK);
+	}
+
+	// Start in-process UI manager, we're just passing data to the game.
+	// Our event loop needs its QApplication
+	SetTickHook(&SignalTick);
+	VaQuole::InitAsync().wait();
+
+	QHash<quint32, HostPage*> Pages;
+	RemoteMessageReader Reader;
+	QByteArray Outgoing;
+
+	// Sleep until game sends something, UI thread has ticked or load should be reported
+	QEventLoop Loop;
+	QSocketNotifier GameReadNotifier(Socket, QSocketNotifier::Read);
+	QSocketNotifier GameWriteNotifier(Socket, QSocketNotifier::Write);
+	QSocketNotifier TickNotifier(TickPipe[0], QSocketNotifier::Read);
+	QTimer LoadReportTimer;
+
+	GameWriteNotifier.setEnabled(false);
+	LoadReportTimer.start(LoadReportIntervalMs);
+
+	auto PublishPages = [&]()
+	{
+		QHash<quint32, HostPage*>::iterator It;
+		for (It = Pages.begin(); It != Pages.end(); ++It)
+		{
+			PublishPageState(It.key(), It.value(), Outgoing);
+			PublishFrame(It.key(), It.value(), Outgoing);
+		}
+
+		if (!FlushRemoteMessages(Socket, Outgoing))
+		{
+			Loop.quit();
+			return;
+		}
+
+		// Rest is written when socket is ready for it
+		GameWriteNotifier.setEnabled(!Outgoing.isEmpty());
+	};
+
+	QObject::connect(&GameReadNotifier, &QSocketNotifier::activated, [&]()
+	{
+		bool bConnected = Reader.ReadAvailable(Socket);
+
+		RemoteMessageHeader Header;
+		QByteArray Payload;
+		while (Reader.NextMessage(Header, Payload))
+		{
+			HandleGameMessage(Header, Payload, Pages);
+		}
+
+		// Game restarts us when connection is closed
+		if (!bConnected || Reader.IsBroken())
+		{
+			Loop.quit();
+			return;
+		}
+
+		// Page data was changed directly, so UI thread doesn't know about it yet
+		WakeUpManager();
+
+		// Acknowledged frame lets the next one go
+		PublishPages();
+	});
+
+	QObject::connect(&TickNotifier, &QSocketNotifier::activated, [&]()
+	{
+		char Signals[64];
+		while (read(TickPipe[0], Signals, sizeof(Signals)) > 0)
+		{
+		}
+
+		PublishPages();
+	});
+
+	QObject::connect(&GameWriteNotifier, &QSocketNotifier::activated, PublishPages);
+	QObject::connect(&LoadReportTimer, &QTimer::timeout, PublishPages);
+
+	Loop.exec();
+
+	qDebug() << "Game has closed the connection";
+
+	foreach (HostPage* Page, Pages)
+	{
+		Page->UI->Destroy();
+		delete Page;
+	}
+
+	VaQuole::Cleanup();
+
+	return 0;
+}
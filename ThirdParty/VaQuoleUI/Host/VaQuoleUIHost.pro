@@ -0,0 +1,24 @@
+#-------------------------------------------------
+#
+# Renderer host process for out-of-process mode
+#
+#-------------------------------------------------
+
+QT       += network webkit webkitwidgets
+
+TARGET = VaQuoleUIHost
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+DEFINES += UNICODE _UNICODE NOT_UE
+
+DESTDIR = $$PWD/../Lib/Linux
+
+INCLUDEPATH += $$PWD/../Include \
+    $$PWD/../Private
+
+SOURCES += VaQuoleUIHost.cpp
+
+LIBS += -L$$DESTDIR -lVaQuoleUILib -lrt
+PRE_TARGETDEPS += $$DESTDIR/libVaQuoleUILib.a
@@ -62,6 +62,64 @@ struct ScriptEval
 	TCHAR* ScriptResult;
 };
 
+/**
+ * Return value of batched JavaScript call (empty if script failed or returned nothing)
+ */
+struct ScriptCallResult
+{
+	unsigned int CallId;
+	TCHAR* Result;
+};
+
+/**
+ * Type of JavaScript call return value
+ */
+namespace EScriptValueType
+{
+	enum Type
+	{
+		// undefined and null
+		Null,
+		Bool,
+		Number,
+		String,
+
+		// Arrays and objects are passed as JSON
+		Array,
+		Object
+	};
+}
+
+/**
+ * State of asynchronous JavaScript call
+ */
+namespace EScriptCallStatus
+{
+	enum Type
+	{
+		Pending,
+		Succeeded,
+
+		// Script has thrown an exception, or it wasn't evaluated at all
+		Failed
+	};
+}
+
+/**
+ * Thread that runs completion callback of JavaScript call
+ */
+namespace EScriptCallbackThread
+{
+	enum Type
+	{
+		// Thread that received the result (UI thread or remote host reader), callback should be quick
+		Immediate,
+
+		// Thread that calls DispatchScriptCallbacks()
+		Dispatched
+	};
+}
+
 /**
  * JavaScript events keeper
  */
@@ -71,6 +129,345 @@ struct ScriptEvent
 	TCHAR* EventMessage;
 };
 
+/**
+ * Pixel layout of the frames passed to the engine
+ */
+namespace EPixelFormat
+{
+	enum Type
+	{
+		// Qt native layout, no conversion is made
+		BGRA8,
+		BGRA8_Premultiplied,
+		RGBA8,
+		RGBA8_Premultiplied,
+
+		// Compact formats
+		RGB565,
+		A8,
+
+		// Block compressed (4x4 pixels): BC1 for opaque pages, BC3 for transparent ones
+		BC1,
+		BC3
+	};
+}
+
+/**
+ * Speed and quality balance of block compression
+ */
+namespace ECompressionQuality
+{
+	enum Type
+	{
+		Fast,
+		Normal,
+		High
+	};
+}
+
+/** Size of the square pixels block the format is stored with (1 for not compressed formats) */
+inline int GetPixelFormatBlockSize(EPixelFormat::Type Format)
+{
+	return (Format == EPixelFormat::BC1 || Format == EPixelFormat::BC3) ? 4 : 1;
+}
+
+/** Number of bytes per pixel (or per block for compressed formats) */
+inline int GetPixelFormatBlockBytes(EPixelFormat::Type Format)
+{
+	switch (Format)
+	{
+	case EPixelFormat::RGB565:	return 2;
+	case EPixelFormat::A8:		return 1;
+	case EPixelFormat::BC1:		return 8;
+	case EPixelFormat::BC3:		return 16;
+	default:					return 4;
+	}
+}
+
+/**
+ * Page importance for the UI thread scheduler
+ */
+namespace EPagePriority
+{
+	enum Type
+	{
+		// Page has player focus, it's never postponed
+		Focused,
+
+		// Page is on screen
+		Visible,
+
+		// Page is off screen, but should keep running
+		Background,
+
+		// Page isn't shown at all
+		Hidden
+	};
+}
+
+/**
+ * Page scheduling statistics
+ */
+struct PageScheduleStats
+{
+	/** UI thread ticks the page was serviced and postponed in */
+	unsigned long long ServicedTicks;
+	unsigned long long DeferredTicks;
+
+	/** Time spent on the page by the last service, the longest one and all of them (microseconds) */
+	unsigned int LastServiceUs;
+	unsigned int MaxServiceUs;
+	unsigned long long TotalServiceUs;
+
+	/** Defaults */
+	PageScheduleStats()
+	{
+		ServicedTicks = 0;
+		DeferredTicks = 0;
+		LastServiceUs = 0;
+		MaxServiceUs = 0;
+		TotalServiceUs = 0;
+	}
+};
+
+/**
+ * Page frame pacing statistics
+ */
+struct FramePacingStats
+{
+	/** Frame rate page is limited to (0 if it isn't) */
+	int TargetFrameRate;
+
+	/** Frames painted and repaints merged into them */
+	unsigned long long FramesPainted;
+	unsigned long long RepaintsCoalesced;
+
+	/** Difference between real and target frame interval (microseconds) */
+	unsigned int LastJitterUs;
+	unsigned int MaxJitterUs;
+	unsigned int MeanJitterUs;
+
+	/** Defaults */
+	FramePacingStats()
+	{
+		TargetFrameRate = 0;
+		FramesPainted = 0;
+		RepaintsCoalesced = 0;
+		LastJitterUs = 0;
+		MaxJitterUs = 0;
+		MeanJitterUs = 0;
+	}
+};
+
+/**
+ * UI thread startup timing
+ */
+struct StartupTiming
+{
+	/** Time since initialization start when each stage was finished (microseconds, 0 until it's done) */
+	unsigned long long QApplicationUs;
+	unsigned long long WebKitSettingsUs;
+	unsigned long long ReadyUs;
+	unsigned long long FirstViewUs;
+	unsigned long long FirstFrameUs;
+
+	/** Defaults */
+	StartupTiming()
+	{
+		QApplicationUs = 0;
+		WebKitSettingsUs = 0;
+		ReadyUs = 0;
+		FirstViewUs = 0;
+		FirstFrameUs = 0;
+	}
+};
+
+/**
+ * Frame buffer pool statistics
+ */
+struct FramePoolStats
+{
+	/** Allocations served by pooled buffers and by system */
+	unsigned long long Hits;
+	unsigned long long Misses;
+
+	/** Memory of free pooled buffers, of all buffers owned by pool and its peak */
+	unsigned long long PooledBytes;
+	unsigned long long AllocatedBytes;
+	unsigned long long PeakBytes;
+
+	/** Defaults */
+	FramePoolStats()
+	{
+		Hits = 0;
+		Misses = 0;
+		PooledBytes = 0;
+		AllocatedBytes = 0;
+		PeakBytes = 0;
+	}
+};
+
+/**
+ * Page command queue statistics
+ */
+struct CommandQueueStats
+{
+	/** Commands waiting for Qt thread now and the most seen by it */
+	unsigned int Depth;
+	unsigned int PeakDepth;
+
+	/** Commands lost because queue was full */
+	unsigned long long Dropped;
+
+	/** Commands with payload that didn't fit the arena and was allocated on heap */
+	unsigned long long HeapPayloads;
+
+	/** Defaults */
+	CommandQueueStats()
+	{
+		Depth = 0;
+		PeakDepth = 0;
+		Dropped = 0;
+		HeapPayloads = 0;
+	}
+};
+
+/**
+ * Work done by UI thread for the page since it was created
+ */
+struct PageStats
+{
+	/** Time spent on repaints, script evaluation and frame conversion (microseconds) */
+	unsigned long long PaintUs;
+	unsigned long long ScriptUs;
+	unsigned long long CopyUs;
+
+	/** Frames published for the engine and bytes written to them */
+	unsigned long long FramesProduced;
+	unsigned long long BytesCopied;
+
+	/** Commands processed */
+	unsigned long long ScriptsEvaluated;
+	unsigned long long InputEventsProcessed;
+
+	/** Commands waiting for UI thread, script results and events waiting for the engine */
+	unsigned int CommandQueueDepth;
+	unsigned int PendingScriptResults;
+	unsigned int PendingScriptEvents;
+
+	/** Memory of the view image, and page content received by WebKit (bytes) */
+	unsigned long long ImageBytes;
+	unsigned long long ContentBytes;
+
+	/** Defaults */
+	PageStats()
+	{
+		PaintUs = 0;
+		ScriptUs = 0;
+		CopyUs = 0;
+		FramesProduced = 0;
+		BytesCopied = 0;
+		ScriptsEvaluated = 0;
+		InputEventsProcessed = 0;
+		CommandQueueDepth = 0;
+		PendingScriptResults = 0;
+		PendingScriptEvents = 0;
+		ImageBytes = 0;
+		ContentBytes = 0;
+	}
+
+	/** Add counters of another page */
+	void Accumulate(const PageStats& Other)
+	{
+		PaintUs += Other.PaintUs;
+		ScriptUs += Other.ScriptUs;
+		CopyUs += Other.CopyUs;
+		FramesProduced += Other.FramesProduced;
+		BytesCopied += Other.BytesCopied;
+		ScriptsEvaluated += Other.ScriptsEvaluated;
+		InputEventsProcessed += Other.InputEventsProcessed;
+		CommandQueueDepth += Other.CommandQueueDepth;
+		PendingScriptResults += Other.PendingScriptResults;
+		PendingScriptEvents += Other.PendingScriptEvents;
+		ImageBytes += Other.ImageBytes;
+		ContentBytes += Other.ContentBytes;
+	}
+};
+
+/**
+ * Input latency of the page (microseconds)
+ */
+struct InputLatencyStats
+{
+	/** Input events delivered to the page, shown in published frames, and the ones no frame followed in time */
+	unsigned long long Delivered;
+	unsigned long long Presented;
+	unsigned long long NoResponse;
+
+	/** Time input waited in the queue before it was delivered to WebKit */
+	unsigned long long DeliveryP50Us;
+	unsigned long long DeliveryP99Us;
+
+	/**
+	 * Time from input to the first frame published after it was delivered. That frame is credited to
+	 * every pending input, even if it was painted for other reasons (animations, timers) and the input
+	 * is shown only in later frames, so percentiles aren't causal input-to-pixels latency
+	 */
+	unsigned long long P50Us;
+	unsigned long long P95Us;
+	unsigned long long P99Us;
+	unsigned long long MaxUs;
+
+	/** Defaults */
+	InputLatencyStats()
+	{
+		Delivered = 0;
+		Presented = 0;
+		NoResponse = 0;
+		DeliveryP50Us = 0;
+		DeliveryP99Us = 0;
+		P50Us = 0;
+		P95Us = 0;
+		P99Us = 0;
+		MaxUs = 0;
+	}
+};
+
+/**
+ * Work done by UI thread for all pages
+ */
+struct UIThreadStats
+{
+	/** Pages alive */
+	unsigned int Pages;
+
+	/** Loop passes and time spent in Qt event processing: timers, network and repaints (microseconds) */
+	unsigned long long Ticks;
+	unsigned long long EventLoopUs;
+
+	/** Sum of page counters (deleted pages included), queues and memory of alive pages */
+	PageStats Totals;
+
+	/** Defaults */
+	UIThreadStats()
+	{
+		Pages = 0;
+		Ticks = 0;
+		EventLoopUs = 0;
+	}
+};
+
+/**
+ * Rectangle of the view that was repainted since the last grab
+ */
+struct DirtyRect
+{
+	int X;
+	int Y;
+	int Width;
+	int Height;
+};
+
 } // namespace VaQuole
 
 #endif // VAQUOLEPUBLICPCH_H
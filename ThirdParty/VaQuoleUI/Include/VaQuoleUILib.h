@@ -5,6 +5,9 @@
 
 #include "VaQuolePublicPCH.h"
 
+#include <functional>
+#include <future>
+#include <memory>
 #include <mutex>
 #include <vector>
 
@@ -13,16 +16,27 @@ namespace VaQuole
 {
 
 class VaQuoleWebUI;
+class ScriptCall;
 struct UIDataKeeper;
+struct ScriptCallState;
+
+/** Completion callback of asynchronous JavaScript call */
+typedef std::function<void(const ScriptCall& Call)> ScriptCallback;
 
 /**
  * Common library functions
  */
 extern "C"
 {
-	/** Initialize QApplication */
+	/** Initialize QApplication. UI thread is started in background, use InitAsync() to know when it's ready */
 	void Init();
 
+	/** Initialize QApplication on offscreen platform, so no display is required (dedicated servers, CI) */
+	void InitHeadless();
+
+	/** Render pages in pool of separate host processes, so page crash doesn't affect the game (POSIX only) */
+	void InitOutOfProcess(const TCHAR* HostExecutable, int HostsNum = 1);
+
 	/** Initialize UE4->Qt key map */
 	void InitKeyMaps();
 
@@ -31,8 +45,84 @@ extern "C"
 
 	/** Construct new web page view */
 	VaQuoleWebUI* ConstructNewUI();
+
+	/** Get hits, misses and memory usage of frame buffer pool shared by all pages */
+	void GetFramePoolStats(FramePoolStats& Stats);
+
+	/** Get time of UI thread startup stages */
+	void GetStartupTiming(StartupTiming& Timing);
+
+	/** Get UI thread work done for all pages */
+	void GetUIThreadStats(UIThreadStats& Stats);
+
+	/** Start recording UI thread work (page service, scripts, paints, frame copies, event processing) into ring of events */
+	void StartTracing(int MaxEvents = 65536);
+
+	/** Stop recording, events are kept until tracing is started again */
+	void StopTracing();
+
+	/** Write recorded events as Chrome trace event JSON (chrome://tracing, Perfetto) */
+	bool SaveTrace(const TCHAR* FilePath);
+
+	/** Set time UI thread may spend on pages per tick before low priority ones are postponed (microseconds), call it after Init() */
+	void SetSchedulerBudget(int BudgetUs);
+
+	/** Set number of pre-warmed views kept for new pages, call it after Init() */
+	void SetWebViewPoolSize(int Size);
+
+	/** Run queued EScriptCallbackThread::Dispatched callbacks on calling thread (all of them if MaxCallbacks < 0). Returns number of callbacks run */
+	int DispatchScriptCallbacks(int MaxCallbacks = -1);
 }
 
+/**
+ * Start UI thread (if it's not started yet) without waiting for it. Returned future becomes
+ * ready when QApplication and WebKit are initialized, so game can do its own startup meanwhile
+ */
+std::shared_future<void> InitAsync();
+
+/**
+ * Handle of asynchronous JavaScript call. It's cheap to copy, all copies share the same call.
+ * Result is set once, so it can be read from any thread after the call is completed
+ */
+class ScriptCall
+{
+public:
+	/** Empty handle that isn't bound to any call */
+	ScriptCall();
+	explicit ScriptCall(const std::shared_ptr<ScriptCallState>& InState);
+
+	/** Is handle bound to a call? */
+	bool IsValid() const;
+
+	/** Call id, the same one GetScriptCallResults() uses */
+	unsigned int GetCallId() const;
+
+	/** Is result ready? */
+	bool IsCompleted() const;
+
+	/** Wait for result (forever if TimeoutMs < 0). Returns false if it isn't ready yet */
+	bool Wait(int TimeoutMs = -1) const;
+
+	/** Call status, it's Pending until result is ready */
+	EScriptCallStatus::Type GetStatus() const;
+
+	/** Type of returned value (Null until call succeeded) */
+	EScriptValueType::Type GetType() const;
+
+	/** Value of Bool and Number results */
+	bool GetBool() const;
+	double GetNumber() const;
+
+	/** Result as text: strings as is, numbers and bools converted, JSON for arrays and objects. Lives with the handle */
+	const TCHAR* GetString() const;
+
+	/** Error message of failed call. Lives with the handle */
+	const TCHAR* GetError() const;
+
+private:
+	std::shared_ptr<ScriptCallState> State;
+};
+
 /**
  * Class that handles view of one web page
  */
@@ -59,16 +149,77 @@ public:
 	/** Load page with HTML5 benchmark */
 	void OpenBenchmark();
 
-	/** Evaluate JS script on current page */
+	/** Script uuid length, including terminating zero */
+	static const int ScriptUuidLength = 39;
+
+	/** Evaluate JS script on current page, its uuid is written into OutUuid (ScriptUuidLength chars) */
+	void EvaluateJavaScript(const TCHAR* ScriptSource, TCHAR* OutUuid);
+
+	/** Evaluate JS script on current page. Returned uuid is overwritten by the next call, so use it from one thread only */
 	TCHAR* EvaluateJavaScript(const TCHAR *ScriptSource);
 
-	/** Get reference to grabbed screen texture */
+	/**
+	 * Evaluate several scripts in one UI thread call, in order, each one in global scope.
+	 * Returns call id of the first script, the next ones get ids one by one (0 if there are no scripts)
+	 */
+	unsigned int EvaluateJavaScriptBatch(const TCHAR* const* ScriptSources, int ScriptsNum);
+
+	/**
+	 * Evaluate JS script in global scope without polling for the result. Returned handle is completed with
+	 * typed value or error (exceptions are caught), then Callback is run on the thread chosen with CallbackThread
+	 */
+	ScriptCall EvaluateJavaScriptAsync(const TCHAR* ScriptSource, ScriptCallback Callback = ScriptCallback(),
+		EScriptCallbackThread::Type CallbackThread = EScriptCallbackThread::Dispatched);
+
+	/**
+	 * Get reference to the latest complete frame. It's never overwritten by Qt thread
+	 * and stays valid until the next GrabView(), GrabDirtyRegions() or GrabDirtyTiles() call
+	 */
 	const uchar* GrabView();
 
+	/**
+	 * Get the latest frame only if its serial differs from LastSerial, LastSerial is updated then.
+	 * Returns NULL if nothing was painted since that frame
+	 */
+	const uchar* GrabViewIfNewer(unsigned int& LastSerial);
+
+	/** Serial of the latest painted frame. It's increased only when the view was repainted */
+	unsigned int GetFrameSerial();
+
+	/**
+	 * Get rectangles repainted since the last call and their pixels packed row by row
+	 * (rect after rect, in output format). Rects of compressed formats are aligned to 4x4 blocks
+	 * and packed by rows of blocks. Returns false if nothing has changed.
+	 * Acquires the latest frame the same way as GrabView() does
+	 */
+	bool GrabDirtyRegions(std::vector<DirtyRect>& Rects, std::vector<uchar>& Bits);
+
+	/**
+	 * The same as GrabDirtyRegions() but changes are split into 64x64 tiles
+	 * (edge ones are smaller), so each of them can be uploaded on its own
+	 */
+	bool GrabDirtyTiles(std::vector<DirtyRect>& Tiles, std::vector<uchar>& Bits);
+
+	/**
+	 * Zero-copy mode: view paints directly into host memory (32-bit pixels in the GrabView() format).
+	 * GrabView() data isn't updated in this mode, use GetFrameSerial() to check for new frames.
+	 * Pass NULL to get back to the default mode. Memory should stay valid until IsPendingVisualEvents() returns false
+	 */
+	void SetExternalFramebuffer(void* Bits, int Stride, int Width, int Height);
+
+	/**
+	 * Take external framebuffer for reading, Qt thread doesn't paint into it until it's unlocked.
+	 * Never waits, returns false if the buffer is being painted right now
+	 */
+	bool LockExternalFramebuffer();
+
+	/** Give external framebuffer back to Qt thread */
+	void UnlockExternalFramebuffer();
+
 	/** Is the view grabbed bits update enabled? */
 	bool IsEnabled();
 
-	/** Disabled view doesn't update grabbed bits because of performance considerations */
+	/** Disabled view doesn't update grabbed bits and is suspended until it's enabled again */
 	void SetEnabled(bool Enabled = true);
 
 	/** Is background marked as transparent? */
@@ -77,9 +228,33 @@ public:
 	/** Change background transparency */
 	void SetTransparent(bool Transparent = true);
 
+	/**
+	 * Set pixel format of frames, conversion is made by Qt thread.
+	 * Compressed formats (and A8 with Qt older than 5.5) aren't available in zero-copy mode
+	 */
+	void SetOutputFormat(EPixelFormat::Type Format);
+
+	/** Set block compression speed and quality balance */
+	void SetCompressionQuality(ECompressionQuality::Type Quality);
+
 	/** Is desired page loaded or nor? */
 	bool IsPageLoaded();
 
+	/** Set page importance for UI thread scheduler. Hidden pages are suspended like disabled ones */
+	void SetPriority(EPagePriority::Type Priority);
+
+	/** Is page suspended (its scripts timers are throttled, animations and painting are stopped)? */
+	bool IsHibernating();
+
+	/** Get how often page was serviced and postponed by scheduler */
+	void GetScheduleStats(PageScheduleStats& Stats);
+
+	/** Limit page repaints and frame updates to desired frame rate (0 to update as fast as possible) */
+	void SetTargetFrameRate(int FrameRate);
+
+	/** Get painted frames and their timing */
+	void GetFramePacingStats(FramePacingStats& Stats);
+
 	/** Set desired few size */
 	void Resize(int w, int h);
 
@@ -96,6 +271,21 @@ public:
 	/** Get events triggered by scripts */
 	void GetScriptEvents(std::vector<ScriptEvent> &Events);
 
+	/** Get return values of batched scripts, every call gets its result (asynchronous calls aren't listed) */
+	void GetScriptCallResults(std::vector<ScriptCallResult>& Results);
+
+	/** Get depth and drops of the queue that passes input and scripts to Qt thread */
+	void GetCommandQueueStats(CommandQueueStats& Stats);
+
+	/** Get snapshot of UI thread work done for the page: time, frames, copied bytes, processed commands and memory */
+	void GetStats(PageStats& Stats);
+
+	/** Get time input events took to be delivered to the page and to reach the next published frame (see InputLatencyStats) */
+	void GetInputLatencyStats(InputLatencyStats& Stats);
+
+	/** Number of the newest input event shown in published frame (events are numbered from 1 in order they were sent) */
+	unsigned int GetFrameInputId();
+
 
 	//////////////////////////////////////////////////////////////////////////
 	// Player input
@@ -116,6 +306,9 @@ public:
 	/** Locker to be used with external commands */
 	std::mutex mutex;
 
+	/** Locker for frame readers, it's never taken by Qt thread */
+	std::mutex FrameMutex;
+
 private:
 	/** Data keeper to share data between threads */
 	UIDataKeeper* ExtComm;
@@ -3,16 +3,23 @@
 #include "VaQuoleAppThread.h"
 #include "../Include/VaQuoleUILib.h"
 #include "VaQuoleWebPage.h"
+#include "VaQuoleTrace.h"
 
 #include <QApplication>
 #include <QNetworkProxyFactory>
 #include <QWebSettings>
 
 #include <QtDebug>
+#include <QElapsedTimer>
 #include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
 #include <QThread>
+#include <QVector>
 #include <QWebFrame>
 
+#include <algorithm>
+
 void myMessageOutput(QtMsgType type, const QMessageLogContext &context, const QString &msg)
 {
 	QFile file(QDate::currentDate().toString("VaQuoleUI_dd_MM_yyyy.log"));
@@ -42,6 +49,23 @@ namespace VaQuole
 /** Main Qt class object */
 static QApplication* pApp = NULL;
 
+/** Input is counted as having no visible response when no frame was published that long after it (microseconds) */
+static const quint64 MaxInputResponseUs = 1000000;
+
+/** Lets host process wait for page data instead of polling it */
+static void (*TickHook)() = NULL;
+
+VaQuoleUIManager::VaQuoleUIManager(bool bInHeadless)
+{
+	bHeadless = bInHeadless;
+	Dispatcher = NULL;
+	ReadyFuture = ReadyPromise.get_future().share();
+	StartupClock.start();
+
+	TickBudgetUs = DefaultTickBudgetUs;
+	ViewPoolSize = DefaultViewPoolSize;
+}
+
 VaQuoleUIManager::~VaQuoleUIManager()
 {
 	qDebug() << "Trying to stop the UI thread..";
@@ -62,12 +86,24 @@ void VaQuoleUIManager::run()
 	// Create
 	if (QApplication::instance() == nullptr)
 	{
-		int argc = 1;
-		//char* argv[] = { "VaQuoleApp" };
-		char* argv[2];
-		argv[0] = new char[100];
-		strcpy_s(argv[0], 100, "VaQuoleApp");
-		argv[1] = nullptr;
+		// QApplication keeps references to arguments for its whole life
+		static int argc = 1;
+		static char AppName[] = "VaQuoleApp";
+		static char* argv[] = { AppName, nullptr };
+
+		// Render without any window system when asked to or when there is no display at all
+		if (bHeadless)
+		{
+			qputenv("QT_QPA_PLATFORM", "offscreen");
+		}
+#ifdef Q_OS_LINUX
+		else if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM") &&
+			qEnvironmentVariableIsEmpty("DISPLAY") && qEnvironmentVariableIsEmpty("WAYLAND_DISPLAY"))
+		{
+			qDebug() << "No display found, offscreen platform is used";
+			qputenv("QT_QPA_PLATFORM", "offscreen");
+		}
+#endif
 
 #ifdef VA_DEBUG
 		qInstallMessageHandler(myMessageOutput);
@@ -77,6 +113,11 @@ void VaQuoleUIManager::run()
 		pApp->setQuitOnLastWindowClosed(false);
 		pApp->processEvents();
 
+		{
+			std::lock_guard<std::mutex> guard(TimingMutex);
+			Timing.QApplicationUs = GetStartupTimeUs();
+		}
+
 		// Set network config
 		QNetworkProxyFactory::setUseSystemConfiguration (true);
 		QWebSettings::globalSettings()->setAttribute(QWebSettings::PluginsEnabled, true);
@@ -88,45 +129,130 @@ void VaQuoleUIManager::run()
 
 		QWebSettings::globalSettings()->setAttribute(QWebSettings::DeveloperExtrasEnabled, true);
 		QWebSettings::globalSettings()->setAttribute(QWebSettings::ScrollAnimatorEnabled, true);
+
+		{
+			std::lock_guard<std::mutex> guard(TimingMutex);
+			Timing.WebKitSettingsUs = GetStartupTimeUs();
+		}
 	}
 
+	// Engine commands wake the thread up, so it sleeps until Qt or engine has something to do
+	{
+		std::lock_guard<std::mutex> guard(DispatcherMutex);
+		Dispatcher = QAbstractEventDispatcher::instance();
+	}
+
+	MarkReady();
+
+	TraceRecorder::Get().SetThreadName("VaQuoleUI");
+
+	// Time of event processing, sleeping for events isn't counted
+	QElapsedTimer EventLoopTimer;
+	qint64 EventLoopUs = 0;
+	bool bEventLoopAwake = false;
+	quint64 EventLoopTraceUs = 0;
+
+	auto BeginEventLoopSlice = [&]()
+	{
+		EventLoopTimer.start();
+		EventLoopTraceUs = TraceRecorder::Get().IsEnabled() ? TraceRecorder::GetTimeUs() : 0;
+		bEventLoopAwake = true;
+	};
+
+	auto EndEventLoopSlice = [&]()
+	{
+		if (bEventLoopAwake)
+		{
+			EventLoopUs += EventLoopTimer.nsecsElapsed() / 1000;
+			bEventLoopAwake = false;
+
+			if (EventLoopTraceUs != 0 && TraceRecorder::Get().IsEnabled())
+			{
+				TraceRecorder::Get().Record("ProcessEvents", EventLoopTraceUs, TraceRecorder::GetTimeUs() - EventLoopTraceUs);
+			}
+		}
+	};
+
+	QMetaObject::Connection BlockConnection = QObject::connect(Dispatcher, &QAbstractEventDispatcher::aboutToBlock, [&]()
+	{
+		EndEventLoopSlice();
+	});
+
+	QMetaObject::Connection AwakeConnection = QObject::connect(Dispatcher, &QAbstractEventDispatcher::awake, [&]()
+	{
+		if (!bEventLoopAwake)
+		{
+			BeginEventLoopSlice();
+		}
+	});
+
 	while (!m_stop)
 	{
+		// Pages are deleted by this thread only, so the copy stays valid during the tick
+		typedef QPair<int, VaQuoleWebUI*> ScheduledPage;
+		QList<ScheduledPage> Schedule;
+
 		mutex.lock();
-		int PagesNum = WebPages.size();
+		foreach (VaQuoleWebUI* Page, WebPages)
+		{
+			Schedule.append(ScheduledPage(Page->GetData()->Priority, Page));
+		}
 		mutex.unlock();
 
-		for(int i = 0; i < PagesNum; i++)
+		// Important pages get the time first
+		std::stable_sort(Schedule.begin(), Schedule.end(), [](const ScheduledPage& A, const ScheduledPage& B)
 		{
-			// [START] Lock pages list
-			mutex.lock();
+			return A.first < B.first;
+		});
 
-			VaQuoleWebUI* Page = WebPages.at(i);
+		QElapsedTimer TickTimer;
+		TickTimer.start();
 
-			// [START] Lock data to read values
-			Page->mutex.lock();
+		const qint64 BudgetUs = TickBudgetUs;
+		bool bDeferredWork = false;
+
+		foreach (const ScheduledPage& Scheduled, Schedule)
+		{
+			VaQuoleWebUI* Page = Scheduled.second;
 
 			UIDataKeeper* ExtComm = Page->GetData();
 			Q_CHECK_PTR(ExtComm);
 
-			// Create webview if necessary
-			VaQuoleWebView* WebView = WebViews.value(ExtComm->ObjectId, NULL);
-			if(WebView == NULL)
+			// Low priority pages wait for the next tick when budget is spent, but never for too long
+			if (ShouldDeferPage((EPagePriority::Type)Scheduled.first, ExtComm->DeferredTicks, TickTimer.nsecsElapsed() / 1000, BudgetUs))
 			{
-				WebView = new VaQuoleWebView();
-				WebView->setContextMenuPolicy(Qt::NoContextMenu);
+				ExtComm->DeferredTicks++;
+				bDeferredWork = true;
+
+				std::lock_guard<std::mutex> guard(Page->mutex);
+				ExtComm->ScheduleStats.DeferredTicks++;
+
+				continue;
+			}
+
+			ExtComm->DeferredTicks = 0;
+
+			TraceScope ServiceTrace("ServicePage", ExtComm);
 
-				// Constuct page that ignores modal JS dialogs
-				VaQuoleWebPage *WebPage = new VaQuoleWebPage(WebView);
-				WebView->setPage(WebPage);
+			QElapsedTimer ServiceTimer;
+			ServiceTimer.start();
 
-				WebView->show();
+			// [START] Lock data to read values
+			Page->mutex.lock();
+
+			// Take pre-warmed webview or create it if pool is empty
+			VaQuoleWebView* WebView = WebViews.value(ExtComm->ObjectId, NULL);
+			if(WebView == NULL)
+			{
+				WebView = SpareViews.isEmpty() ? CreateWebView() : SpareViews.takeLast();
+				WebView->resetPageLoadState();
 				WebViews.insert(ExtComm->ObjectId, WebView);
+				WebView->setTraceId(ExtComm);
 			}
 
 			// Cache data from struct
-			QString NewURL = ExtComm->NewURL;
-
+			bool bEnabled = ExtComm->bEnabled;
+			FrameFormat OutputFormat(ExtComm->OutputFormat, false, ExtComm->CompressionQuality);
 			bool bNewTransparency = ExtComm->bDesiredTransparency;
 			int NewWidth = ExtComm->DesiredWidth;
 			int NewHeight = ExtComm->DesiredHeight;
@@ -135,50 +261,136 @@ void VaQuoleUIManager::run()
 			bool bTransparencyChanged = bNewTransparency != WebView->getTransparency();
 			bool bSizeChanged = (WebView->width() != NewWidth || WebView->height() != NewHeight);
 
-			// Extract mouse events
-			QList<MouseEvent> MouseEvents = ExtComm->MouseEvents;
-			QList<KeyEvent> KeyEvents = ExtComm->KeyEvents;
-
-			// Process JavaScript commands
-			QPair<QString, QString> ScriptCommand;
-			foreach (ScriptCommand, ExtComm->ScriptCommands)
+			// Switch zero-copy mode. Qt thread is the only one who paints, so it's safe to do it here
+			ExternalFramebuffer& Framebuffer = ExtComm->Framebuffer;
+			if (Framebuffer.Bits != ExtComm->DesiredFramebufferBits ||
+				Framebuffer.Stride != ExtComm->DesiredFramebufferStride ||
+				Framebuffer.Width != ExtComm->DesiredFramebufferWidth ||
+				Framebuffer.Height != ExtComm->DesiredFramebufferHeight)
 			{
-				QVariant ScriptResult = WebView->page()->mainFrame()->evaluateJavaScript(ScriptCommand.second);
+				Framebuffer.Bits = ExtComm->DesiredFramebufferBits;
+				Framebuffer.Stride = ExtComm->DesiredFramebufferStride;
+				Framebuffer.Width = ExtComm->DesiredFramebufferWidth;
+				Framebuffer.Height = ExtComm->DesiredFramebufferHeight;
 
-				QString ScriptResultStr = ScriptResult.toString();
-				if(!ScriptResultStr.isEmpty() && !ScriptResultStr.isNull())
-				{
-					QPair<QString, QString> ScriptResultPair;
-					ScriptResultPair.first = ScriptCommand.first;
-					ScriptResultPair.second = ScriptResultStr;
-
-					ExtComm->ScriptResults.append(ScriptResultPair);
-				}
+				WebView->setExternalFramebuffer(Framebuffer.Bits ? &Framebuffer : NULL);
 			}
 
+			WebView->setOutputFormat(OutputFormat.PixelFormat);
+			WebView->setTargetFrameRate(ExtComm->TargetFrameRate);
+
+			// Disabled and hidden pages are suspended, so they don't burn CPU on timers and animations
+			WebView->setHibernated(!bEnabled || Scheduled.first == EPagePriority::Hidden);
+
+			// Account page load
+			ExtComm->Stats.PaintUs += WebView->takePaintTime();
+			ExtComm->Stats.ImageBytes = WebView->getImageDataSize();
+			ExtComm->Stats.ContentBytes = WebView->page()->totalBytes();
+			ExtComm->PacingStats = WebView->getFramePacingStats();
+
 			// Extract JavaScript events
 			QList< QPair<QString, QString> > ScriptEvents;
 			WebView->getCachedEvents(ScriptEvents, true);
 			ExtComm->ScriptEvents.append(ScriptEvents);
 
 			// External data update (mark we've read it)
-			ExtComm->NewURL = "";
 			ExtComm->bTransparent = WebView->getTransparency();
 			ExtComm->bPageLoaded = WebView->isLoadFinished();
+			ExtComm->bHibernating = WebView->isHibernated();
 			ExtComm->Width = WebView->width();
 			ExtComm->Height = WebView->height();
-			ExtComm->MouseEvents.clear();
-			ExtComm->KeyEvents.clear();
-			ExtComm->ScriptCommands.clear();
-
-			// Update grabbed view
-			UpdateImageBuffer(ExtComm, WebView);
 
 			// [END] Unlock page data
 			Page->mutex.unlock();
 
-			// [END] Unlock pages list
-			mutex.unlock();
+			// Input events and scripts are queued without locks
+			PageCommands Commands;
+			ExtComm->Commands.Drain(Commands);
+
+			// Slow script shouldn't block engine calls, so it's evaluated without locks
+			if (!Commands.ScriptCommands.isEmpty() || !Commands.ScriptBatches.isEmpty())
+			{
+				TraceScope ScriptTrace("EvaluateJavaScript", ExtComm);
+
+				QElapsedTimer ScriptTimer;
+				ScriptTimer.start();
+
+				QList< QPair<QString, QString> > ScriptResults;
+				QList< QPair<quint32, ScriptValue> > ScriptCallResults;
+				int ScriptsEvaluated = Commands.ScriptCommands.size();
+				int BatchIndex = 0;
+
+				for (int i = 0; i <= Commands.ScriptCommands.size(); i++)
+				{
+					// Batches queued before this script go first
+					while (BatchIndex < Commands.ScriptBatches.size() && Commands.ScriptBatches[BatchIndex].ScriptCommandsBefore <= i)
+					{
+						EvaluateScriptBatch(WebView, Commands.ScriptBatches[BatchIndex], ScriptCallResults);
+						ScriptsEvaluated += Commands.ScriptBatches[BatchIndex].Scripts.size();
+						BatchIndex++;
+					}
+
+					if (i == Commands.ScriptCommands.size())
+					{
+						break;
+					}
+
+					const QPair<QString, QString>& ScriptCommand = Commands.ScriptCommands[i];
+					QVariant ScriptResult = WebView->page()->mainFrame()->evaluateJavaScript(ScriptCommand.second);
+
+					// Empty results are passed too, so engine never waits for the script forever
+					QPair<QString, QString> ScriptResultPair;
+					ScriptResultPair.first = ScriptCommand.first;
+					ScriptResultPair.second = ScriptResult.toString();
+
+					ScriptResults.append(ScriptResultPair);
+				}
+
+				const qint64 ScriptTimeUs = ScriptTimer.nsecsElapsed() / 1000;
+
+				// Scripts could emit events too, we may sleep before the next pass
+				WebView->getCachedEvents(ScriptEvents, true);
+
+				// Asynchronous calls are completed before the page is locked, their callbacks can call it
+				PublishScriptCallResults(Page, ScriptCallResults);
+
+				// Publish results back
+				std::lock_guard<std::mutex> guard(Page->mutex);
+				ExtComm->ScriptResults.append(ScriptResults);
+				ExtComm->ScriptEvents.append(ScriptEvents);
+				ExtComm->Stats.ScriptUs += ScriptTimeUs;
+				ExtComm->Stats.ScriptsEvaluated += ScriptsEvaluated;
+			}
+
+			// Update grabbed view. Frames are passed without locks, so engine never waits for us.
+			// Copy image only if page is enabled! Painted region is kept in view until then
+			bool bFramePublished = false;
+			qint64 BytesCopied = 0;
+			qint64 CopyUs = 0;
+			if (bEnabled)
+			{
+				QElapsedTimer CopyTimer;
+				CopyTimer.start();
+
+				bFramePublished = UpdateImageBuffer(ExtComm, WebView, OutputFormat, BytesCopied);
+				CopyUs = CopyTimer.nsecsElapsed() / 1000;
+			}
+
+			// Inputs delivered on previous ticks were painted before this frame
+			QVector<quint64> InputLatencies;
+			if (bFramePublished && !ExtComm->PendingInputs.isEmpty())
+			{
+				const quint64 FrameTimeUs = TraceRecorder::GetTimeUs();
+
+				typedef QPair<quint32, quint64> PendingInput;
+				foreach (const PendingInput& Input, ExtComm->PendingInputs)
+				{
+					InputLatencies.append(FrameTimeUs - Input.second);
+				}
+
+				ExtComm->PresentedInputId = ExtComm->PendingInputs.last().first;
+				ExtComm->PendingInputs.clear();
+			}
 
 			// Check primary visual changes
 			if(bTransparencyChanged || bSizeChanged)
@@ -195,17 +407,21 @@ void VaQuoleUIManager::run()
 			}
 
 			// Check URL
-			if(!NewURL.isEmpty())
+			if(!Commands.NewURL.isEmpty())
 			{
-				qDebug() << "Load url:" << NewURL;
+				qDebug() << "Load url:" << Commands.NewURL;
 				WebView->resetPageLoadState();
-				WebView->load(QUrl(NewURL));
+				WebView->load(QUrl(Commands.NewURL));
 			}
 
+			QVector<quint64> DeliveryLatencies;
+
 			// Process mouse events
 			MouseEvent MyMouseEvent;
-			foreach (MyMouseEvent, MouseEvents)
+			foreach (MyMouseEvent, Commands.MouseEvents)
 			{
+				TraceScope InputTrace("DeliverInput", ExtComm);
+
 				if(MyMouseEvent.button == Qt::NoButton)
 				{
 					if (MyMouseEvent.bScrollUp)
@@ -232,38 +448,114 @@ void VaQuoleUIManager::run()
 				{
 					VaQuole::simulateMouseClick(WebView, MyMouseEvent.eventPos, MyMouseEvent.button, MyMouseEvent.modifiers, MyMouseEvent.bButtonPressed);
 				}
+
+				const quint64 DeliveredUs = TraceRecorder::GetTimeUs();
+				DeliveryLatencies.append(DeliveredUs - MyMouseEvent.TimeUs);
+				ExtComm->PendingInputs.append(qMakePair(MyMouseEvent.InputId, MyMouseEvent.TimeUs));
 			}
 
 			// Process key events
 			KeyEvent MyKeyEvent;
-			foreach (MyKeyEvent, KeyEvents)
+			foreach (MyKeyEvent, Commands.KeyEvents)
 			{
+				TraceScope InputTrace("DeliverInput", ExtComm);
+
 				VaQuole::simulateKey(WebView, MyKeyEvent.key, MyKeyEvent.modifiers, MyKeyEvent.text, MyKeyEvent.bKeyPressed);
+
+				const quint64 DeliveredUs = TraceRecorder::GetTimeUs();
+				DeliveryLatencies.append(DeliveredUs - MyKeyEvent.TimeUs);
+				ExtComm->PendingInputs.append(qMakePair(MyKeyEvent.InputId, MyKeyEvent.TimeUs));
+			}
+
+			// Mouse and key events are delivered separately, so restore their order
+			if (!Commands.MouseEvents.isEmpty() && !Commands.KeyEvents.isEmpty())
+			{
+				std::sort(ExtComm->PendingInputs.begin(), ExtComm->PendingInputs.end());
+			}
+
+			// Input that changed nothing on the page would wait for unrelated frame forever
+			quint64 InputsNoResponse = 0;
+			const quint64 NowUs = TraceRecorder::GetTimeUs();
+			while (!ExtComm->PendingInputs.isEmpty() && NowUs - ExtComm->PendingInputs.first().second > MaxInputResponseUs)
+			{
+				ExtComm->PendingInputs.removeFirst();
+				InputsNoResponse++;
+			}
+
+			// Account scheduling
+			const qint64 ServiceUs = ServiceTimer.nsecsElapsed() / 1000;
+
+			std::lock_guard<std::mutex> guard(Page->mutex);
+			PageScheduleStats& Stats = ExtComm->ScheduleStats;
+			Stats.ServicedTicks++;
+			Stats.LastServiceUs = (unsigned int)ServiceUs;
+			Stats.MaxServiceUs = qMax(Stats.MaxServiceUs, Stats.LastServiceUs);
+			Stats.TotalServiceUs += ServiceUs;
+
+			PageStats& Counters = ExtComm->Stats;
+			Counters.CopyUs += CopyUs;
+			Counters.BytesCopied += BytesCopied;
+			Counters.FramesProduced += bFramePublished ? 1 : 0;
+			Counters.InputEventsProcessed += Commands.MouseEvents.size() + Commands.KeyEvents.size();
+
+			foreach (quint64 LatencyUs, DeliveryLatencies)
+			{
+				ExtComm->DeliveryLatency.Add(LatencyUs);
 			}
 
-			// Update pages num to be sure that we're in array bounds
-			mutex.lock();
-			PagesNum = WebPages.size();
-			mutex.unlock();
+			foreach (quint64 LatencyUs, InputLatencies)
+			{
+				ExtComm->InputLatency.Add(LatencyUs);
+			}
+
+			ExtComm->InputsNoResponse += InputsNoResponse;
+		}
+
+		// Wait for timers, repaints, network replies or engine commands and process them.
+		// Deferred pages should be serviced and view pool refilled on the next tick, so don't sleep then
+		const bool bPoolRefill = SpareViews.size() < ViewPoolSize;
+
+		if (TickHook != NULL)
+		{
+			TickHook();
 		}
 
-		// Process Qt events
-		qApp->processEvents();
+		EventLoopUs = 0;
+		BeginEventLoopSlice();
+
+		qApp->processEvents((bDeferredWork || bPoolRefill) ? QEventLoop::AllEvents : QEventLoop::WaitForMoreEvents);
+
+		EndEventLoopSlice();
 
 		// Clean pages marked for delete
+		QList<VaQuoleWebView*> ReleasedViews;
+		QList< std::shared_ptr<ScriptCallState> > CancelledCalls;
+
 		mutex.lock();
-		PagesNum = WebPages.size();
+		ThreadStats.Ticks++;
+		ThreadStats.EventLoopUs += EventLoopUs;
+
+		const int PagesNum = WebPages.size();
 		for(int j = 0; j < WebPages.size(); )
 		{
 			if(WebPages.at(j)->GetData()->bMarkedForDelete)
 			{
+				TraceScope DeleteTrace("DeletePage", WebPages.at(j)->GetData());
+
+				RetirePageStats(ThreadStats, WebPages.at(j)->GetData());
+				CancelledCalls.append(WebPages.at(j)->GetData()->ScriptCalls.values());
+
 				VaQuoleWebView* ViewToDelete = WebViews.value(WebPages.at(j)->GetData()->ObjectId);
 				VaQuoleWebUI* PageToDelete = WebPages.at(j);
 
 				WebViews.remove(WebPages.at(j)->GetData()->ObjectId);
 				WebPages.removeAt(j);
 
-				delete ViewToDelete;
+				if (ViewToDelete)
+				{
+					ReleasedViews.append(ViewToDelete);
+				}
+
 				delete PageToDelete->GetData();
 				delete PageToDelete;
 			}
@@ -274,6 +566,26 @@ void VaQuoleUIManager::run()
 		}
 		mutex.unlock();
 
+		CancelScriptCalls(CancelledCalls);
+
+		// Views of deleted pages go back to the pool, so the next page gets them ready
+		foreach (VaQuoleWebView* View, ReleasedViews)
+		{
+			TraceScope RecycleTrace("RecycleView");
+			RecycleWebView(View);
+		}
+
+		// Pre-warm one view per tick, so pages never wait for WebKit initialisation
+		if (!bDeferredWork && SpareViews.size() < ViewPoolSize)
+		{
+			SpareViews.append(CreateWebView());
+		}
+
+		while (SpareViews.size() > ViewPoolSize)
+		{
+			delete SpareViews.takeLast();
+		}
+
 		// Check we've closed some windows
 		if( PagesNum != WebPages.size() )
 		{
@@ -282,33 +594,322 @@ void VaQuoleUIManager::run()
 		}
 	}
 
+	QObject::disconnect(BlockConnection);
+	QObject::disconnect(AwakeConnection);
+
+	qDeleteAll(SpareViews);
+	SpareViews.clear();
+
+	{
+		std::lock_guard<std::mutex> guard(DispatcherMutex);
+		Dispatcher = NULL;
+	}
+
 	qDebug() << "About to exit";
 }
 
+void VaQuoleUIManager::wakeUp()
+{
+	std::lock_guard<std::mutex> guard(DispatcherMutex);
+
+	if (Dispatcher)
+	{
+		Dispatcher->wakeUp();
+	}
+}
+
+void VaQuoleUIManager::SetViewPoolSize(int Size)
+{
+	ViewPoolSize = qMax(Size, 0);
+
+	wakeUp();
+}
+
+VaQuoleWebView* VaQuoleUIManager::CreateWebView()
+{
+	VaQuoleWebView* WebView = new VaQuoleWebView();
+	WebView->setContextMenuPolicy(Qt::NoContextMenu);
+
+	// Constuct page that ignores modal JS dialogs
+	VaQuoleWebPage *WebPage = new VaQuoleWebPage(WebView);
+	WebView->setPage(WebPage);
+
+	WebView->show();
+
+	{
+		std::lock_guard<std::mutex> guard(TimingMutex);
+		if (Timing.FirstViewUs == 0)
+		{
+			Timing.FirstViewUs = GetStartupTimeUs();
+		}
+	}
+
+	return WebView;
+}
+
+void VaQuoleUIManager::RecycleWebView(VaQuoleWebView* WebView)
+{
+	if (SpareViews.size() >= ViewPoolSize)
+	{
+		delete WebView;
+		return;
+	}
+
+	// Network and memory caches are shared, so they're kept for the next page
+	WebView->resetForReuse();
+	SpareViews.append(WebView);
+}
+
+void VaQuoleUIManager::SetTickBudget(int BudgetUs)
+{
+	TickBudgetUs = qMax(BudgetUs, 0);
+
+	wakeUp();
+}
+
+int VaQuoleUIManager::GetMaxDeferredTicks(EPagePriority::Type Priority)
+{
+	switch (Priority)
+	{
+	case EPagePriority::Background:	return 4;
+	case EPagePriority::Hidden:		return 16;
+	default:						return 0;
+	}
+}
+
+bool VaQuoleUIManager::ShouldDeferPage(EPagePriority::Type Priority, int DeferredTicks, qint64 TickTimeUs, qint64 BudgetUs)
+{
+	return TickTimeUs >= BudgetUs && DeferredTicks < GetMaxDeferredTicks(Priority);
+}
+
+std::shared_future<void> VaQuoleUIManager::GetReadyFuture() const
+{
+	return ReadyFuture;
+}
+
+StartupTiming VaQuoleUIManager::GetStartupTiming()
+{
+	std::lock_guard<std::mutex> guard(TimingMutex);
+
+	return Timing;
+}
+
+void VaQuoleUIManager::MarkReady()
+{
+	const unsigned long long ReadyUs = GetStartupTimeUs();
+
+	{
+		std::lock_guard<std::mutex> guard(TimingMutex);
+		Timing.ReadyUs = ReadyUs;
+	}
+
+	qDebug() << "UI thread is ready in" << ReadyUs << "us";
+
+	ReadyPromise.set_value();
+}
+
+unsigned long long VaQuoleUIManager::GetStartupTimeUs() const
+{
+	// Stage finished just after start still should be distinguished from not finished one
+	return qMax(StartupClock.nsecsElapsed() / 1000, (qint64)1);
+}
+
 void VaQuoleUIManager::AddPage(VaQuoleWebUI *Page)
+{
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+
+		WebPages.append(Page);
+	}
+
+	wakeUp();
+}
+
+bool VaQuoleUIManager::UpdateImageBuffer(UIDataKeeper *ExtComm, VaQuoleWebView *WebView, FrameFormat OutputFormat, qint64& BytesCopied)
+{
+	TraceScope CopyTrace("CopyFrame", ExtComm);
+
+	QRegion PaintedRegion;
+	WebView->getDirtyRegion(PaintedRegion);
+
+	BytesCopied = 0;
+
+	// View paints into host memory itself, so just inform about new frame
+	if (WebView->hasExternalFramebuffer())
+	{
+		WebView->flushPendingExternalPaint();
+
+		if (PaintedRegion.isEmpty())
+		{
+			return false;
+		}
+
+		ExtComm->Frames.PublishExternalFrame();
+		MarkFirstFrame();
+
+		return true;
+	}
+
+	// WebKit repaints whole layers on animations, so publish only tiles that have really changed
+	const QSize ImageSize(WebView->getImageStride() / 4, WebView->getImageDataSize() / qMax(WebView->getImageStride(), 1));
+	PaintedRegion = ExtComm->Tiles.FilterChangedTiles(WebView->getImageData(), WebView->getImageStride(), ImageSize, PaintedRegion);
+
+	// Pixels are converted while they're copied, so engine gets them ready to use
+	OutputFormat.bOpaque = !WebView->getTransparency();
+	BytesCopied = ExtComm->Frames.PublishFrame(WebView->getImageData(), WebView->getImageDataSize(), WebView->getImageStride(),
+		PaintedRegion, OutputFormat);
+
+	if (BytesCopied == 0)
+	{
+		return false;
+	}
+
+	MarkFirstFrame();
+
+	return true;
+}
+
+void VaQuoleUIManager::EvaluateScriptBatch(VaQuoleWebView *WebView, const ScriptBatch& Batch, QList< QPair<quint32, ScriptValue> >& Results)
+{
+	// Sources are passed as JSON array of strings, JSON allows line separators in strings but JavaScript doesn't
+	QString Sources = QString::fromUtf8(QJsonDocument(QJsonArray::fromStringList(Batch.Scripts)).toJson(QJsonDocument::Compact));
+	Sources.replace(QChar(0x2028), QLatin1String("\\u2028"));
+	Sources.replace(QChar(0x2029), QLatin1String("\\u2029"));
+
+	// Each script is evaluated in global scope like a separate call, failed one doesn't stop others.
+	// Every result is [true, value] or [false, error]
+	const QString BatchScript = QLatin1String(
+		"(function(s) {"
+		"	var r = [];"
+		"	for (var i = 0; i < s.length; i++) {"
+		"		try { r.push([true, (0, eval)(s[i])]); } catch (e) { r.push([false, String(e)]); }"
+		"	}"
+		"	return r;"
+		"})(") + Sources + QLatin1String(");");
+
+	const QVariantList Values = WebView->page()->mainFrame()->evaluateJavaScript(BatchScript).toList();
+
+	for (int i = 0; i < Batch.Scripts.size(); i++)
+	{
+		const QVariantList Value = (i < Values.size()) ? Values[i].toList() : QVariantList();
+
+		ScriptValue Result;
+		if (Value.isEmpty())
+		{
+			Result = ScriptValue::FromError(QLatin1String("Script wasn't evaluated"));
+		}
+		else if (Value[0].toBool())
+		{
+			Result = ScriptValue::FromVariant(Value.value(1));
+		}
+		else
+		{
+			Result = ScriptValue::FromError(Value.value(1).toString());
+		}
+
+		Results.append(qMakePair(Batch.FirstCallId + i, Result));
+	}
+}
+
+UIThreadStats VaQuoleUIManager::GetStats()
 {
 	std::lock_guard<std::mutex> guard(mutex);
 
-	WebPages.append(Page);
+	UIThreadStats Stats = ThreadStats;
+	Stats.Pages = WebPages.size();
+
+	foreach (VaQuoleWebUI* Page, WebPages)
+	{
+		PageStats Counters;
+		Page->GetStats(Counters);
+		Stats.Totals.Accumulate(Counters);
+	}
+
+	return Stats;
 }
 
-void VaQuoleUIManager::UpdateImageBuffer(UIDataKeeper *ExtComm, VaQuoleWebView *WebView)
+void VaQuoleUIManager::RetirePageStats(UIThreadStats& Stats, const UIDataKeeper* ExtComm)
 {
-	if(ExtComm->ImageDataSize != WebView->getImageDataSize())
+	// Memory and queues of deleted page aren't used anymore
+	PageStats Counters = ExtComm->Stats;
+	Counters.CommandQueueDepth = 0;
+	Counters.PendingScriptResults = 0;
+	Counters.PendingScriptEvents = 0;
+	Counters.ImageBytes = 0;
+	Counters.ContentBytes = 0;
+
+	Stats.Totals.Accumulate(Counters);
+}
+
+void VaQuoleUIManager::MarkFirstFrame()
+{
+	StartupTiming FinalTiming;
+
 	{
-		if(ExtComm->ImageBits)
+		std::lock_guard<std::mutex> guard(TimingMutex);
+		if (Timing.FirstFrameUs != 0)
 		{
-			delete ExtComm->ImageBits;
+			return;
 		}
 
-		ExtComm->ImageDataSize = WebView->getImageDataSize();
-		ExtComm->ImageBits = new uchar[ExtComm->ImageDataSize];
+		Timing.FirstFrameUs = GetStartupTimeUs();
+		FinalTiming = Timing;
+	}
+
+	qDebug() << "Startup timing (us): QApplication" << FinalTiming.QApplicationUs
+		<< "WebKit settings" << FinalTiming.WebKitSettingsUs
+		<< "ready" << FinalTiming.ReadyUs
+		<< "first view" << FinalTiming.FirstViewUs
+		<< "first frame" << FinalTiming.FirstFrameUs;
+}
+
+void SetTickHook(void (*Hook)())
+{
+	TickHook = Hook;
+}
+
+void PublishScriptCallResults(VaQuoleWebUI *Page, const QList< QPair<quint32, ScriptValue> >& Results)
+{
+	if (Results.isEmpty())
+	{
+		return;
 	}
 
-	// Copy image only if page is enabled!
-	if (ExtComm->bEnabled)
+	UIDataKeeper* ExtComm = Page->GetData();
+	Q_CHECK_PTR(ExtComm);
+
+	QList< QPair<std::shared_ptr<ScriptCallState>, ScriptValue> > CompletedCalls;
+
+	{
+		std::lock_guard<std::mutex> guard(Page->mutex);
+
+		typedef QPair<quint32, ScriptValue> CallResultPair;
+		foreach (const CallResultPair& CallResult, Results)
+		{
+			std::shared_ptr<ScriptCallState> State = ExtComm->ScriptCalls.take(CallResult.first);
+			if (State)
+			{
+				CompletedCalls.append(qMakePair(State, CallResult.second));
+			}
+			else
+			{
+				ExtComm->ScriptCallResults.append(CallResult);
+			}
+		}
+	}
+
+	typedef QPair<std::shared_ptr<ScriptCallState>, ScriptValue> CompletedCallPair;
+	foreach (const CompletedCallPair& CompletedCall, CompletedCalls)
+	{
+		ScriptCallState::Complete(CompletedCall.first, CompletedCall.second);
+	}
+}
+
+void CancelScriptCalls(const QList< std::shared_ptr<ScriptCallState> >& Calls)
+{
+	foreach (const std::shared_ptr<ScriptCallState>& State, Calls)
 	{
-		memcpy(ExtComm->ImageBits, WebView->getImageData(), ExtComm->ImageDataSize);
+		ScriptCallState::Complete(State, ScriptValue::FromError(QLatin1String("Page was destroyed")));
 	}
 }
 
@@ -4,13 +4,24 @@
 #define VAQUOLEAPPTHREAD_H
 
 #include "../Include/VaQuolePublicPCH.h"
+#include "VaQuoleFrameExchange.h"
 #include "VaQuoleWebView.h"
 #include "VaQuoleInputHelpers.h"
+#include "VaQuoleLatency.h"
+#include "VaQuoleCommandQueue.h"
+#include "VaQuoleScriptCall.h"
+#include "VaQuoleStringHelpers.h"
+#include "VaQuoleTileHash.h"
 
 #include <atomic>
+#include <future>
+#include <memory>
 #include <mutex>
 #include <thread>
+#include <vector>
 
+#include <QAbstractEventDispatcher>
+#include <QElapsedTimer>
 #include <QHash>
 #include <QList>
 #include <QString>
@@ -38,8 +49,13 @@ struct UIDataKeeper
 	/** Is last desired page loaded or nor? */
 	bool bPageLoaded;
 
-	/** URL managament */
-	QString NewURL;
+	/** Is page suspended because it's disabled or hidden? */
+	bool bHibernating;
+
+	/** Scheduler data: priority (EPagePriority), ticks page was postponed in a row (Qt thread only) and stats */
+	std::atomic<int> Priority;
+	int DeferredTicks;
+	PageScheduleStats ScheduleStats;
 
 	/** Transparency */
 	bool bTransparent;
@@ -51,19 +67,62 @@ struct UIDataKeeper
 	int DesiredWidth;
 	int DesiredHeight;
 
-	/** Image data */
-	uchar* ImageBits;
-	int ImageDataSize;
+	/** Frame rate limit (0 for none) and pacing stats */
+	int TargetFrameRate;
+	FramePacingStats PacingStats;
+
+	/** Image data passed from Qt thread to engine, each frame has its own serial */
+	FrameExchange Frames;
+	EPixelFormat::Type OutputFormat;
+	ECompressionQuality::Type CompressionQuality;
+
+	/** Hashes of published tiles to skip repainted but unchanged ones (Qt thread only) */
+	TileHashGrid Tiles;
+
+	/** Host memory for zero-copy mode (applied on Qt thread) */
+	ExternalFramebuffer Framebuffer;
+	void* DesiredFramebufferBits;
+	int DesiredFramebufferStride;
+	int DesiredFramebufferWidth;
+	int DesiredFramebufferHeight;
+
+	/** Input, scripts and URL requests passed to Qt thread without locks */
+	CommandQueue Commands;
+
+	/** Last cursor position sent, packed as (X << 32 | Y) */
+	std::atomic<quint64> LastMousePos;
+
+	/** Input delivery and input-to-frame latency, inputs no frame followed in time */
+	LatencyHistogram DeliveryLatency;
+	LatencyHistogram InputLatency;
+	quint64 InputsNoResponse;
 
-	/** Input data */
-	QList<MouseEvent> MouseEvents;
-	QList<KeyEvent> KeyEvents;
+	/** Delivered inputs waiting for the next frame (Qt thread only) */
+	QList< QPair<quint32, quint64> > PendingInputs;		// InputId, TimeUs
+
+	/** The newest input shown in published frame */
+	std::atomic<quint32> PresentedInputId;
 
 	/** JavaScript data stored in QList to keep strict order */
-	QList< QPair<QString, QString> > ScriptCommands;	// Uuid, ScriptSource
 	QList< QPair<QString, QString> > ScriptResults;		// Uuid, ReturnValue
 	QList< QPair<QString, QString> > ScriptEvents;		// Event, Message
 
+	/** Results of batched scripts and the last call id given out */
+	QList< QPair<quint32, ScriptValue> > ScriptCallResults;
+	std::atomic<quint32> LastScriptCallId;
+
+	/** Asynchronous calls waiting for their results */
+	QHash< quint32, std::shared_ptr<ScriptCallState> > ScriptCalls;
+
+	/** Strings returned to engine, they live until the next call of the same function */
+	TCHARString LastScriptUuid;
+	std::vector<TCHARString> ScriptResultStrings;
+	std::vector<TCHARString> ScriptEventStrings;
+	std::vector<TCHARString> ScriptCallResultStrings;
+
+	/** Work done by Qt thread for the page (queue depth and pending scripts data are read on request) */
+	PageStats Stats;
+
 	/** Defaults */
 	UIDataKeeper()
 		: ObjectId(QUuid::createUuid().toString())
@@ -71,13 +130,31 @@ struct UIDataKeeper
 		bEnabled = false;
 		bMarkedForDelete = false;
 		bPageLoaded = false;
+		bHibernating = false;
+
+		Priority = EPagePriority::Visible;
+		DeferredTicks = 0;
 
 		bDesiredTransparency = false;
 		DesiredWidth = 32;
 		DesiredHeight = 32;
 
-		ImageBits = NULL;
-		ImageDataSize = 0;
+		LastMousePos = ~0ULL;
+
+		InputsNoResponse = 0;
+		PresentedInputId = 0;
+
+		LastScriptCallId = 0;
+
+		TargetFrameRate = 0;
+
+		OutputFormat = EPixelFormat::BGRA8;
+		CompressionQuality = ECompressionQuality::Normal;
+
+		DesiredFramebufferBits = NULL;
+		DesiredFramebufferStride = 0;
+		DesiredFramebufferWidth = 0;
+		DesiredFramebufferHeight = 0;
 	}
 };
 
@@ -93,9 +170,12 @@ public:
 	VaThread(VaThread const&) = delete;
 	VaThread& operator =(VaThread const&) = delete;
 
-	void stop() { m_stop = true; m_thread.join(); }
+	void stop() { m_stop = true; wakeUp(); if (m_thread.joinable()) m_thread.join(); }
 	void start() { m_thread = std::thread(&VaThread::run, this); }
 
+	/** Interrupt thread waiting for work (can be called from any thread) */
+	virtual void wakeUp() { }
+
 protected:
 	virtual void run() = 0;
 	std::atomic<bool> m_stop;
@@ -111,8 +191,11 @@ class VaQuoleUIManager : public VaThread
 {
 	// Begin VaThread Interface
 public:
+	VaQuoleUIManager(bool bInHeadless = false);
 	~VaQuoleUIManager();
 
+	void wakeUp();
+
 protected:
 	void run();
 	// End VaThread Interface
@@ -120,22 +203,108 @@ protected:
 public:
 	void AddPage(VaQuoleWebUI *Page);
 
-private:
-	/** Check that we have valid buffer to keep the image bits */
-	void UpdateImageBuffer(UIDataKeeper *ExtComm, VaQuoleWebView *WebView);
+	/** Future that becomes ready when thread can serve pages */
+	std::shared_future<void> GetReadyFuture() const;
+
+	/** Time of startup stages */
+	StartupTiming GetStartupTiming();
+
+	/** Work done by the thread for all pages */
+	UIThreadStats GetStats();
+
+	/** Keep counters of the page that is being deleted in thread totals (call it with locked mutex) */
+	static void RetirePageStats(UIThreadStats& Stats, const UIDataKeeper* ExtComm);
+
+	/** Time the thread may spend on pages per tick before low priority ones are postponed */
+	void SetTickBudget(int BudgetUs);
+
+	/** Half of 60 fps frame by default */
+	static const int DefaultTickBudgetUs = 8000;
+
+	/** Should page wait for the next tick, when the tick has already taken TickTimeUs and page was postponed DeferredTicks times in a row */
+	static bool ShouldDeferPage(EPagePriority::Type Priority, int DeferredTicks, qint64 TickTimeUs, qint64 BudgetUs);
+
+	/** Number of spare views kept ready for new pages */
+	void SetViewPoolSize(int Size);
+
+	static const int DefaultViewPoolSize = 1;
 
 private:
+	/** How many ticks in a row page of desired priority can be postponed */
+	static int GetMaxDeferredTicks(EPagePriority::Type Priority);
+
+	/** Construct and configure new view */
+	VaQuoleWebView* CreateWebView();
+
+	/** Reset view of deleted page and keep it for the next one (or delete it if pool is full) */
+	void RecycleWebView(VaQuoleWebView* WebView);
+
+	/** Evaluate scripts in one WebKit call, each of them gets its result or error */
+	static void EvaluateScriptBatch(VaQuoleWebView *WebView, const ScriptBatch& Batch, QList< QPair<quint32, ScriptValue> >& Results);
+
+	/** Publish changed parts of the view image for the engine. Returns true if new frame was published */
+	bool UpdateImageBuffer(UIDataKeeper *ExtComm, VaQuoleWebView *WebView, FrameFormat OutputFormat, qint64& BytesCopied);
+
+protected:
+	/** Let waiters know that thread is initialized */
+	void MarkReady();
+
+	/** Time since manager construction (microseconds) */
+	unsigned long long GetStartupTimeUs() const;
+
+	/** Remember and log startup timing when the first frame is published */
+	void MarkFirstFrame();
+
 	/** Locker to be used with external commands */
 	std::mutex mutex;
 
+	/** Startup timing, first frame and view stages are written once */
+	std::mutex TimingMutex;
+	StartupTiming Timing;
+
 	/** List of all opened web pages */
 	QList<VaQuoleWebUI*> WebPages;
 
+	/** Loop counters and counters of deleted pages (locked with mutex) */
+	UIThreadStats ThreadStats;
+
+	/** Scheduler time budget per tick (microseconds) */
+	std::atomic<int> TickBudgetUs;
+
+private:
 	/** Map of all Qt WebView windows */
 	QHash<QString, VaQuoleWebView*> WebViews;
 
+	/** Pre-warmed views that aren't used by pages yet (Qt thread only) */
+	QList<VaQuoleWebView*> SpareViews;
+	std::atomic<int> ViewPoolSize;
+
+	/** Use offscreen platform instead of the window system */
+	bool bHeadless;
+
+	/** Readiness of the thread */
+	std::promise<void> ReadyPromise;
+	std::shared_future<void> ReadyFuture;
+	QElapsedTimer StartupClock;
+
+	/** Event dispatcher of Qt thread that sleeps until it has something to do */
+	std::mutex DispatcherMutex;
+	QAbstractEventDispatcher* Dispatcher;
+
 };
 
+/** Let UI thread know that page has new commands */
+void WakeUpManager();
+
+/** Called by UI thread after each tick, when page data could be published. Set it before Init() */
+void SetTickHook(void (*Hook)());
+
+/** Complete asynchronous calls of the page, other results are kept for GetScriptCallResults() (page mutex should be unlocked) */
+void PublishScriptCallResults(VaQuoleWebUI *Page, const QList< QPair<quint32, ScriptValue> >& Results);
+
+/** Fail asynchronous calls of the page that is being deleted, call it without locks */
+void CancelScriptCalls(const QList< std::shared_ptr<ScriptCallState> >& Calls);
+
 } // namespace VaQuole
 
 #endif // VAQUOLEAPPTHREAD_H
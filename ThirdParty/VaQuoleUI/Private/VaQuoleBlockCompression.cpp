@@ -0,0 +1,497 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#include "VaQuoleBlockCompression.h"
+
+#include <QtGlobal>
+
+#include <math.h>
+#include <string.h>
+
+namespace VaQuole
+{
+
+/** Number of least squares passes made with high quality */
+static const int RefinementPasses = 2;
+
+/** Power iterations to find principal axis of block colors */
+static const int PowerIterations = 8;
+
+/**
+ * Color with 8-bit channels
+ */
+struct BlockColor
+{
+	int R;
+	int G;
+	int B;
+};
+
+
+//////////////////////////////////////////////////////////////////////////
+// Color helpers
+
+static inline int QuantizeChannel(int Value, int MaxValue)
+{
+	return (Value * MaxValue + 127) / 255;
+}
+
+static inline quint16 PackColor565(const BlockColor& Color)
+{
+	return (quint16)((QuantizeChannel(Color.R, 31) << 11) | (QuantizeChannel(Color.G, 63) << 5) | QuantizeChannel(Color.B, 31));
+}
+
+static inline BlockColor UnpackColor565(quint16 Packed)
+{
+	const int R = (Packed >> 11) & 31;
+	const int G = (Packed >> 5) & 63;
+	const int B = Packed & 31;
+
+	BlockColor Color;
+	Color.R = (R << 3) | (R >> 2);
+	Color.G = (G << 2) | (G >> 4);
+	Color.B = (B << 3) | (B >> 2);
+
+	return Color;
+}
+
+static inline BlockColor MixColors(const BlockColor& First, const BlockColor& Second, int FirstWeight, int SecondWeight)
+{
+	const int Total = FirstWeight + SecondWeight;
+
+	BlockColor Color;
+	Color.R = (First.R * FirstWeight + Second.R * SecondWeight) / Total;
+	Color.G = (First.G * FirstWeight + Second.G * SecondWeight) / Total;
+	Color.B = (First.B * FirstWeight + Second.B * SecondWeight) / Total;
+
+	return Color;
+}
+
+static inline int ColorDistance(const BlockColor& First, const BlockColor& Second)
+{
+	const int R = First.R - Second.R;
+	const int G = First.G - Second.G;
+	const int B = First.B - Second.B;
+
+	return R * R + G * G + B * B;
+}
+
+static inline int ClampChannel(float Value)
+{
+	return qBound(0, (int)(Value + 0.5f), 255);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// Color block
+
+/** Choose palette index for each color, returns total squared error. Endpoints are reordered for 4-color mode */
+static int FitColorIndices(const BlockColor* Colors, quint16& Color0, quint16& Color1, int* Indices)
+{
+	// Color0 > Color1 means 4-color mode without transparent black
+	if (Color0 < Color1)
+	{
+		qSwap(Color0, Color1);
+	}
+
+	BlockColor Palette[4];
+	Palette[0] = UnpackColor565(Color0);
+	Palette[1] = UnpackColor565(Color1);
+	Palette[2] = MixColors(Palette[0], Palette[1], 2, 1);
+	Palette[3] = MixColors(Palette[0], Palette[1], 1, 2);
+
+	// Equal endpoints are decoded in 3-color mode, so only the first one is safe
+	const int PaletteSize = (Color0 == Color1) ? 1 : 4;
+
+	int Error = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		int BestIndex = 0;
+		int BestDistance = ColorDistance(Colors[i], Palette[0]);
+
+		for (int j = 1; j < PaletteSize; j++)
+		{
+			const int Distance = ColorDistance(Colors[i], Palette[j]);
+			if (Distance < BestDistance)
+			{
+				BestIndex = j;
+				BestDistance = Distance;
+			}
+		}
+
+		Indices[i] = BestIndex;
+		Error += BestDistance;
+	}
+
+	return Error;
+}
+
+/** Bounding box corners moved inside a bit to reduce the error of outliers */
+static void SelectBoxEndpoints(const BlockColor* Colors, BlockColor& Max, BlockColor& Min)
+{
+	Min = Max = Colors[0];
+	for (int i = 1; i < 16; i++)
+	{
+		Min.R = qMin(Min.R, Colors[i].R);
+		Min.G = qMin(Min.G, Colors[i].G);
+		Min.B = qMin(Min.B, Colors[i].B);
+		Max.R = qMax(Max.R, Colors[i].R);
+		Max.G = qMax(Max.G, Colors[i].G);
+		Max.B = qMax(Max.B, Colors[i].B);
+	}
+
+	const int InsetR = (Max.R - Min.R) / 16;
+	const int InsetG = (Max.G - Min.G) / 16;
+	const int InsetB = (Max.B - Min.B) / 16;
+
+	Min.R += InsetR;
+	Min.G += InsetG;
+	Min.B += InsetB;
+	Max.R -= InsetR;
+	Max.G -= InsetG;
+	Max.B -= InsetB;
+
+	// Pick the box diagonal that follows colors: flip channels that fall while green rises
+	const int CenterR = (Max.R + Min.R) / 2;
+	const int CenterG = (Max.G + Min.G) / 2;
+	const int CenterB = (Max.B + Min.B) / 2;
+
+	int CovarianceRG = 0;
+	int CovarianceBG = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		CovarianceRG += (Colors[i].R - CenterR) * (Colors[i].G - CenterG);
+		CovarianceBG += (Colors[i].B - CenterB) * (Colors[i].G - CenterG);
+	}
+
+	if (CovarianceRG < 0)
+	{
+		qSwap(Max.R, Min.R);
+	}
+
+	if (CovarianceBG < 0)
+	{
+		qSwap(Max.B, Min.B);
+	}
+}
+
+/** Block colors most distant along their principal axis */
+static void SelectAxisEndpoints(const BlockColor* Colors, BlockColor& Max, BlockColor& Min)
+{
+	float Mean[3] = { 0.f, 0.f, 0.f };
+	for (int i = 0; i < 16; i++)
+	{
+		Mean[0] += Colors[i].R;
+		Mean[1] += Colors[i].G;
+		Mean[2] += Colors[i].B;
+	}
+
+	for (int c = 0; c < 3; c++)
+	{
+		Mean[c] /= 16.f;
+	}
+
+	// Covariance matrix is symmetric: RR, RG, RB, GG, GB, BB
+	float Cov[6] = { 0.f, 0.f, 0.f, 0.f, 0.f, 0.f };
+	for (int i = 0; i < 16; i++)
+	{
+		const float R = Colors[i].R - Mean[0];
+		const float G = Colors[i].G - Mean[1];
+		const float B = Colors[i].B - Mean[2];
+
+		Cov[0] += R * R;
+		Cov[1] += R * G;
+		Cov[2] += R * B;
+		Cov[3] += G * G;
+		Cov[4] += G * B;
+		Cov[5] += B * B;
+	}
+
+	float Axis[3] = { 1.f, 1.f, 1.f };
+	for (int Iteration = 0; Iteration < PowerIterations; Iteration++)
+	{
+		const float R = Cov[0] * Axis[0] + Cov[1] * Axis[1] + Cov[2] * Axis[2];
+		const float G = Cov[1] * Axis[0] + Cov[3] * Axis[1] + Cov[4] * Axis[2];
+		const float B = Cov[2] * Axis[0] + Cov[4] * Axis[1] + Cov[5] * Axis[2];
+
+		const float Length = qMax(qMax(fabsf(R), fabsf(G)), fabsf(B));
+		if (Length < 1e-6f)
+		{
+			// All colors are the same
+			Max = Min = Colors[0];
+			return;
+		}
+
+		Axis[0] = R / Length;
+		Axis[1] = G / Length;
+		Axis[2] = B / Length;
+	}
+
+	int MinIndex = 0;
+	int MaxIndex = 0;
+	float MinDot = 0.f;
+	float MaxDot = 0.f;
+
+	for (int i = 0; i < 16; i++)
+	{
+		const float Dot = Colors[i].R * Axis[0] + Colors[i].G * Axis[1] + Colors[i].B * Axis[2];
+		if (i == 0 || Dot < MinDot)
+		{
+			MinDot = Dot;
+			MinIndex = i;
+		}
+
+		if (i == 0 || Dot > MaxDot)
+		{
+			MaxDot = Dot;
+			MaxIndex = i;
+		}
+	}
+
+	Max = Colors[MaxIndex];
+	Min = Colors[MinIndex];
+}
+
+/** Least squares endpoints for the chosen indices */
+static bool RefineEndpoints(const BlockColor* Colors, const int* Indices, BlockColor& Color0, BlockColor& Color1)
+{
+	// Weight of the first endpoint for each index
+	static const float Weights[4] = { 1.f, 0.f, 2.f / 3.f, 1.f / 3.f };
+
+	float AA = 0.f, BB = 0.f, AB = 0.f;
+	float AX[3] = { 0.f, 0.f, 0.f };
+	float BX[3] = { 0.f, 0.f, 0.f };
+
+	for (int i = 0; i < 16; i++)
+	{
+		const float A = Weights[Indices[i]];
+		const float B = 1.f - A;
+		const float Value[3] = { (float)Colors[i].R, (float)Colors[i].G, (float)Colors[i].B };
+
+		AA += A * A;
+		BB += B * B;
+		AB += A * B;
+
+		for (int c = 0; c < 3; c++)
+		{
+			AX[c] += A * Value[c];
+			BX[c] += B * Value[c];
+		}
+	}
+
+	const float Det = AA * BB - AB * AB;
+	if (fabsf(Det) < 1e-6f)
+	{
+		return false;
+	}
+
+	float First[3], Second[3];
+	for (int c = 0; c < 3; c++)
+	{
+		First[c] = (AX[c] * BB - BX[c] * AB) / Det;
+		Second[c] = (BX[c] * AA - AX[c] * AB) / Det;
+	}
+
+	Color0.R = ClampChannel(First[0]);
+	Color0.G = ClampChannel(First[1]);
+	Color0.B = ClampChannel(First[2]);
+	Color1.R = ClampChannel(Second[0]);
+	Color1.G = ClampChannel(Second[1]);
+	Color1.B = ClampChannel(Second[2]);
+
+	return true;
+}
+
+static void EncodeColorBlock(uchar* Dst, const uchar* BlockPixels, ECompressionQuality::Type Quality)
+{
+	BlockColor Colors[16];
+	for (int i = 0; i < 16; i++)
+	{
+		Colors[i].B = BlockPixels[i * 4 + 0];
+		Colors[i].G = BlockPixels[i * 4 + 1];
+		Colors[i].R = BlockPixels[i * 4 + 2];
+	}
+
+	BlockColor Max, Min;
+	if (Quality == ECompressionQuality::Fast)
+	{
+		SelectBoxEndpoints(Colors, Max, Min);
+	}
+	else
+	{
+		SelectAxisEndpoints(Colors, Max, Min);
+	}
+
+	quint16 Color0 = PackColor565(Max);
+	quint16 Color1 = PackColor565(Min);
+	int Indices[16];
+	int Error = FitColorIndices(Colors, Color0, Color1, Indices);
+
+	if (Quality == ECompressionQuality::High)
+	{
+		for (int Pass = 0; Pass < RefinementPasses && Error > 0; Pass++)
+		{
+			BlockColor Refined0, Refined1;
+			if (!RefineEndpoints(Colors, Indices, Refined0, Refined1))
+			{
+				break;
+			}
+
+			quint16 NewColor0 = PackColor565(Refined0);
+			quint16 NewColor1 = PackColor565(Refined1);
+			int NewIndices[16];
+			const int NewError = FitColorIndices(Colors, NewColor0, NewColor1, NewIndices);
+			if (NewError >= Error)
+			{
+				break;
+			}
+
+			Color0 = NewColor0;
+			Color1 = NewColor1;
+			memcpy(Indices, NewIndices, sizeof(Indices));
+			Error = NewError;
+		}
+	}
+
+	quint32 IndexBits = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		IndexBits |= (quint32)Indices[i] << (i * 2);
+	}
+
+	Dst[0] = (uchar)(Color0 & 0xFF);
+	Dst[1] = (uchar)(Color0 >> 8);
+	Dst[2] = (uchar)(Color1 & 0xFF);
+	Dst[3] = (uchar)(Color1 >> 8);
+	Dst[4] = (uchar)(IndexBits & 0xFF);
+	Dst[5] = (uchar)((IndexBits >> 8) & 0xFF);
+	Dst[6] = (uchar)((IndexBits >> 16) & 0xFF);
+	Dst[7] = (uchar)(IndexBits >> 24);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// Alpha block
+
+/** Build alpha palette the same way decoder does */
+static void BuildAlphaPalette(int Alpha0, int Alpha1, int* Palette)
+{
+	Palette[0] = Alpha0;
+	Palette[1] = Alpha1;
+
+	if (Alpha0 > Alpha1)
+	{
+		for (int i = 1; i < 7; i++)
+		{
+			Palette[i + 1] = ((7 - i) * Alpha0 + i * Alpha1) / 7;
+		}
+	}
+	else
+	{
+		for (int i = 1; i < 5; i++)
+		{
+			Palette[i + 1] = ((5 - i) * Alpha0 + i * Alpha1) / 5;
+		}
+
+		Palette[6] = 0;
+		Palette[7] = 255;
+	}
+}
+
+static int FitAlphaIndices(const int* Alphas, int Alpha0, int Alpha1, int* Indices)
+{
+	int Palette[8];
+	BuildAlphaPalette(Alpha0, Alpha1, Palette);
+
+	int Error = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		int BestIndex = 0;
+		int BestDistance = qAbs(Alphas[i] - Palette[0]);
+
+		for (int j = 1; j < 8; j++)
+		{
+			const int Distance = qAbs(Alphas[i] - Palette[j]);
+			if (Distance < BestDistance)
+			{
+				BestIndex = j;
+				BestDistance = Distance;
+			}
+		}
+
+		Indices[i] = BestIndex;
+		Error += BestDistance * BestDistance;
+	}
+
+	return Error;
+}
+
+static void EncodeAlphaBlock(uchar* Dst, const uchar* BlockPixels, ECompressionQuality::Type Quality)
+{
+	int Alphas[16];
+	int Min = 255, Max = 0;
+	int InnerMin = 255, InnerMax = 0;
+
+	for (int i = 0; i < 16; i++)
+	{
+		Alphas[i] = BlockPixels[i * 4 + 3];
+
+		Min = qMin(Min, Alphas[i]);
+		Max = qMax(Max, Alphas[i]);
+
+		// Values that aren't available in 6-value mode palette for free
+		if (Alphas[i] != 0 && Alphas[i] != 255)
+		{
+			InnerMin = qMin(InnerMin, Alphas[i]);
+			InnerMax = qMax(InnerMax, Alphas[i]);
+		}
+	}
+
+	// 8-value mode covers the whole range
+	int Alpha0 = Max;
+	int Alpha1 = Min;
+	int Indices[16];
+	int Error = FitAlphaIndices(Alphas, Alpha0, Alpha1, Indices);
+
+	// Fully transparent and opaque pixels are exact in 6-value mode, so try it for UI edges
+	if (Quality == ECompressionQuality::High && Error > 0 && InnerMin <= InnerMax)
+	{
+		int NewIndices[16];
+		const int NewError = FitAlphaIndices(Alphas, InnerMin, InnerMax, NewIndices);
+		if (NewError < Error)
+		{
+			Alpha0 = InnerMin;
+			Alpha1 = InnerMax;
+			memcpy(Indices, NewIndices, sizeof(Indices));
+		}
+	}
+
+	quint64 IndexBits = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		IndexBits |= (quint64)Indices[i] << (i * 3);
+	}
+
+	Dst[0] = (uchar)Alpha0;
+	Dst[1] = (uchar)Alpha1;
+	for (int i = 0; i < 6; i++)
+	{
+		Dst[2 + i] = (uchar)((IndexBits >> (i * 8)) & 0xFF);
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// Blocks
+
+void EncodeBC1Block(uchar* Dst, const uchar* BlockPixels, ECompressionQuality::Type Quality)
+{
+	EncodeColorBlock(Dst, BlockPixels, Quality);
+}
+
+void EncodeBC3Block(uchar* Dst, const uchar* BlockPixels, ECompressionQuality::Type Quality)
+{
+	EncodeAlphaBlock(Dst, BlockPixels, Quality);
+	EncodeColorBlock(Dst + 8, BlockPixels, Quality);
+}
+
+} // namespace VaQuole
@@ -0,0 +1,22 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#ifndef VAQUOLEBLOCKCOMPRESSION_H
+#define VAQUOLEBLOCKCOMPRESSION_H
+
+#include "../Include/VaQuolePublicPCH.h"
+
+namespace VaQuole
+{
+
+/** Number of bytes in 4x4 block of BGRA pixels passed to encoders (row by row) */
+static const int BlockPixelsSize = 4 * 4 * 4;
+
+/** Encode 4x4 block into BC1 (DXT1) 8-byte block, alpha is ignored */
+void EncodeBC1Block(uchar* Dst, const uchar* BlockPixels, ECompressionQuality::Type Quality);
+
+/** Encode 4x4 block into BC3 (DXT5) 16-byte block with interpolated alpha */
+void EncodeBC3Block(uchar* Dst, const uchar* BlockPixels, ECompressionQuality::Type Quality);
+
+} // namespace VaQuole
+
+#endif // VAQUOLEBLOCKCOMPRESSION_H
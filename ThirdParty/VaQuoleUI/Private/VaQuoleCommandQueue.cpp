@@ -0,0 +1,420 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#include "VaQuoleCommandQueue.h"
+#include "VaQuoleTrace.h"
+
+#include <QVector>
+
+#include <string.h>
+
+namespace VaQuole
+{
+
+CommandQueue::CommandQueue()
+{
+	static_assert((Capacity & (Capacity - 1)) == 0, "Queue capacity should be power of two");
+
+	Cells = new CommandCell[Capacity];
+	for (quint32 i = 0; i < Capacity; i++)
+	{
+		Cells[i].Sequence.store(i, std::memory_order_relaxed);
+	}
+
+	for (int i = 0; i < 2; i++)
+	{
+		Arenas[i].Bits = new uchar[ArenaSize];
+		Arenas[i].Head.store(0);
+		Arenas[i].Writers.store(0);
+		Arenas[i].Records.store(0);
+	}
+
+	CurrentArena.store(0);
+
+	EnqueuePos.store(0);
+	DequeuePos.store(0);
+
+	LastInputId.store(0);
+
+	PeakDepth.store(0);
+	Dropped.store(0);
+	HeapPayloads.store(0);
+}
+
+CommandQueue::~CommandQueue()
+{
+	// Free payloads of commands nobody has read
+	const quint32 End = EnqueuePos.load();
+	for (quint32 Pos = DequeuePos.load(); Pos != End; Pos++)
+	{
+		CommandCell& Cell = Cells[Pos & (Capacity - 1)];
+		if (Cell.Sequence.load() == Pos + 1)
+		{
+			delete[] Cell.Data.HeapPayload;
+		}
+	}
+
+	delete[] Cells;
+
+	for (int i = 0; i < 2; i++)
+	{
+		delete[] Arenas[i].Bits;
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// Producers
+
+bool CommandQueue::PushMouseEvent(const MouseEvent& Event)
+{
+	CommandData Data;
+	Data.Type = Command_Mouse;
+	Data.Flags = (Event.bButtonPressed ? Flag_Pressed : 0) |
+		(Event.bScrollUp ? Flag_ScrollUp : 0) |
+		(Event.bScrollDown ? Flag_ScrollDown : 0);
+	Data.X = Event.eventPos.x();
+	Data.Y = Event.eventPos.y();
+	Data.Code = Event.button;
+	Data.Modifiers = Event.modifiers;
+	Data.InputId = LastInputId.fetch_add(1, std::memory_order_relaxed) + 1;
+	Data.TimeUs = TraceRecorder::GetTimeUs();
+
+	return Push(Data, NULL, 0);
+}
+
+bool CommandQueue::PushKeyEvent(const KeyEvent& Event)
+{
+	CommandData Data;
+	Data.Type = Command_Key;
+	Data.Flags = Event.bKeyPressed ? Flag_Pressed : 0;
+	Data.X = 0;
+	Data.Y = 0;
+	Data.Code = Event.key;
+	Data.Modifiers = Event.modifiers;
+	Data.InputId = LastInputId.fetch_add(1, std::memory_order_relaxed) + 1;
+	Data.TimeUs = TraceRecorder::GetTimeUs();
+
+	return Push(Data, &Event.text, 1);
+}
+
+bool CommandQueue::PushScript(const QString& ScriptUuid, const QString& ScriptSource)
+{
+	CommandData Data;
+	Data.Type = Command_Script;
+	Data.Flags = 0;
+	Data.X = 0;
+	Data.Y = 0;
+	Data.Code = 0;
+	Data.Modifiers = 0;
+	Data.InputId = 0;
+	Data.TimeUs = 0;
+
+	const QString Strings[2] = { ScriptUuid, ScriptSource };
+	return Push(Data, Strings, 2);
+}
+
+bool CommandQueue::PushScriptBatch(quint32 FirstCallId, const QStringList& Scripts)
+{
+	CommandData Data;
+	Data.Type = Command_ScriptBatch;
+	Data.Flags = 0;
+	Data.X = Scripts.size();
+	Data.Y = 0;
+	Data.Code = (int)FirstCallId;
+	Data.Modifiers = 0;
+	Data.InputId = 0;
+	Data.TimeUs = 0;
+
+	const QVector<QString> Strings = Scripts.toVector();
+	return Push(Data, Strings.constData(), Strings.size());
+}
+
+bool CommandQueue::PushURL(const QString& URL)
+{
+	CommandData Data;
+	Data.Type = Command_URL;
+	Data.Flags = 0;
+	Data.X = 0;
+	Data.Y = 0;
+	Data.Code = 0;
+	Data.Modifiers = 0;
+	Data.InputId = 0;
+	Data.TimeUs = 0;
+
+	return Push(Data, &URL, 1);
+}
+
+bool CommandQueue::Push(CommandData& Data, const QString* Strings, int StringsNum)
+{
+	quint32 PayloadSize = 0;
+	for (int i = 0; i < StringsNum; i++)
+	{
+		PayloadSize += sizeof(quint32) + Strings[i].size() * sizeof(ushort);
+	}
+
+	Data.Arena = HeapArena;
+	Data.PayloadOffset = 0;
+	Data.PayloadSize = PayloadSize;
+	Data.HeapPayload = NULL;
+
+	// Copy strings before the record becomes visible to consumer
+	if (PayloadSize > 0)
+	{
+		uchar* Payload = NULL;
+		if (ReservePayload(PayloadSize, Data))
+		{
+			Payload = Arenas[Data.Arena].Bits + Data.PayloadOffset;
+		}
+		else
+		{
+			Data.HeapPayload = new uchar[PayloadSize];
+			Payload = Data.HeapPayload;
+			HeapPayloads.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		for (int i = 0; i < StringsNum; i++)
+		{
+			const quint32 Length = Strings[i].size();
+			memcpy(Payload, &Length, sizeof(Length));
+			memcpy(Payload + sizeof(Length), Strings[i].utf16(), Length * sizeof(ushort));
+			Payload += sizeof(Length) + Length * sizeof(ushort);
+		}
+	}
+
+	// Claim the cell
+	CommandCell* Cell = NULL;
+	quint32 Pos = EnqueuePos.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		Cell = &Cells[Pos & (Capacity - 1)];
+		const quint32 Sequence = Cell->Sequence.load(std::memory_order_acquire);
+		const qint32 Diff = (qint32)(Sequence - Pos);
+
+		if (Diff == 0)
+		{
+			if (EnqueuePos.compare_exchange_weak(Pos, Pos + 1, std::memory_order_relaxed))
+			{
+				break;
+			}
+		}
+		else if (Diff < 0)
+		{
+			// Consumer is too far behind, so command is lost
+			if (Data.Arena != HeapArena)
+			{
+				Arenas[Data.Arena].Writers.fetch_sub(1);
+			}
+
+			delete[] Data.HeapPayload;
+			Dropped.fetch_add(1, std::memory_order_relaxed);
+
+			return false;
+		}
+		else
+		{
+			Pos = EnqueuePos.load(std::memory_order_relaxed);
+		}
+	}
+
+	Cell->Data = Data;
+
+	if (Data.Arena != HeapArena)
+	{
+		// Arena is counted as busy before we stop writing to it
+		Arenas[Data.Arena].Records.fetch_add(1);
+	}
+
+	Cell->Sequence.store(Pos + 1, std::memory_order_release);
+
+	if (Data.Arena != HeapArena)
+	{
+		Arenas[Data.Arena].Writers.fetch_sub(1);
+	}
+
+	return true;
+}
+
+bool CommandQueue::ReservePayload(quint32 Size, CommandData& Data)
+{
+	// Big scripts would exhaust arena for the small input events
+	if (Size > ArenaSize / 4)
+	{
+		return false;
+	}
+
+	for (;;)
+	{
+		const int Index = CurrentArena.load();
+		PayloadArena& Arena = Arenas[Index];
+
+		// Consumer doesn't reset arena with writers, but it could switch arenas before we were counted
+		Arena.Writers.fetch_add(1);
+		if (CurrentArena.load() != Index)
+		{
+			Arena.Writers.fetch_sub(1);
+			continue;
+		}
+
+		// Check first, so failed reservations never move head far beyond the arena
+		if (Arena.Head.load(std::memory_order_relaxed) + Size > ArenaSize)
+		{
+			Arena.Writers.fetch_sub(1);
+			return false;
+		}
+
+		const quint32 Offset = Arena.Head.fetch_add(Size, std::memory_order_relaxed);
+		if (Offset + Size > ArenaSize)
+		{
+			Arena.Writers.fetch_sub(1);
+			return false;
+		}
+
+		Data.Arena = Index;
+		Data.PayloadOffset = Offset;
+
+		return true;
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// Consumer
+
+void CommandQueue::Drain(PageCommands& Commands)
+{
+	// Move producers to the other arena when everything written there is consumed.
+	// Writers are checked before records: writer publishes its record before it leaves
+	const int Current = CurrentArena.load();
+	PayloadArena& OtherArena = Arenas[Current ^ 1];
+	if (OtherArena.Writers.load() == 0 && OtherArena.Records.load() == 0)
+	{
+		OtherArena.Head.store(0);
+		CurrentArena.store(Current ^ 1);
+	}
+
+	const quint32 Depth = EnqueuePos.load(std::memory_order_relaxed) - DequeuePos.load(std::memory_order_relaxed);
+	if (Depth > PeakDepth.load(std::memory_order_relaxed))
+	{
+		PeakDepth.store(Depth, std::memory_order_relaxed);
+	}
+
+	for (;;)
+	{
+		const quint32 Pos = DequeuePos.load(std::memory_order_relaxed);
+		CommandCell& Cell = Cells[Pos & (Capacity - 1)];
+		if (Cell.Sequence.load(std::memory_order_acquire) != Pos + 1)
+		{
+			break;
+		}
+
+		// Free the cell, payload stays valid until arena records are released
+		const CommandData Data = Cell.Data;
+		Cell.Sequence.store(Pos + Capacity, std::memory_order_release);
+		DequeuePos.store(Pos + 1, std::memory_order_relaxed);
+
+		const uchar* Payload = Data.HeapPayload;
+		if (Data.Arena != HeapArena)
+		{
+			Payload = Arenas[Data.Arena].Bits + Data.PayloadOffset;
+		}
+
+		switch (Data.Type)
+		{
+		case Command_Mouse:
+			{
+				MouseEvent Event;
+				Event.eventPos = QPoint(Data.X, Data.Y);
+				Event.button = (Qt::MouseButton)Data.Code;
+				Event.modifiers = Qt::KeyboardModifiers(QFlag(Data.Modifiers));
+				Event.bButtonPressed = (Data.Flags & Flag_Pressed) != 0;
+				Event.bScrollUp = (Data.Flags & Flag_ScrollUp) != 0;
+				Event.bScrollDown = (Data.Flags & Flag_ScrollDown) != 0;
+				Event.InputId = Data.InputId;
+				Event.TimeUs = Data.TimeUs;
+				Commands.MouseEvents.append(Event);
+			}
+			break;
+
+		case Command_Key:
+			{
+				KeyEvent Event;
+				Event.key = (Qt::Key)Data.Code;
+				Event.modifiers = Qt::KeyboardModifiers(QFlag(Data.Modifiers));
+				Event.bKeyPressed = (Data.Flags & Flag_Pressed) != 0;
+				Event.text = ReadString(Payload);
+				Event.InputId = Data.InputId;
+				Event.TimeUs = Data.TimeUs;
+				Commands.KeyEvents.append(Event);
+			}
+			break;
+
+		case Command_Script:
+			{
+				QPair<QString, QString> ScriptCommand;
+				ScriptCommand.first = ReadString(Payload);
+				ScriptCommand.second = ReadString(Payload);
+				Commands.ScriptCommands.append(ScriptCommand);
+			}
+			break;
+
+		case Command_ScriptBatch:
+			{
+				ScriptBatch Batch;
+				Batch.FirstCallId = (quint32)Data.Code;
+				Batch.ScriptCommandsBefore = Commands.ScriptCommands.size();
+				for (int i = 0; i < Data.X; i++)
+				{
+					Batch.Scripts.append(ReadString(Payload));
+				}
+				Commands.ScriptBatches.append(Batch);
+			}
+			break;
+
+		case Command_URL:
+			// Only the last URL matters
+			Commands.NewURL = ReadString(Payload);
+			break;
+
+		default:
+			break;
+		}
+
+		if (Data.Arena != HeapArena)
+		{
+			Arenas[Data.Arena].Records.fetch_sub(1);
+		}
+		else
+		{
+			delete[] Data.HeapPayload;
+		}
+	}
+}
+
+QString CommandQueue::ReadString(const uchar*& Payload)
+{
+	quint32 Length = 0;
+	memcpy(&Length, Payload, sizeof(Length));
+	Payload += sizeof(Length);
+
+	QString Result(Length, Qt::Uninitialized);
+	memcpy(Result.data(), Payload, Length * sizeof(ushort));
+	Payload += Length * sizeof(ushort);
+
+	return Result;
+}
+
+CommandQueueStats CommandQueue::GetStats() const
+{
+	CommandQueueStats Stats;
+
+	// Consumer position is read first, so it's never ahead of producers one
+	const quint32 Pos = DequeuePos.load();
+	Stats.Depth = EnqueuePos.load() - Pos;
+	Stats.PeakDepth = PeakDepth.load(std::memory_order_relaxed);
+	Stats.Dropped = Dropped.load(std::memory_order_relaxed);
+	Stats.HeapPayloads = HeapPayloads.load(std::memory_order_relaxed);
+
+	return Stats;
+}
+
+} // namespace VaQuole
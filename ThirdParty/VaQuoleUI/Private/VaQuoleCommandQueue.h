@@ -0,0 +1,177 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#ifndef VAQUOLECOMMANDQUEUE_H
+#define VAQUOLECOMMANDQUEUE_H
+
+#include "../Include/VaQuolePublicPCH.h"
+#include "VaQuoleInputHelpers.h"
+
+#include <atomic>
+
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+
+namespace VaQuole
+{
+
+/**
+ * Scripts evaluated in one pass, their calls are numbered one by one
+ */
+struct ScriptBatch
+{
+	quint32 FirstCallId;
+	QStringList Scripts;
+
+	/** Number of single scripts queued before the batch, so evaluation order is kept */
+	int ScriptCommandsBefore;
+};
+
+/**
+ * Commands extracted from the queue by Qt thread
+ */
+struct PageCommands
+{
+	/** The last URL requested (empty if none) */
+	QString NewURL;
+
+	QList<MouseEvent> MouseEvents;
+	QList<KeyEvent> KeyEvents;
+	QList< QPair<QString, QString> > ScriptCommands;	// Uuid, ScriptSource
+	QList<ScriptBatch> ScriptBatches;
+
+	bool IsEmpty() const
+	{
+		return NewURL.isEmpty() && MouseEvents.isEmpty() && KeyEvents.isEmpty() && ScriptCommands.isEmpty() &&
+			ScriptBatches.isEmpty();
+	}
+};
+
+/**
+ * Bounded lock-free multi-producer/single-consumer queue of page commands.
+ * Commands are fixed-size records in a ring, strings are copied to one of two
+ * payload arenas that are recycled by consumer in turn, so engine, input and
+ * worker threads never wait for each other or for Qt thread
+ */
+class CommandQueue
+{
+public:
+	/** Number of records in the ring (power of two) */
+	static const quint32 Capacity = 512;
+
+	/** Size of each payload arena. Bigger payloads are allocated on heap */
+	static const quint32 ArenaSize = 64 * 1024;
+
+	CommandQueue();
+	~CommandQueue();
+
+	/**
+	 * Enqueue commands (any thread). Return false if queue is full and command was dropped.
+	 * Input events are numbered from 1 and stamped with trace clock time here
+	 */
+	bool PushMouseEvent(const MouseEvent& Event);
+	bool PushKeyEvent(const KeyEvent& Event);
+	bool PushScript(const QString& ScriptUuid, const QString& ScriptSource);
+	bool PushScriptBatch(quint32 FirstCallId, const QStringList& Scripts);
+	bool PushURL(const QString& URL);
+
+	/** Move all queued commands to the lists (consumer thread only) */
+	void Drain(PageCommands& Commands);
+
+	/** Queue depth and loss counters */
+	CommandQueueStats GetStats() const;
+
+private:
+	CommandQueue(CommandQueue const&) = delete;
+	CommandQueue& operator =(CommandQueue const&) = delete;
+
+	/** Command kinds stored in the ring */
+	enum ECommandType
+	{
+		Command_Mouse,
+		Command_Key,
+		Command_Script,
+		Command_ScriptBatch,
+		Command_URL
+	};
+
+	/** Input flags */
+	enum ECommandFlags
+	{
+		Flag_Pressed = 1,
+		Flag_ScrollUp = 2,
+		Flag_ScrollDown = 4
+	};
+
+	/** Payload isn't kept in arena */
+	static const int HeapArena = -1;
+
+	/** Fixed-size command record */
+	struct CommandData
+	{
+		int Type;
+		int Flags;
+		int X;
+		int Y;
+		int Code;			// Mouse button, key or first call id of scripts batch
+		int Modifiers;
+
+		/** Input number and time it was queued */
+		quint32 InputId;
+		quint64 TimeUs;
+
+		/** Strings are stored as [quint32 length][UTF-16 chars] */
+		int Arena;
+		quint32 PayloadOffset;
+		quint32 PayloadSize;
+		uchar* HeapPayload;
+	};
+
+	/** Ring cell, its sequence tells whether it's free or ready to be read (Vyukov's bounded queue) */
+	struct CommandCell
+	{
+		std::atomic<quint32> Sequence;
+		CommandData Data;
+	};
+
+	/** Payload memory filled by producers and recycled by consumer */
+	struct PayloadArena
+	{
+		uchar* Bits;
+		std::atomic<quint32> Head;
+
+		/** Producers writing to the arena and records not consumed yet */
+		std::atomic<int> Writers;
+		std::atomic<int> Records;
+	};
+
+	/** Copy strings to payload and put the record to the ring */
+	bool Push(CommandData& Data, const QString* Strings, int StringsNum);
+
+	/** Get payload place in current arena (holds arena writer on success) */
+	bool ReservePayload(quint32 Size, CommandData& Data);
+
+	/** Read string written by Push() and advance data pointer */
+	static QString ReadString(const uchar*& Payload);
+
+	CommandCell* Cells;
+	PayloadArena Arenas[2];
+	std::atomic<int> CurrentArena;
+
+	/** Next position to be claimed by producers and read by consumer */
+	std::atomic<quint32> EnqueuePos;
+	std::atomic<quint32> DequeuePos;
+
+	/** Number of the last input event */
+	std::atomic<quint32> LastInputId;
+
+	/** Statistics */
+	std::atomic<quint32> PeakDepth;
+	std::atomic<quint64> Dropped;
+	std::atomic<quint64> HeapPayloads;
+};
+
+} // namespace VaQuole
+
+#endif // VAQUOLECOMMANDQUEUE_H
@@ -0,0 +1,177 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#include "VaQuoleFrameExchange.h"
+#include "VaQuoleFramePool.h"
+#include "VaQuolePixelFormat.h"
+
+#include <QRect>
+#include <QVector>
+
+namespace VaQuole
+{
+
+FrameExchange::FrameExchange()
+	: ReadyState(1)
+	, PublishedSerial(0)
+	, PublishedFormat(EPixelFormat::BGRA8)
+{
+	WriterIndex = 0;
+	WriterSerial = 0;
+	ReaderIndex = 2;
+}
+
+FrameExchange::~FrameExchange()
+{
+	for (int i = 0; i < 3; i++)
+	{
+		FrameBufferPool::Get().Release(Slots[i].Bits);
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// Writer side
+
+/** Number of bytes written to frame for the region */
+static qint64 GetRegionBytes(EPixelFormat::Type Format, const QRegion& Region)
+{
+	const int BlockSize = GetPixelFormatBlockSize(Format);
+	const int BlockBytes = GetPixelFormatBlockBytes(Format);
+
+	qint64 Bytes = 0;
+	foreach (const QRect& Rect, Region.rects())
+	{
+		Bytes += (qint64)Rect.width() * Rect.height() * BlockBytes / (BlockSize * BlockSize);
+	}
+
+	return Bytes;
+}
+
+qint64 FrameExchange::PublishFrame(const uchar* ImageBits, int ImageDataSize, int ImageStride, const QRegion& PaintedRegion,
+	const FrameFormat& Format, bool bPreconverted)
+{
+	FrameSlot& Slot = Slots[WriterIndex];
+
+	const QSize ImageSize(ImageStride / 4, ImageDataSize / qMax(ImageStride, 1));
+	const QRect ImageRect(QPoint(0, 0), ImageSize);
+	QRegion Dirty = PaintedRegion.intersected(ImageRect);
+
+	// Each slot has pixels of the old format, so convert them all again
+	if (Format != WriterFormat)
+	{
+		WriterFormat = Format;
+
+		for (int i = 0; i < 3; i++)
+		{
+			StaleRegions[i] = QRegion(ImageRect);
+		}
+
+		Dirty = QRegion(ImageRect);
+	}
+
+	const FrameFormat ConversionFormat = bPreconverted ? FrameFormat() : Format;
+	const int SlotStride = GetFormatStride(Format.PixelFormat, ImageSize.width());
+	const int SlotDataSize = SlotStride * GetFormatLines(Format.PixelFormat, ImageSize.height());
+	qint64 BytesCopied = 0;
+
+	if (Slot.Width != ImageSize.width() || Slot.Height != ImageSize.height() ||
+		Slot.Format != Format.PixelFormat || Slot.DataSize != SlotDataSize)
+	{
+		FrameBufferPool::Get().Release(Slot.Bits);
+
+		Slot.DataSize = SlotDataSize;
+		Slot.Stride = SlotStride;
+		Slot.Width = ImageSize.width();
+		Slot.Height = ImageSize.height();
+		Slot.Format = Format.PixelFormat;
+		Slot.Bits = FrameBufferPool::Get().Allocate(SlotDataSize);
+
+		// New buffer has no valid data at all
+		Dirty = QRegion(ImageRect);
+		ConvertRegion(Slot.Bits, SlotStride, ImageBits, ImageStride, ImageSize, Dirty, ConversionFormat);
+		BytesCopied = SlotDataSize;
+	}
+	else
+	{
+		// Nothing to publish
+		if (Dirty.isEmpty())
+		{
+			return 0;
+		}
+
+		// Slot is two frames behind, so bring it up to date too
+		const QRegion ConvertedRegion = StaleRegions[WriterIndex].united(Dirty).intersected(ImageRect);
+		ConvertRegion(Slot.Bits, SlotStride, ImageBits, ImageStride, ImageSize, ConvertedRegion, ConversionFormat);
+		BytesCopied = GetRegionBytes(Format.PixelFormat, ConvertedRegion);
+	}
+
+	// Readers copy whole blocks of compressed formats
+	Dirty = AlignToBlocks(Format.PixelFormat, Dirty, ImageSize);
+
+	// Reader hasn't seen previous frame, so it should get its changes with this one
+	QRegion FrameDirty = Dirty;
+	if (ReadyState.load(std::memory_order_acquire) & FreshFrameFlag)
+	{
+		FrameDirty += PublishedDirtyRegion;
+	}
+
+	Slot.DirtyRegion = FrameDirty;
+	Slot.Serial = ++WriterSerial;
+	PublishedDirtyRegion = FrameDirty;
+
+	// Other slots are outdated now
+	for (int i = 0; i < 3; i++)
+	{
+		StaleRegions[i] = (i == WriterIndex) ? QRegion() : StaleRegions[i].united(Dirty);
+	}
+
+	int PrevState = ReadyState.exchange(WriterIndex | FreshFrameFlag, std::memory_order_acq_rel);
+	WriterIndex = PrevState & SlotIndexMask;
+
+	PublishedFormat.store(Format.PixelFormat, std::memory_order_release);
+	PublishedSerial.store(WriterSerial, std::memory_order_release);
+
+	return BytesCopied;
+}
+
+void FrameExchange::PublishExternalFrame()
+{
+	PublishedSerial.store(++WriterSerial, std::memory_order_release);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// Reader side
+
+const FrameSlot& FrameExchange::AcquireFrame()
+{
+	if (ReadyState.load(std::memory_order_acquire) & FreshFrameFlag)
+	{
+		int PrevState = ReadyState.exchange(ReaderIndex, std::memory_order_acq_rel);
+		ReaderIndex = PrevState & SlotIndexMask;
+
+		ReaderDirtyRegion += Slots[ReaderIndex].DirtyRegion;
+	}
+
+	return Slots[ReaderIndex];
+}
+
+QRegion FrameExchange::TakeDirtyRegion()
+{
+	QRegion Region = ReaderDirtyRegion;
+	ReaderDirtyRegion = QRegion();
+
+	return Region;
+}
+
+unsigned int FrameExchange::GetPublishedSerial() const
+{
+	return PublishedSerial.load(std::memory_order_acquire);
+}
+
+EPixelFormat::Type FrameExchange::GetPublishedFormat() const
+{
+	return (EPixelFormat::Type)PublishedFormat.load(std::memory_order_acquire);
+}
+
+} // namespace VaQuole
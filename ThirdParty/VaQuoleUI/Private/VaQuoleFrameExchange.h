@@ -0,0 +1,181 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#ifndef VAQUOLEFRAMEEXCHANGE_H
+#define VAQUOLEFRAMEEXCHANGE_H
+
+#include "../Include/VaQuolePublicPCH.h"
+#include "VaQuolePixelFormat.h"
+
+#include <atomic>
+
+#include <QRegion>
+
+namespace VaQuole
+{
+
+/** Dirty rects count after which one bounding rect is used instead */
+static const int MaxDirtyRects = 16;
+
+/**
+ * One complete frame of the view
+ */
+struct FrameSlot
+{
+	/** Image data */
+	uchar* Bits;
+	int DataSize;
+	int Stride;
+
+	/** Image size in pixels and layout of its data */
+	int Width;
+	int Height;
+	EPixelFormat::Type Format;
+
+	/** Sequence number of the frame, it's increased each time the view was painted */
+	unsigned int Serial;
+
+	/** Part of the image changed since the previous frame seen by reader */
+	QRegion DirtyRegion;
+
+	/** Defaults */
+	FrameSlot()
+	{
+		Bits = NULL;
+		DataSize = 0;
+		Stride = 0;
+		Width = 0;
+		Height = 0;
+		Format = EPixelFormat::BGRA8;
+		Serial = 0;
+	}
+};
+
+/**
+ * External framebuffer ownership states
+ */
+namespace EFramebufferState
+{
+	enum Type
+	{
+		Idle,
+		Painting,
+		HostLocked
+	};
+}
+
+/**
+ * Memory owned by host that the view paints into directly (zero-copy mode)
+ */
+struct ExternalFramebuffer
+{
+	/** Image data */
+	void* Bits;
+	int Stride;
+	int Width;
+	int Height;
+
+	/** Fence between Qt thread painting and host reading */
+	std::atomic<int> State;
+
+	/** Defaults */
+	ExternalFramebuffer()
+		: State(EFramebufferState::Idle)
+	{
+		Bits = NULL;
+		Stride = 0;
+		Width = 0;
+		Height = 0;
+	}
+
+	/** Take the buffer if nobody uses it now */
+	bool TryAcquire(EFramebufferState::Type NewState)
+	{
+		int Expected = EFramebufferState::Idle;
+		return State.compare_exchange_strong(Expected, NewState, std::memory_order_acquire);
+	}
+
+	/** Give the buffer back if it was taken with desired state */
+	bool Release(EFramebufferState::Type OwnState)
+	{
+		int Expected = OwnState;
+		return State.compare_exchange_strong(Expected, EFramebufferState::Idle, std::memory_order_release);
+	}
+};
+
+/**
+ * Triple buffer to pass frames from the Qt thread to the engine without locks.
+ * Writer fills its own slot and swaps it with the ready one, reader swaps its
+ * slot with the ready one only when a fresh frame was published. Both sides
+ * never wait for each other.
+ */
+class FrameExchange
+{
+public:
+	FrameExchange();
+	~FrameExchange();
+
+	FrameExchange(FrameExchange const&) = delete;
+	FrameExchange& operator =(FrameExchange const&) = delete;
+
+
+	//////////////////////////////////////////////////////////////////////////
+	// Writer (Qt thread) side
+
+	/**
+	 * Copy changed parts of the view image into the writer slot converting them to desired format and publish it.
+	 * Preconverted image already has desired 32-bit format and is copied as is.
+	 * Returns number of bytes written to the slot (0 if nothing was published)
+	 */
+	qint64 PublishFrame(const uchar* ImageBits, int ImageDataSize, int ImageStride, const QRegion& PaintedRegion,
+		const FrameFormat& Format = FrameFormat(), bool bPreconverted = false);
+
+	/** Frame was painted into external framebuffer, so only its serial is published */
+	void PublishExternalFrame();
+
+
+	//////////////////////////////////////////////////////////////////////////
+	// Reader side (should be called from one thread at a time)
+
+	/** Get the latest published frame. It stays valid until the next call */
+	const FrameSlot& AcquireFrame();
+
+	/** Get region changed since the last call and clear it */
+	QRegion TakeDirtyRegion();
+
+	/** Serial of the latest published frame (can be called from any thread) */
+	unsigned int GetPublishedSerial() const;
+
+	/** Pixel format of the latest published frame (can be called from any thread) */
+	EPixelFormat::Type GetPublishedFormat() const;
+
+
+private:
+	/** Marks ready slot as not consumed by reader yet */
+	static const int FreshFrameFlag = 0x4;
+	static const int SlotIndexMask = 0x3;
+
+	/** Writer, ready and reader frames */
+	FrameSlot Slots[3];
+
+	/** Ready slot index with fresh frame flag */
+	std::atomic<int> ReadyState;
+
+	/** Serial and format of the frame that was published last */
+	std::atomic<unsigned int> PublishedSerial;
+	std::atomic<int> PublishedFormat;
+
+	/** Writer side data */
+	int WriterIndex;
+	unsigned int WriterSerial;
+	QRegion StaleRegions[3];		// Changes made in view since slot was written
+	QRegion PublishedDirtyRegion;	// Dirty region of the last published frame
+	FrameFormat WriterFormat;
+
+	/** Reader side data */
+	int ReaderIndex;
+	QRegion ReaderDirtyRegion;
+};
+
+} // namespace VaQuole
+
+#endif // VAQUOLEFRAMEEXCHANGE_H
@@ -0,0 +1,88 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#include "VaQuoleFramePacing.h"
+
+namespace VaQuole
+{
+
+FramePacer::FramePacer()
+{
+	FrameIntervalUs = 0;
+	NextFrameTimeUs = 0;
+	LastFrameTimeUs = -1;
+
+	TotalJitterUs = 0;
+	JitterSamples = 0;
+}
+
+bool FramePacer::SetTargetFrameRate(int FrameRate)
+{
+	const qint64 NewIntervalUs = (FrameRate > 0) ? 1000000 / FrameRate : 0;
+	if (NewIntervalUs == FrameIntervalUs)
+	{
+		return false;
+	}
+
+	FrameIntervalUs = NewIntervalUs;
+	Stats.TargetFrameRate = qMax(FrameRate, 0);
+
+	// Don't wait for the frame time of the old rate
+	NextFrameTimeUs = 0;
+
+	return true;
+}
+
+bool FramePacer::BeginFrame(qint64 NowUs, qint64& WaitUs)
+{
+	WaitUs = 0;
+
+	if (FrameIntervalUs > 0)
+	{
+		if (NowUs < NextFrameTimeUs)
+		{
+			WaitUs = NextFrameTimeUs - NowUs;
+			Stats.RepaintsCoalesced++;
+
+			return false;
+		}
+
+		// Keep the cadence, but don't try to catch up frames missed by idle page
+		NextFrameTimeUs += FrameIntervalUs;
+		if (NextFrameTimeUs <= NowUs)
+		{
+			NextFrameTimeUs = NowUs + FrameIntervalUs;
+		}
+
+		// Jitter is measured for continuous animation only
+		if (LastFrameTimeUs >= 0 && NowUs - LastFrameTimeUs < FrameIntervalUs * 2)
+		{
+			const qint64 JitterUs = qAbs(NowUs - LastFrameTimeUs - FrameIntervalUs);
+			TotalJitterUs += JitterUs;
+			JitterSamples++;
+
+			Stats.LastJitterUs = (unsigned int)JitterUs;
+			Stats.MaxJitterUs = qMax(Stats.MaxJitterUs, Stats.LastJitterUs);
+			Stats.MeanJitterUs = (unsigned int)(TotalJitterUs / JitterSamples);
+		}
+
+		LastFrameTimeUs = NowUs;
+	}
+
+	Stats.FramesPainted++;
+
+	return true;
+}
+
+void FramePacer::Reset()
+{
+	NextFrameTimeUs = 0;
+	LastFrameTimeUs = -1;
+	TotalJitterUs = 0;
+	JitterSamples = 0;
+
+	const int TargetFrameRate = Stats.TargetFrameRate;
+	Stats = FramePacingStats();
+	Stats.TargetFrameRate = TargetFrameRate;
+}
+
+} // namespace VaQuole
@@ -0,0 +1,50 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#ifndef VAQUOLEFRAMEPACING_H
+#define VAQUOLEFRAMEPACING_H
+
+#include "../Include/VaQuolePublicPCH.h"
+
+#include <QtGlobal>
+
+namespace VaQuole
+{
+
+/**
+ * Decides when view may paint with limited frame rate: repaints that come
+ * before the next frame time are merged into that frame
+ */
+class FramePacer
+{
+public:
+	FramePacer();
+
+	/** Limit frame rate (0 to paint at once). Returns true if frame interval has changed */
+	bool SetTargetFrameRate(int FrameRate);
+
+	/** Try to paint frame at desired time (microseconds). If it's too early, returns false and time left till the next frame */
+	bool BeginFrame(qint64 NowUs, qint64& WaitUs);
+
+	/** Forget painted frames and their timing, frame rate is kept */
+	void Reset();
+
+	/** Painted frames and their timing */
+	const FramePacingStats& GetStats() const
+	{
+		return Stats;
+	}
+
+private:
+	/** Interval between frames, time of the next and the last one (microseconds) */
+	qint64 FrameIntervalUs;
+	qint64 NextFrameTimeUs;
+	qint64 LastFrameTimeUs;
+
+	FramePacingStats Stats;
+	qint64 TotalJitterUs;
+	qint64 JitterSamples;
+};
+
+} // namespace VaQuole
+
+#endif // VAQUOLEFRAMEPACING_H
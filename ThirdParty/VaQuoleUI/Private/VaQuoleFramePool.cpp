@@ -0,0 +1,125 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#include "VaQuoleFramePool.h"
+
+#include <QtGlobal>
+
+namespace VaQuole
+{
+
+/** The smallest size class is 4 KB */
+static const int MinClassPower = 12;
+
+FrameBufferPool::FrameBufferPool()
+{
+}
+
+FrameBufferPool::~FrameBufferPool()
+{
+	Q_ASSERT(UsedBuffers.isEmpty());
+
+	foreach (const QVector<uchar*>& Free, FreeBuffers)
+	{
+		foreach (uchar* Bits, Free)
+		{
+			qFreeAligned(Bits);
+		}
+	}
+}
+
+FrameBufferPool& FrameBufferPool::Get()
+{
+	// Never destroyed: images can release their buffers during static destruction
+	static FrameBufferPool* Pool = new FrameBufferPool();
+	return *Pool;
+}
+
+uchar* FrameBufferPool::Allocate(size_t Size)
+{
+	const int SizeClass = GetSizeClass(Size);
+	const size_t ClassSize = GetClassSize(SizeClass);
+
+	std::lock_guard<std::mutex> guard(mutex);
+
+	uchar* Bits = NULL;
+
+	QVector<uchar*>& Free = FreeBuffers[SizeClass];
+	if (!Free.isEmpty())
+	{
+		Bits = Free.takeLast();
+
+		Stats.Hits++;
+		Stats.PooledBytes -= ClassSize;
+	}
+	else
+	{
+		Bits = (uchar*)qMallocAligned(ClassSize, Alignment);
+		Q_CHECK_PTR(Bits);
+
+		Stats.Misses++;
+		Stats.AllocatedBytes += ClassSize;
+		Stats.PeakBytes = qMax(Stats.PeakBytes, Stats.AllocatedBytes);
+	}
+
+	UsedBuffers.insert(Bits, SizeClass);
+
+	return Bits;
+}
+
+void FrameBufferPool::Release(uchar* Bits)
+{
+	if (Bits == NULL)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> guard(mutex);
+
+	Q_ASSERT(UsedBuffers.contains(Bits));
+	const int SizeClass = UsedBuffers.take(Bits);
+	const size_t ClassSize = GetClassSize(SizeClass);
+
+	// Keep memory for the next resize unless pool is too big already
+	if (Stats.PooledBytes + ClassSize <= MaxPooledBytes)
+	{
+		FreeBuffers[SizeClass].append(Bits);
+		Stats.PooledBytes += ClassSize;
+	}
+	else
+	{
+		qFreeAligned(Bits);
+		Stats.AllocatedBytes -= ClassSize;
+	}
+}
+
+FramePoolStats FrameBufferPool::GetStats()
+{
+	std::lock_guard<std::mutex> guard(mutex);
+
+	return Stats;
+}
+
+void FrameBufferPool::ReleaseImageData(void* Bits)
+{
+	Get().Release((uchar*)Bits);
+}
+
+int FrameBufferPool::GetSizeClass(size_t Size)
+{
+	int SizeClass = 0;
+	while (GetClassSize(SizeClass) < Size)
+	{
+		SizeClass++;
+	}
+
+	return SizeClass;
+}
+
+size_t FrameBufferPool::GetClassSize(int SizeClass)
+{
+	// Four classes per power of two waste no more than 25% of memory
+	const int Power = MinClassPower + SizeClass / 4;
+	return ((size_t)1 << Power) + (SizeClass % 4) * ((size_t)1 << (Power - 2));
+}
+
+} // namespace VaQuole
@@ -0,0 +1,72 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#ifndef VAQUOLEFRAMEPOOL_H
+#define VAQUOLEFRAMEPOOL_H
+
+#include "../Include/VaQuolePublicPCH.h"
+
+#include <mutex>
+
+#include <QHash>
+#include <QVector>
+
+namespace VaQuole
+{
+
+/**
+ * Pool of frame buffers shared by all pages. Buffers are grouped by size classes
+ * (four per power of two), so resized frames reuse memory of the old ones
+ * instead of churning multi-megabyte allocations
+ */
+class FrameBufferPool
+{
+public:
+	/** Buffers are aligned for SIMD conversion and to never share cache lines */
+	static const int Alignment = 64;
+
+	/** Free buffers above this limit are returned to the system */
+	static const size_t MaxPooledBytes = 64 * 1024 * 1024;
+
+	/** Pool used by all pages */
+	static FrameBufferPool& Get();
+
+	/** Separate pool, so its statistics aren't mixed with the shared one */
+	FrameBufferPool();
+
+	/** Free pooled buffers, the ones given away should be released before */
+	~FrameBufferPool();
+
+	/** Get buffer of at least desired size */
+	uchar* Allocate(size_t Size);
+
+	/** Put buffer back to the pool */
+	void Release(uchar* Bits);
+
+	/** Allocation statistics */
+	FramePoolStats GetStats();
+
+	/** Cleanup function for QImage that keeps its data in pool buffer */
+	static void ReleaseImageData(void* Bits);
+
+private:
+	FrameBufferPool(FrameBufferPool const&) = delete;
+	FrameBufferPool& operator =(FrameBufferPool const&) = delete;
+
+	/** Size class index and its buffer size */
+	static int GetSizeClass(size_t Size);
+	static size_t GetClassSize(int SizeClass);
+
+	std::mutex mutex;
+
+	/** Free buffers by size class */
+	QHash<int, QVector<uchar*> > FreeBuffers;
+
+	/** Size classes of the buffers given away */
+	QHash<uchar*, int> UsedBuffers;
+
+	FramePoolStats Stats;
+};
+
+} // namespace VaQuole
+
+#endif // VAQUOLEFRAMEPOOL_H
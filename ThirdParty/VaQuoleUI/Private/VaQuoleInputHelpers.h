@@ -30,6 +30,10 @@ struct MouseEvent
 	bool bScrollUp;
 	bool bScrollDown;
 
+	/** Input number and time it was queued (set by command queue) */
+	quint32 InputId;
+	quint64 TimeUs;
+
 	MouseEvent()
 	{
 		button = Qt::NoButton;
@@ -38,6 +42,9 @@ struct MouseEvent
 
 		bScrollUp = false;
 		bScrollDown = false;
+
+		InputId = 0;
+		TimeUs = 0;
 	}
 };
 
@@ -48,12 +55,19 @@ struct KeyEvent
 	bool bKeyPressed;
 	QString text;
 
+	/** Input number and time it was queued (set by command queue) */
+	quint32 InputId;
+	quint64 TimeUs;
+
 	KeyEvent()
 	{
 		key = Qt::Key_unknown;
 		modifiers = Qt::NoModifier;
 		bKeyPressed = false;
 		text = QString();
+
+		InputId = 0;
+		TimeUs = 0;
 	}
 };
 
@@ -0,0 +1,86 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#include "VaQuoleLatency.h"
+
+namespace VaQuole
+{
+
+LatencyHistogram::LatencyHistogram()
+{
+	for (int i = 0; i < BucketsNum; i++)
+	{
+		Buckets[i] = 0;
+	}
+
+	Count = 0;
+	Max = 0;
+}
+
+void LatencyHistogram::Add(quint64 ValueUs)
+{
+	Buckets[GetBucket(ValueUs)]++;
+	Count++;
+	Max = qMax(Max, ValueUs);
+}
+
+quint64 LatencyHistogram::GetPercentile(int Percent) const
+{
+	if (Count == 0)
+	{
+		return 0;
+	}
+
+	// Nearest rank
+	const quint64 Rank = qMax((Count * Percent + 99) / 100, (quint64)1);
+
+	quint64 Seen = 0;
+	for (int i = 0; i < BucketsNum; i++)
+	{
+		Seen += Buckets[i];
+		if (Seen >= Rank)
+		{
+			return qMin(GetBucketUpperBound(i), Max);
+		}
+	}
+
+	return Max;
+}
+
+int LatencyHistogram::GetBucket(quint64 ValueUs)
+{
+	// Small values have their own buckets
+	if (ValueUs < SubBuckets)
+	{
+		return (int)ValueUs;
+	}
+
+	int Power = 0;
+	while ((ValueUs >> (Power + 1)) != 0)
+	{
+		Power++;
+	}
+
+	if (Power > MaxPower)
+	{
+		return BucketsNum - 1;
+	}
+
+	const int SubBucket = (int)(ValueUs >> (Power - SubBucketBits)) & (SubBuckets - 1);
+	return (Power - SubBucketBits + 1) * SubBuckets + SubBucket;
+}
+
+quint64 LatencyHistogram::GetBucketUpperBound(int Bucket)
+{
+	if (Bucket < SubBuckets)
+	{
+		return Bucket;
+	}
+
+	const int Power = Bucket / SubBuckets + SubBucketBits - 1;
+	const int SubBucket = Bucket % SubBuckets;
+
+	const quint64 Lower = (quint64)(SubBuckets + SubBucket) << (Power - SubBucketBits);
+	return Lower + ((quint64)1 << (Power - SubBucketBits)) - 1;
+}
+
+} // namespace VaQuole
@@ -0,0 +1,56 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#ifndef VAQUOLELATENCY_H
+#define VAQUOLELATENCY_H
+
+#include <QtGlobal>
+
+namespace VaQuole
+{
+
+/**
+ * Log-linear histogram of latencies: each power of two is split into 8 buckets,
+ * so percentiles are within 12.5% of exact values at any scale
+ */
+class LatencyHistogram
+{
+public:
+	LatencyHistogram();
+
+	/** Add sample (microseconds) */
+	void Add(quint64 ValueUs);
+
+	/** Number of samples */
+	quint64 GetCount() const
+	{
+		return Count;
+	}
+
+	/** The biggest sample */
+	quint64 GetMax() const
+	{
+		return Max;
+	}
+
+	/** Upper bound of the bucket that holds desired percentile of samples */
+	quint64 GetPercentile(int Percent) const;
+
+private:
+	static const int SubBucketBits = 3;
+	static const int SubBuckets = 1 << SubBucketBits;
+
+	/** Up to 2^27 us (more than two minutes) */
+	static const int MaxPower = 26;
+	static const int BucketsNum = (MaxPower - SubBucketBits + 2) * SubBuckets;
+
+	static int GetBucket(quint64 ValueUs);
+	static quint64 GetBucketUpperBound(int Bucket);
+
+	quint64 Buckets[BucketsNum];
+	quint64 Count;
+	quint64 Max;
+};
+
+} // namespace VaQuole
+
+#endif // VAQUOLELATENCY_H
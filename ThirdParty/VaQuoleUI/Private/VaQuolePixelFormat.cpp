@@ -0,0 +1,495 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#include "VaQuolePixelFormat.h"
+#include "VaQuoleBlockCompression.h"
+
+#include <QRect>
+#include <QVector>
+
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define VA_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(VA_SSE2) && (defined(_MSC_VER) || defined(__GNUC__))
+#define VA_AVX2 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define VA_TARGET_AVX2
+#else
+#define VA_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace VaQuole
+{
+
+/** Conversion steps for the line */
+struct ConversionOptions
+{
+	bool bSwizzle;
+	bool bPremultiply;
+	bool bOpaque;
+
+	ConversionOptions(EPixelFormat::Type Format, bool bOpaquePage)
+	{
+		bSwizzle = (Format == EPixelFormat::RGBA8 || Format == EPixelFormat::RGBA8_Premultiplied);
+		bOpaque = bOpaquePage;
+
+		// Opaque pixels are the same in both forms
+		bPremultiply = !bOpaque && (Format == EPixelFormat::BGRA8_Premultiplied || Format == EPixelFormat::RGBA8_Premultiplied);
+	}
+};
+
+
+//////////////////////////////////////////////////////////////////////////
+// Scalar kernel
+
+/** Exact Value * Alpha / 255 with rounding */
+static inline uchar MultiplyAlpha(uint Value, uint Alpha)
+{
+	uint Temp = Value * Alpha + 128;
+	return (uchar)((Temp + (Temp >> 8)) >> 8);
+}
+
+static void ConvertScalar(uchar* Dst, const uchar* Src, int PixelsNum, const ConversionOptions& Options)
+{
+	for (int i = 0; i < PixelsNum; i++, Src += 4, Dst += 4)
+	{
+		uchar B = Src[0];
+		uchar G = Src[1];
+		uchar R = Src[2];
+		uchar A = Options.bOpaque ? 255 : Src[3];
+
+		if (Options.bPremultiply)
+		{
+			B = MultiplyAlpha(B, A);
+			G = MultiplyAlpha(G, A);
+			R = MultiplyAlpha(R, A);
+		}
+
+		Dst[0] = Options.bSwizzle ? R : B;
+		Dst[1] = G;
+		Dst[2] = Options.bSwizzle ? B : R;
+		Dst[3] = A;
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// SSE2 kernel (4 pixels per step)
+
+#ifdef VA_SSE2
+
+/** Multiply colors of two pixels unpacked to 16 bits by their alpha */
+static inline __m128i PremultiplyWordsSSE2(__m128i Pixels)
+{
+	const __m128i AlphaMask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+
+	__m128i Alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(Pixels, 0xFF), 0xFF);
+	__m128i Temp = _mm_add_epi16(_mm_mullo_epi16(Pixels, Alpha), _mm_set1_epi16(128));
+	Temp = _mm_srli_epi16(_mm_add_epi16(Temp, _mm_srli_epi16(Temp, 8)), 8);
+
+	return _mm_or_si128(_mm_andnot_si128(AlphaMask, Temp), _mm_and_si128(AlphaMask, Pixels));
+}
+
+static void ConvertSSE2(uchar* Dst, const uchar* Src, int PixelsNum, const ConversionOptions& Options)
+{
+	const __m128i Zero = _mm_setzero_si128();
+	const __m128i OpaqueMask = _mm_set1_epi32((int)0xFF000000);
+	const __m128i GreenAlphaMask = _mm_set1_epi32((int)0xFF00FF00);
+	const __m128i LowByteMask = _mm_set1_epi32(0x000000FF);
+
+	int i = 0;
+	for (; i + 4 <= PixelsNum; i += 4)
+	{
+		__m128i Pixels = _mm_loadu_si128((const __m128i*)(Src + i * 4));
+
+		if (Options.bOpaque)
+		{
+			Pixels = _mm_or_si128(Pixels, OpaqueMask);
+		}
+		else if (Options.bPremultiply)
+		{
+			__m128i Lo = PremultiplyWordsSSE2(_mm_unpacklo_epi8(Pixels, Zero));
+			__m128i Hi = PremultiplyWordsSSE2(_mm_unpackhi_epi8(Pixels, Zero));
+			Pixels = _mm_packus_epi16(Lo, Hi);
+		}
+
+		if (Options.bSwizzle)
+		{
+			// Swap first and third bytes of each pixel
+			__m128i Blue = _mm_slli_epi32(_mm_and_si128(Pixels, LowByteMask), 16);
+			__m128i Red = _mm_and_si128(_mm_srli_epi32(Pixels, 16), LowByteMask);
+			Pixels = _mm_or_si128(_mm_and_si128(Pixels, GreenAlphaMask), _mm_or_si128(Blue, Red));
+		}
+
+		_mm_storeu_si128((__m128i*)(Dst + i * 4), Pixels);
+	}
+
+	ConvertScalar(Dst + i * 4, Src + i * 4, PixelsNum - i, Options);
+}
+
+#endif // VA_SSE2
+
+
+//////////////////////////////////////////////////////////////////////////
+// AVX2 kernel (8 pixels per step)
+
+#ifdef VA_AVX2
+
+VA_TARGET_AVX2 static inline __m256i PremultiplyWordsAVX2(__m256i Pixels)
+{
+	const __m256i AlphaMask = _mm256_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0);
+
+	__m256i Alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(Pixels, 0xFF), 0xFF);
+	__m256i Temp = _mm256_add_epi16(_mm256_mullo_epi16(Pixels, Alpha), _mm256_set1_epi16(128));
+	Temp = _mm256_srli_epi16(_mm256_add_epi16(Temp, _mm256_srli_epi16(Temp, 8)), 8);
+
+	return _mm256_or_si256(_mm256_andnot_si256(AlphaMask, Temp), _mm256_and_si256(AlphaMask, Pixels));
+}
+
+VA_TARGET_AVX2 static void ConvertAVX2(uchar* Dst, const uchar* Src, int PixelsNum, const ConversionOptions& Options)
+{
+	const __m256i Zero = _mm256_setzero_si256();
+	const __m256i OpaqueMask = _mm256_set1_epi32((int)0xFF000000);
+	const __m256i Swizzle = _mm256_setr_epi8(
+		2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+		2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+	int i = 0;
+	for (; i + 8 <= PixelsNum; i += 8)
+	{
+		__m256i Pixels = _mm256_loadu_si256((const __m256i*)(Src + i * 4));
+
+		if (Options.bOpaque)
+		{
+			Pixels = _mm256_or_si256(Pixels, OpaqueMask);
+		}
+		else if (Options.bPremultiply)
+		{
+			// Unpack and pack work inside 128-bit lanes, so pixels order is kept
+			__m256i Lo = PremultiplyWordsAVX2(_mm256_unpacklo_epi8(Pixels, Zero));
+			__m256i Hi = PremultiplyWordsAVX2(_mm256_unpackhi_epi8(Pixels, Zero));
+			Pixels = _mm256_packus_epi16(Lo, Hi);
+		}
+
+		if (Options.bSwizzle)
+		{
+			Pixels = _mm256_shuffle_epi8(Pixels, Swizzle);
+		}
+
+		_mm256_storeu_si256((__m256i*)(Dst + i * 4), Pixels);
+	}
+
+	ConvertSSE2(Dst + i * 4, Src + i * 4, PixelsNum - i, Options);
+}
+
+/** Check both CPU and OS support AVX2 */
+static bool IsAVX2Supported()
+{
+#ifdef _MSC_VER
+	int Info[4];
+	__cpuid(Info, 0);
+	if (Info[0] < 7)
+	{
+		return false;
+	}
+
+	// OS saves YMM registers
+	__cpuid(Info, 1);
+	const bool bOSXSave = (Info[2] & (1 << 27)) != 0 && (Info[2] & (1 << 28)) != 0;
+	if (!bOSXSave || (_xgetbv(0) & 0x6) != 0x6)
+	{
+		return false;
+	}
+
+	__cpuidex(Info, 7, 0);
+	return (Info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+#endif // VA_AVX2
+
+
+//////////////////////////////////////////////////////////////////////////
+// Compact formats
+
+static void ConvertToRGB565(uchar* Dst, const uchar* Src, int PixelsNum)
+{
+	quint16* DstPixels = (quint16*)Dst;
+
+	for (int i = 0; i < PixelsNum; i++, Src += 4)
+	{
+		const uint R = (Src[2] * 31 + 127) / 255;
+		const uint G = (Src[1] * 63 + 127) / 255;
+		const uint B = (Src[0] * 31 + 127) / 255;
+
+		DstPixels[i] = (quint16)((R << 11) | (G << 5) | B);
+	}
+}
+
+static void ConvertToA8(uchar* Dst, const uchar* Src, int PixelsNum, bool bOpaque)
+{
+	if (bOpaque)
+	{
+		memset(Dst, 255, PixelsNum);
+		return;
+	}
+
+	for (int i = 0; i < PixelsNum; i++)
+	{
+		Dst[i] = Src[i * 4 + 3];
+	}
+}
+
+/** Encode all blocks of the rect, pixels outside the image are clamped to its edge */
+static void EncodeBlocks(uchar* Dst, int DstStride, const uchar* Src, int SrcStride, const QSize& ImageSize,
+	const QRect& Rect, const FrameFormat& Format)
+{
+	const int BlockBytes = GetPixelFormatBlockBytes(Format.PixelFormat);
+	uchar BlockPixels[BlockPixelsSize];
+
+	for (int BlockY = Rect.top() / 4; BlockY <= Rect.bottom() / 4; BlockY++)
+	{
+		for (int BlockX = Rect.left() / 4; BlockX <= Rect.right() / 4; BlockX++)
+		{
+			for (int y = 0; y < 4; y++)
+			{
+				const int SrcY = qMin(BlockY * 4 + y, ImageSize.height() - 1);
+				for (int x = 0; x < 4; x++)
+				{
+					const int SrcX = qMin(BlockX * 4 + x, ImageSize.width() - 1);
+					memcpy(BlockPixels + (y * 4 + x) * 4, Src + SrcY * SrcStride + SrcX * 4, 4);
+				}
+			}
+
+			if (Format.bOpaque)
+			{
+				for (int i = 0; i < 16; i++)
+				{
+					BlockPixels[i * 4 + 3] = 255;
+				}
+			}
+
+			uchar* Block = Dst + BlockY * DstStride + BlockX * BlockBytes;
+			if (Format.PixelFormat == EPixelFormat::BC1)
+			{
+				EncodeBC1Block(Block, BlockPixels, Format.Quality);
+			}
+			else
+			{
+				EncodeBC3Block(Block, BlockPixels, Format.Quality);
+			}
+		}
+	}
+}
+
+int GetFormatStride(EPixelFormat::Type Format, int Width)
+{
+	const int BlockSize = GetPixelFormatBlockSize(Format);
+	return (Width + BlockSize - 1) / BlockSize * GetPixelFormatBlockBytes(Format);
+}
+
+int GetFormatLines(EPixelFormat::Type Format, int Height)
+{
+	const int BlockSize = GetPixelFormatBlockSize(Format);
+	return (Height + BlockSize - 1) / BlockSize;
+}
+
+bool IsFormat32Bit(EPixelFormat::Type Format)
+{
+	return GetPixelFormatBlockSize(Format) == 1 && GetPixelFormatBlockBytes(Format) == 4;
+}
+
+QRegion AlignToBlocks(EPixelFormat::Type Format, const QRegion& Region, const QSize& ImageSize)
+{
+	const int BlockSize = GetPixelFormatBlockSize(Format);
+	if (BlockSize == 1)
+	{
+		return Region;
+	}
+
+	const QRect ImageRect(QPoint(0, 0), ImageSize);
+
+	QRegion Aligned;
+	foreach (const QRect& Rect, Region.rects())
+	{
+		const int Left = Rect.left() / BlockSize * BlockSize;
+		const int Top = Rect.top() / BlockSize * BlockSize;
+		const int Right = (Rect.right() / BlockSize + 1) * BlockSize;
+		const int Bottom = (Rect.bottom() / BlockSize + 1) * BlockSize;
+
+		Aligned += QRect(Left, Top, Right - Left, Bottom - Top).intersected(ImageRect);
+	}
+
+	return Aligned;
+}
+
+void ConvertRegion(uchar* Dst, int DstStride, const uchar* Src, int SrcStride, const QSize& ImageSize,
+	const QRegion& Region, const FrameFormat& Format)
+{
+	const QRegion AlignedRegion = AlignToBlocks(Format.PixelFormat, Region, ImageSize);
+	const int BlockBytes = GetPixelFormatBlockBytes(Format.PixelFormat);
+
+	foreach (const QRect& Rect, AlignedRegion.rects())
+	{
+		if (GetPixelFormatBlockSize(Format.PixelFormat) > 1)
+		{
+			EncodeBlocks(Dst, DstStride, Src, SrcStride, ImageSize, Rect, Format);
+			continue;
+		}
+
+		for (int Line = Rect.top(); Line <= Rect.bottom(); Line++)
+		{
+			uchar* DstLine = Dst + Line * DstStride + Rect.x() * BlockBytes;
+			const uchar* SrcLine = Src + Line * SrcStride + Rect.x() * 4;
+
+			switch (Format.PixelFormat)
+			{
+			case EPixelFormat::RGB565:
+				ConvertToRGB565(DstLine, SrcLine, Rect.width());
+				break;
+
+			case EPixelFormat::A8:
+				ConvertToA8(DstLine, SrcLine, Rect.width(), Format.bOpaque);
+				break;
+
+			default:
+				ConvertPixels(DstLine, SrcLine, Rect.width(), Format.PixelFormat, Format.bOpaque);
+				break;
+			}
+		}
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// Dispatch
+
+typedef void (*ConvertFunction)(uchar* Dst, const uchar* Src, int PixelsNum, const ConversionOptions& Options);
+
+/** Pick the fastest kernel supported by CPU */
+static ConvertFunction SelectConvertFunction()
+{
+#ifdef VA_AVX2
+	if (IsAVX2Supported())
+	{
+		return &ConvertAVX2;
+	}
+#endif
+
+#ifdef VA_SSE2
+	return &ConvertSSE2;
+#else
+	return &ConvertScalar;
+#endif
+}
+
+void ConvertPixels(uchar* Dst, const uchar* Src, int PixelsNum, EPixelFormat::Type Format, bool bOpaque)
+{
+	if (!IsConversionRequired(Format, bOpaque))
+	{
+		if (Dst != Src)
+		{
+			memcpy(Dst, Src, PixelsNum * 4);
+		}
+
+		return;
+	}
+
+	static const ConvertFunction Convert = SelectConvertFunction();
+	Convert(Dst, Src, PixelsNum, ConversionOptions(Format, bOpaque));
+}
+
+bool IsPixelKernelSupported(EPixelKernel::Type Kernel)
+{
+	switch (Kernel)
+	{
+	case EPixelKernel::Scalar:
+		return true;
+
+#ifdef VA_SSE2
+	case EPixelKernel::SSE2:
+		return true;
+#endif
+
+#ifdef VA_AVX2
+	case EPixelKernel::AVX2:
+		return IsAVX2Supported();
+#endif
+
+	default:
+		return false;
+	}
+}
+
+void ConvertPixelsWithKernel(EPixelKernel::Type Kernel, uchar* Dst, const uchar* Src, int PixelsNum, EPixelFormat::Type Format, bool bOpaque)
+{
+	Q_ASSERT(IsPixelKernelSupported(Kernel));
+
+	ConvertFunction Convert = &ConvertScalar;
+
+#ifdef VA_SSE2
+	if (Kernel == EPixelKernel::SSE2)
+	{
+		Convert = &ConvertSSE2;
+	}
+#endif
+
+#ifdef VA_AVX2
+	if (Kernel == EPixelKernel::AVX2)
+	{
+		Convert = &ConvertAVX2;
+	}
+#endif
+
+	Convert(Dst, Src, PixelsNum, ConversionOptions(Format, bOpaque));
+}
+
+bool IsConversionRequired(EPixelFormat::Type Format, bool bOpaque)
+{
+	return bOpaque || Format != EPixelFormat::BGRA8;
+}
+
+QImage::Format GetQtImageFormat(EPixelFormat::Type Format, bool bOpaque)
+{
+	switch (Format)
+	{
+	case EPixelFormat::BGRA8_Premultiplied:
+		return bOpaque ? QImage::Format_RGB32 : QImage::Format_ARGB32_Premultiplied;
+
+	case EPixelFormat::RGBA8:
+		return bOpaque ? QImage::Format_RGBX8888 : QImage::Format_RGBA8888;
+
+	case EPixelFormat::RGBA8_Premultiplied:
+		return bOpaque ? QImage::Format_RGBX8888 : QImage::Format_RGBA8888_Premultiplied;
+
+	case EPixelFormat::RGB565:
+		return QImage::Format_RGB16;
+
+	case EPixelFormat::A8:
+		// Alpha-only images are available since Qt 5.5, older ones get A8 by conversion only
+#if QT_VERSION >= QT_VERSION_CHECK(5, 5, 0)
+		return QImage::Format_Alpha8;
+#else
+		return QImage::Format_Invalid;
+#endif
+
+	case EPixelFormat::BC1:
+	case EPixelFormat::BC3:
+		return QImage::Format_Invalid;
+
+	case EPixelFormat::BGRA8:
+	default:
+		return bOpaque ? QImage::Format_RGB32 : QImage::Format_ARGB32;
+	}
+}
+
+} // namespace VaQuole
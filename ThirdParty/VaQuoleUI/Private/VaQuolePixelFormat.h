@@ -0,0 +1,92 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#ifndef VAQUOLEPIXELFORMAT_H
+#define VAQUOLEPIXELFORMAT_H
+
+#include "../Include/VaQuolePublicPCH.h"
+
+#include <QImage>
+#include <QRegion>
+#include <QSize>
+
+namespace VaQuole
+{
+
+/**
+ * Everything that defines frame pixels layout
+ */
+struct FrameFormat
+{
+	EPixelFormat::Type PixelFormat;
+	bool bOpaque;
+	ECompressionQuality::Type Quality;
+
+	FrameFormat(EPixelFormat::Type InPixelFormat = EPixelFormat::BGRA8, bool bInOpaque = false,
+		ECompressionQuality::Type InQuality = ECompressionQuality::Normal)
+		: PixelFormat(InPixelFormat)
+		, bOpaque(bInOpaque)
+		, Quality(InQuality)
+	{
+	}
+
+	bool operator==(const FrameFormat& Other) const
+	{
+		return PixelFormat == Other.PixelFormat && bOpaque == Other.bOpaque && Quality == Other.Quality;
+	}
+
+	bool operator!=(const FrameFormat& Other) const
+	{
+		return !(*this == Other);
+	}
+};
+
+/**
+ * Convert line of Qt ARGB32 pixels (BGRA bytes, straight alpha) into desired format.
+ * Alpha of opaque pages is forced to 255. Dst can be the same as Src
+ */
+void ConvertPixels(uchar* Dst, const uchar* Src, int PixelsNum, EPixelFormat::Type Format, bool bOpaque);
+
+/**
+ * Kernels of ConvertPixels(), the fastest one supported by CPU is used
+ */
+namespace EPixelKernel
+{
+	enum Type
+	{
+		Scalar,
+		SSE2,
+		AVX2
+	};
+}
+
+/** Is kernel built in and supported by CPU? */
+bool IsPixelKernelSupported(EPixelKernel::Type Kernel);
+
+/** ConvertPixels() with desired kernel (it should be supported), lets tests compare kernels */
+void ConvertPixelsWithKernel(EPixelKernel::Type Kernel, uchar* Dst, const uchar* Src, int PixelsNum, EPixelFormat::Type Format, bool bOpaque);
+
+/** Number of bytes in line of pixels (or line of blocks for compressed formats) */
+int GetFormatStride(EPixelFormat::Type Format, int Width);
+
+/** Number of lines of pixels (or blocks) */
+int GetFormatLines(EPixelFormat::Type Format, int Height);
+
+/** Is format packed by 32-bit pixels? */
+bool IsFormat32Bit(EPixelFormat::Type Format);
+
+/** Expand region to the blocks grid of the format */
+QRegion AlignToBlocks(EPixelFormat::Type Format, const QRegion& Region, const QSize& ImageSize);
+
+/** Convert region of Qt ARGB32 image into frame of desired format, region is aligned to blocks itself */
+void ConvertRegion(uchar* Dst, int DstStride, const uchar* Src, int SrcStride, const QSize& ImageSize,
+	const QRegion& Region, const FrameFormat& Format);
+
+/** Is any conversion necessary or line can be just copied? */
+bool IsConversionRequired(EPixelFormat::Type Format, bool bOpaque);
+
+/** Qt image format that has the same memory layout as desired output (Format_Invalid if Qt can't paint it: compressed ones, A8 before Qt 5.5) */
+QImage::Format GetQtImageFormat(EPixelFormat::Type Format, bool bOpaque);
+
+} // namespace VaQuole
+
+#endif // VAQUOLEPIXELFORMAT_H
@@ -0,0 +1,1027 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#include "VaQuoleRemoteManager.h"
+#include "../Include/VaQuoleUILib.h"
+#include "VaQuoleTrace.h"
+
+#include <QDebug>
+#include <QRect>
+#include <QVector>
+
+#include <chrono>
+#include <thread>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+namespace VaQuole
+{
+
+/** Socket descriptor number passed to host process */
+static const int HostSocketFd = 3;
+
+/** Longest wait for host messages or page commands, host restarts and balancing are checked that often */
+static const int HostPollTimeoutMs = 100;
+
+/** Host is treated as hung when it doesn't read that much of our data */
+static const int MaxOutgoingSize = 32 * 1024 * 1024;
+
+/** Delay before broken host is respawned */
+static const qint64 HostRestartDelayMs = 1000;
+
+/** How often pages are rebalanced between hosts */
+static const qint64 RebalanceIntervalMs = 2000;
+
+/** Hosts load difference that is worth the page move (microseconds per second, 10% of core) */
+static const qint64 RebalanceThreshold = 100000;
+
+/** Moved page has to reload, so don't move it back and forth */
+static const qint64 MigrationCooldownMs = 10000;
+
+VaQuoleRemoteUIManager::VaQuoleRemoteUIManager(const QString& HostExecutablePath, int HostsNum)
+	: HostExecutable(HostExecutablePath)
+	, Hosts(qMax(HostsNum, 1))
+{
+	NextPageId = 1;
+	NextRebalanceMs = RebalanceIntervalMs;
+
+	Clock.start();
+
+	if (pipe(WakeUpPipe) == 0)
+	{
+		for (int i = 0; i < 2; i++)
+		{
+			fcntl(WakeUpPipe[i], F_SETFL, fcntl(WakeUpPipe[i], F_GETFL) | O_NONBLOCK);
+			fcntl(WakeUpPipe[i], F_SETFD, FD_CLOEXEC);
+		}
+	}
+	else
+	{
+		qDebug() << "Can't create wake up pipe:" << strerror(errno);
+		WakeUpPipe[0] = WakeUpPipe[1] = -1;
+	}
+}
+
+VaQuoleRemoteUIManager::~VaQuoleRemoteUIManager()
+{
+	// Thread uses our data, so stop it before members are destroyed
+	stop();
+
+	qDeleteAll(RemotePages);
+	RemotePages.clear();
+
+	for (int i = 0; i < 2; i++)
+	{
+		if (WakeUpPipe[i] >= 0)
+		{
+			close(WakeUpPipe[i]);
+		}
+	}
+}
+
+void VaQuoleRemoteUIManager::wakeUp()
+{
+	if (WakeUpPipe[1] >= 0)
+	{
+		// Pipe is full when thread has a lot of wake ups already, so result doesn't matter
+		const char Signal = 0;
+		ssize_t Written = write(WakeUpPipe[1], &Signal, 1);
+		Q_UNUSED(Written);
+	}
+}
+
+void VaQuoleRemoteUIManager::run()
+{
+	bool bReady = false;
+
+	TraceRecorder::Get().SetThreadName("VaQuoleUIRemote");
+
+	while (!m_stop)
+	{
+		for (int i = 0; i < Hosts.size(); i++)
+		{
+			if (Hosts[i].Socket < 0 && Clock.elapsed() >= Hosts[i].NextStartTimeMs && !StartHost(i))
+			{
+				// Don't respawn broken host too often
+				Hosts[i].NextStartTimeMs = Clock.elapsed() + HostRestartDelayMs;
+			}
+		}
+
+		// Pages are accepted once hosts were launched, they're sent when host connects
+		if (!bReady)
+		{
+			MarkReady();
+			bReady = true;
+		}
+
+		// [START] Lock pages list
+		mutex.lock();
+		ThreadStats.Ticks++;
+
+		foreach (VaQuoleWebUI* Page, WebPages)
+		{
+			// [START] Lock data to read values
+			Page->mutex.lock();
+
+			UIDataKeeper* ExtComm = Page->GetData();
+			Q_CHECK_PTR(ExtComm);
+
+			// Register page if necessary
+			RemotePage* Remote = RemotePages.value(ExtComm->ObjectId, NULL);
+			if (Remote == NULL)
+			{
+				Remote = new RemotePage();
+				Remote->PageId = NextPageId++;
+				Remote->HostIndex = SelectHost();
+
+				RemotePages.insert(ExtComm->ObjectId, Remote);
+				PagesById.insert(Remote->PageId, Page);
+			}
+
+			// Page waits for its host to be (re)started
+			if (!ExtComm->bMarkedForDelete && Hosts[Remote->HostIndex].Socket >= 0)
+			{
+				SendPageCommands(ExtComm, Remote);
+			}
+
+			// [END] Unlock page data
+			Page->mutex.unlock();
+		}
+
+		// Clean pages marked for delete
+		QList< std::shared_ptr<ScriptCallState> > CancelledCalls;
+		for (int j = 0; j < WebPages.size(); )
+		{
+			VaQuoleWebUI* PageToDelete = WebPages.at(j);
+			if (PageToDelete->GetData()->bMarkedForDelete)
+			{
+				RetirePageStats(ThreadStats, PageToDelete->GetData());
+				CancelledCalls.append(PageToDelete->GetData()->ScriptCalls.values());
+
+				RemotePage* Remote = RemotePages.take(PageToDelete->GetData()->ObjectId);
+				if (Remote)
+				{
+					if (Remote->bCreated)
+					{
+						Send(Remote->HostIndex, Remote->PageId, ERemoteCommand::DestroyPage);
+					}
+
+					PagesById.remove(Remote->PageId);
+					delete Remote;
+				}
+
+				WebPages.removeAt(j);
+
+				delete PageToDelete->GetData();
+				delete PageToDelete;
+			}
+			else
+			{
+				j++;
+			}
+		}
+
+		if (Hosts.size() > 1 && Clock.elapsed() >= NextRebalanceMs)
+		{
+			RebalancePages();
+			NextRebalanceMs = Clock.elapsed() + RebalanceIntervalMs;
+		}
+
+		// [END] Unlock pages list
+		mutex.unlock();
+
+		CancelScriptCalls(CancelledCalls);
+		FailLostScripts();
+
+		ProcessHostMessages(HostPollTimeoutMs);
+		FailLostScripts();
+	}
+
+	for (int i = 0; i < Hosts.size(); i++)
+	{
+		StopHost(i);
+	}
+
+	qDebug() << "About to exit";
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// Host process
+
+bool VaQuoleRemoteUIManager::StartHost(int HostIndex)
+{
+	RemoteHost& Host = Hosts[HostIndex];
+
+	int Sockets[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, Sockets) != 0)
+	{
+		qDebug() << "Can't create host socket:" << strerror(errno);
+		return false;
+	}
+
+	posix_spawn_file_actions_t Actions;
+	posix_spawn_file_actions_init(&Actions);
+	posix_spawn_file_actions_addclose(&Actions, Sockets[0]);
+	posix_spawn_file_actions_adddup2(&Actions, Sockets[1], HostSocketFd);
+
+	QByteArray Path = HostExecutable.toLocal8Bit();
+	QByteArray SocketArg = QString("--socket-fd=%1").arg(HostSocketFd).toLatin1();
+	char* Argv[] = { Path.data(), SocketArg.data(), NULL };
+
+	int Result = posix_spawn(&Host.Pid, Path.constData(), &Actions, NULL, Argv, environ);
+
+	posix_spawn_file_actions_destroy(&Actions);
+	close(Sockets[1]);
+
+	if (Result != 0)
+	{
+		qDebug() << "Can't start UI host" << HostExecutable << strerror(Result);
+		close(Sockets[0]);
+		Host.Pid = 0;
+		return false;
+	}
+
+	// Don't leak game sockets into other hosts
+	fcntl(Sockets[0], F_SETFD, FD_CLOEXEC);
+
+	Host.Socket = Sockets[0];
+	Host.Reader.Reset();
+	Host.Outgoing.clear();
+
+	qDebug() << "UI host" << HostIndex << "started:" << Host.Pid;
+
+	return true;
+}
+
+void VaQuoleRemoteUIManager::StopHost(int HostIndex, bool bKill)
+{
+	RemoteHost& Host = Hosts[HostIndex];
+
+	if (Host.Socket >= 0)
+	{
+		close(Host.Socket);
+		Host.Socket = -1;
+	}
+
+	if (Host.Pid > 0)
+	{
+		if (bKill)
+		{
+			kill(Host.Pid, SIGKILL);
+		}
+
+		// Host exits itself when connection is closed
+		int Status = 0;
+		for (int i = 0; i < 100 && waitpid(Host.Pid, &Status, WNOHANG) == 0; i++)
+		{
+			if (i == 99)
+			{
+				qDebug() << "UI host doesn't exit, kill it";
+				kill(Host.Pid, SIGKILL);
+				waitpid(Host.Pid, &Status, 0);
+				break;
+			}
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+
+		qDebug() << "UI host" << HostIndex << "stopped:" << Host.Pid;
+
+		// Killed or crashed host can't remove its frames itself
+		UnlinkSharedFrames(Host.Pid);
+
+		Host.Pid = 0;
+	}
+
+	Host.Reader.Reset();
+	Host.Outgoing.clear();
+
+	// New host knows nothing about our pages
+	foreach (RemotePage* Remote, RemotePages)
+	{
+		if (Remote->HostIndex == HostIndex)
+		{
+			Remote->ResetHostState();
+		}
+	}
+}
+
+void VaQuoleRemoteUIManager::Send(int HostIndex, quint32 PageId, ERemoteCommand::Type Command, const QByteArray& Payload)
+{
+	RemoteHost& Host = Hosts[HostIndex];
+	if (Host.Socket < 0)
+	{
+		return;
+	}
+
+	AppendRemoteMessage(Host.Outgoing, PageId, Command, Payload);
+}
+
+void VaQuoleRemoteUIManager::FlushOutgoing(int HostIndex)
+{
+	RemoteHost& Host = Hosts[HostIndex];
+	if (Host.Socket < 0 || Host.Outgoing.isEmpty())
+	{
+		return;
+	}
+
+	if (!FlushRemoteMessages(Host.Socket, Host.Outgoing))
+	{
+		qDebug() << "UI host connection is broken";
+		StopHost(HostIndex);
+	}
+	else if (Host.Outgoing.size() > MaxOutgoingSize)
+	{
+		qDebug() << "UI host doesn't respond, restart it";
+		StopHost(HostIndex, true);
+	}
+}
+
+void VaQuoleRemoteUIManager::FailLostScripts()
+{
+	foreach (RemotePage* Remote, RemotePages)
+	{
+		if (Remote->LostCallIds.isEmpty() && Remote->LostScripts.isEmpty())
+		{
+			continue;
+		}
+
+		VaQuoleWebUI* Page = PagesById.value(Remote->PageId, NULL);
+		Q_CHECK_PTR(Page);
+
+		FailLostPageScripts(Page, Remote);
+	}
+}
+
+void FailLostPageScripts(VaQuoleWebUI* Page, RemotePage* Remote)
+{
+	QList< QPair<quint32, ScriptValue> > FailedCalls;
+	foreach (quint32 CallId, Remote->LostCallIds)
+	{
+		FailedCalls.append(qMakePair(CallId, ScriptValue::FromError(QLatin1String("UI host has stopped"))));
+	}
+
+	Remote->LostCallIds.clear();
+
+	// Asynchronous calls are completed here, so their callbacks are run
+	PublishScriptCallResults(Page, FailedCalls);
+
+	if (!Remote->LostScripts.isEmpty())
+	{
+		std::lock_guard<std::mutex> guard(Page->mutex);
+
+		foreach (const QString& ScriptUuid, Remote->LostScripts)
+		{
+			Page->GetData()->ScriptResults.append(qMakePair(ScriptUuid, QString()));
+		}
+
+		Remote->LostScripts.clear();
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// Balancing
+
+qint64 VaQuoleRemoteUIManager::GetHostLoad(int HostIndex) const
+{
+	qint64 Load = 0;
+
+	foreach (const RemotePage* Remote, RemotePages)
+	{
+		if (Remote->HostIndex == HostIndex)
+		{
+			Load += Remote->Load;
+		}
+	}
+
+	return Load;
+}
+
+int VaQuoleRemoteUIManager::GetHostPagesNum(int HostIndex) const
+{
+	int PagesNum = 0;
+
+	foreach (const RemotePage* Remote, RemotePages)
+	{
+		if (Remote->HostIndex == HostIndex)
+		{
+			PagesNum++;
+		}
+	}
+
+	return PagesNum;
+}
+
+int VaQuoleRemoteUIManager::SelectHost() const
+{
+	int BestHost = 0;
+	qint64 BestLoad = GetHostLoad(0);
+	int BestPagesNum = GetHostPagesNum(0);
+
+	for (int i = 1; i < Hosts.size(); i++)
+	{
+		// New pages report no load until their first PageLoad, so pages created together
+		// would all go to the first host without counting them
+		const qint64 Load = GetHostLoad(i);
+		const int PagesNum = GetHostPagesNum(i);
+		if (Load < BestLoad || (Load == BestLoad && PagesNum < BestPagesNum))
+		{
+			BestHost = i;
+			BestLoad = Load;
+			BestPagesNum = PagesNum;
+		}
+	}
+
+	return BestHost;
+}
+
+void VaQuoleRemoteUIManager::RebalancePages()
+{
+	int HotHost = 0;
+	int ColdHost = 0;
+	QVector<qint64> Loads(Hosts.size());
+
+	for (int i = 0; i < Hosts.size(); i++)
+	{
+		Loads[i] = GetHostLoad(i);
+
+		if (Loads[i] > Loads[HotHost])
+		{
+			HotHost = i;
+		}
+
+		if (Loads[i] < Loads[ColdHost])
+		{
+			ColdHost = i;
+		}
+	}
+
+	const qint64 LoadDiff = Loads[HotHost] - Loads[ColdHost];
+	if (LoadDiff < RebalanceThreshold || Hosts[ColdHost].Socket < 0)
+	{
+		return;
+	}
+
+	// Move the heaviest page that makes hosts closer to each other
+	RemotePage* PageToMove = NULL;
+	int HotHostPages = 0;
+	foreach (RemotePage* Remote, RemotePages)
+	{
+		if (Remote->HostIndex != HotHost)
+		{
+			continue;
+		}
+
+		HotHostPages++;
+
+		if (Remote->Load <= 0 || Remote->Load >= LoadDiff ||
+			(Remote->LastMigrationMs > 0 && Clock.elapsed() - Remote->LastMigrationMs < MigrationCooldownMs))
+		{
+			continue;
+		}
+
+		if (PageToMove == NULL || Remote->Load > PageToMove->Load)
+		{
+			PageToMove = Remote;
+		}
+	}
+
+	// Single hot page should stay where it is
+	if (PageToMove == NULL || HotHostPages < 2)
+	{
+		return;
+	}
+
+	qDebug() << "Move page" << PageToMove->PageId << "from UI host" << HotHost << "to" << ColdHost
+		<< "load:" << PageToMove->Load << Loads[HotHost] << Loads[ColdHost];
+
+	if (PageToMove->bCreated)
+	{
+		Send(HotHost, PageToMove->PageId, ERemoteCommand::DestroyPage);
+	}
+
+	// Page will be created and its URL reopened by new host
+	PageToMove->ResetHostState();
+	PageToMove->HostIndex = ColdHost;
+	PageToMove->LastMigrationMs = Clock.elapsed();
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// Commands
+
+void VaQuoleRemoteUIManager::SendPageCommands(UIDataKeeper *ExtComm, RemotePage *Remote)
+{
+	const quint32 PageId = Remote->PageId;
+	const int HostIndex = Remote->HostIndex;
+
+	PageCommands Commands;
+	ExtComm->Commands.Drain(Commands);
+
+	if (!Remote->bCreated)
+	{
+		Send(HostIndex, PageId, ERemoteCommand::CreatePage);
+		Remote->bCreated = true;
+
+		// Host was restarted, so load the last page again
+		if (Commands.NewURL.isEmpty())
+		{
+			Commands.NewURL = Remote->URL;
+		}
+	}
+
+	if (!Commands.NewURL.isEmpty())
+	{
+		QByteArray Payload;
+		QDataStream Stream(&Payload, QIODevice::WriteOnly);
+		Stream << Commands.NewURL;
+		Send(HostIndex, PageId, ERemoteCommand::OpenURL, Payload);
+
+		Remote->URL = Commands.NewURL;
+		Remote->URLSerial++;
+
+		ExtComm->bPageLoaded = false;
+	}
+
+	if (ExtComm->DesiredWidth != Remote->Width || ExtComm->DesiredHeight != Remote->Height)
+	{
+		QByteArray Payload;
+		QDataStream Stream(&Payload, QIODevice::WriteOnly);
+		Stream << (qint32)ExtComm->DesiredWidth << (qint32)ExtComm->DesiredHeight;
+		Send(HostIndex, PageId, ERemoteCommand::Resize, Payload);
+
+		Remote->Width = ExtComm->DesiredWidth;
+		Remote->Height = ExtComm->DesiredHeight;
+	}
+
+	if (ExtComm->bDesiredTransparency != Remote->bTransparent)
+	{
+		QByteArray Payload;
+		QDataStream Stream(&Payload, QIODevice::WriteOnly);
+		Stream << ExtComm->bDesiredTransparency;
+		Send(HostIndex, PageId, ERemoteCommand::SetTransparent, Payload);
+
+		Remote->bTransparent = ExtComm->bDesiredTransparency;
+	}
+
+	if (ExtComm->bEnabled != Remote->bEnabled)
+	{
+		QByteArray Payload;
+		QDataStream Stream(&Payload, QIODevice::WriteOnly);
+		Stream << ExtComm->bEnabled;
+		Send(HostIndex, PageId, ERemoteCommand::SetEnabled, Payload);
+
+		Remote->bEnabled = ExtComm->bEnabled;
+	}
+
+	// Host converts 32-bit pixels, so we only pass them through. Compressed ones are made here from BGRA
+	Remote->PublishedFormat.PixelFormat = ExtComm->OutputFormat;
+	Remote->PublishedFormat.Quality = ExtComm->CompressionQuality;
+
+	const EPixelFormat::Type HostFormat = IsFormat32Bit(ExtComm->OutputFormat) ? ExtComm->OutputFormat : EPixelFormat::BGRA8;
+	if (HostFormat != Remote->OutputFormat)
+	{
+		QByteArray Payload;
+		QDataStream Stream(&Payload, QIODevice::WriteOnly);
+		Stream << (qint32)HostFormat;
+		Send(HostIndex, PageId, ERemoteCommand::SetOutputFormat, Payload);
+
+		Remote->OutputFormat = HostFormat;
+	}
+
+	// Host schedules and suspends its pages itself
+	const int Priority = ExtComm->Priority;
+	ExtComm->bHibernating = !ExtComm->bEnabled || Priority == EPagePriority::Hidden;
+
+	if (Priority != Remote->Priority)
+	{
+		QByteArray Payload;
+		QDataStream Stream(&Payload, QIODevice::WriteOnly);
+		Stream << (qint32)Priority;
+		Send(HostIndex, PageId, ERemoteCommand::SetPriority, Payload);
+
+		Remote->Priority = Priority;
+	}
+
+	if (ExtComm->TargetFrameRate != Remote->TargetFrameRate)
+	{
+		QByteArray Payload;
+		QDataStream Stream(&Payload, QIODevice::WriteOnly);
+		Stream << (qint32)ExtComm->TargetFrameRate;
+		Send(HostIndex, PageId, ERemoteCommand::SetTargetFrameRate, Payload);
+
+		Remote->TargetFrameRate = ExtComm->TargetFrameRate;
+	}
+
+	// Input
+	foreach (const MouseEvent& Event, Commands.MouseEvents)
+	{
+		QByteArray Payload;
+		QDataStream Stream(&Payload, QIODevice::WriteOnly);
+		Stream << Event;
+		Send(HostIndex, PageId, ERemoteCommand::InputMouse, Payload);
+	}
+
+	foreach (const KeyEvent& Event, Commands.KeyEvents)
+	{
+		QByteArray Payload;
+		QDataStream Stream(&Payload, QIODevice::WriteOnly);
+		Stream << Event;
+		Send(HostIndex, PageId, ERemoteCommand::InputKey, Payload);
+	}
+
+	// JavaScript, batches are sent in the order they were queued with single scripts
+	int BatchIndex = 0;
+	for (int i = 0; i <= Commands.ScriptCommands.size(); i++)
+	{
+		while (BatchIndex < Commands.ScriptBatches.size() && Commands.ScriptBatches[BatchIndex].ScriptCommandsBefore <= i)
+		{
+			const ScriptBatch& Batch = Commands.ScriptBatches[BatchIndex++];
+
+			QByteArray Payload;
+			QDataStream Stream(&Payload, QIODevice::WriteOnly);
+			Stream << Batch.FirstCallId << Batch.Scripts;
+			Send(HostIndex, PageId, ERemoteCommand::EvaluateJavaScriptBatch, Payload);
+
+			for (int j = 0; j < Batch.Scripts.size(); j++)
+			{
+				Remote->InFlightCallIds.insert(Batch.FirstCallId + j);
+			}
+		}
+
+		if (i == Commands.ScriptCommands.size())
+		{
+			break;
+		}
+
+		QByteArray Payload;
+		QDataStream Stream(&Payload, QIODevice::WriteOnly);
+		Stream << Commands.ScriptCommands[i].first << Commands.ScriptCommands[i].second;
+		Send(HostIndex, PageId, ERemoteCommand::EvaluateJavaScript, Payload);
+
+		Remote->InFlightScripts.insert(Commands.ScriptCommands[i].first);
+	}
+
+	// Zero-copy mode is emulated by copying host frames into host memory
+	ExternalFramebuffer& Framebuffer = ExtComm->Framebuffer;
+	if (Framebuffer.Bits != ExtComm->DesiredFramebufferBits ||
+		Framebuffer.Stride != ExtComm->DesiredFramebufferStride ||
+		Framebuffer.Width != ExtComm->DesiredFramebufferWidth ||
+		Framebuffer.Height != ExtComm->DesiredFramebufferHeight)
+	{
+		Framebuffer.Bits = ExtComm->DesiredFramebufferBits;
+		Framebuffer.Stride = ExtComm->DesiredFramebufferStride;
+		Framebuffer.Width = ExtComm->DesiredFramebufferWidth;
+		Framebuffer.Height = ExtComm->DesiredFramebufferHeight;
+
+		// New buffer should be filled completely
+		Remote->PendingExternalRegion = QRegion(0, 0, Remote->ImageWidth, Remote->ImageHeight);
+	}
+
+	UpdateExternalFramebuffer(ExtComm, Remote, QRegion());
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// Host messages
+
+void VaQuoleRemoteUIManager::ProcessHostMessages(int TimeoutMs)
+{
+	QVector<pollfd> Fds;
+	QVector<int> FdHosts;
+
+	// Page commands wake us up through the pipe
+	if (WakeUpPipe[0] >= 0)
+	{
+		pollfd Fd;
+		Fd.fd = WakeUpPipe[0];
+		Fd.events = POLLIN;
+		Fd.revents = 0;
+
+		Fds.append(Fd);
+		FdHosts.append(-1);
+	}
+
+	for (int i = 0; i < Hosts.size(); i++)
+	{
+		FlushOutgoing(i);
+
+		if (Hosts[i].Socket < 0)
+		{
+			continue;
+		}
+
+		pollfd Fd;
+		Fd.fd = Hosts[i].Socket;
+		Fd.events = POLLIN | (Hosts[i].Outgoing.isEmpty() ? 0 : POLLOUT);
+		Fd.revents = 0;
+
+		Fds.append(Fd);
+		FdHosts.append(i);
+	}
+
+	if (Fds.isEmpty())
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(TimeoutMs));
+		return;
+	}
+
+	if (poll(Fds.data(), Fds.size(), TimeoutMs) <= 0)
+	{
+		return;
+	}
+
+	for (int i = 0; i < Fds.size(); i++)
+	{
+		if (Fds[i].revents == 0)
+		{
+			continue;
+		}
+
+		const int HostIndex = FdHosts[i];
+		if (HostIndex < 0)
+		{
+			char Signals[64];
+			while (read(Fds[i].fd, Signals, sizeof(Signals)) > 0)
+			{
+			}
+
+			continue;
+		}
+
+		RemoteHost& Host = Hosts[HostIndex];
+
+		bool bConnected = Host.Reader.ReadAvailable(Host.Socket);
+
+		// Process all we've got before the host has gone
+		RemoteMessageHeader Header;
+		QByteArray Payload;
+		while (Host.Reader.NextMessage(Header, Payload))
+		{
+			HandleHostMessage(HostIndex, Header, Payload);
+		}
+
+		if (!bConnected)
+		{
+			qDebug() << "UI host" << HostIndex << "has closed the connection";
+			StopHost(HostIndex);
+		}
+		else if (Host.Reader.IsBroken())
+		{
+			qDebug() << "UI host" << HostIndex << "has sent broken message, restart it";
+			StopHost(HostIndex, true);
+		}
+	}
+}
+
+void VaQuoleRemoteUIManager::HandleHostMessage(int HostIndex, const RemoteMessageHeader& Header, const QByteArray& Payload)
+{
+	// Page can be deleted already
+	VaQuoleWebUI* Page = PagesById.value(Header.PageId, NULL);
+	if (Page == NULL)
+	{
+		return;
+	}
+
+	UIDataKeeper* ExtComm = Page->GetData();
+	RemotePage* Remote = RemotePages.value(ExtComm->ObjectId, NULL);
+	Q_CHECK_PTR(Remote);
+
+	// Late message from the host page was moved from
+	if (Remote->HostIndex != HostIndex)
+	{
+		return;
+	}
+
+	QDataStream Stream(Payload);
+
+	switch (Header.Command)
+	{
+	case ERemoteCommand::PageState:
+		{
+			quint32 URLSerial = 0;
+			bool bPageLoaded = false;
+			bool bTransparent = false;
+			qint32 Width = 0;
+			qint32 Height = 0;
+			Stream >> URLSerial >> bPageLoaded >> bTransparent >> Width >> Height;
+
+			std::lock_guard<std::mutex> guard(Page->mutex);
+
+			// Loading state of previous URL doesn't matter
+			ExtComm->bPageLoaded = (URLSerial == Remote->URLSerial) && bPageLoaded;
+			ExtComm->bTransparent = bTransparent;
+			ExtComm->Width = Width;
+			ExtComm->Height = Height;
+
+			Remote->PublishedFormat.bOpaque = !bTransparent;
+		}
+		break;
+
+	case ERemoteCommand::FrameReady:
+		HandleFrame(HostIndex, Page, Remote, Stream);
+
+		// Let host write next frame
+		Send(HostIndex, Header.PageId, ERemoteCommand::FrameAck);
+		break;
+
+	case ERemoteCommand::PageLoad:
+		{
+			qint32 IntervalMs = 0;
+			qint64 PaintTimeUs = 0;
+			qint64 ScriptTimeUs = 0;
+			Stream >> IntervalMs >> PaintTimeUs >> ScriptTimeUs;
+
+			// Smooth it a bit to not react on single spikes
+			const qint64 Load = (PaintTimeUs + ScriptTimeUs) * 1000 / qMax(IntervalMs, 1);
+			Remote->Load = (Remote->Load + Load) / 2;
+
+			std::lock_guard<std::mutex> guard(Page->mutex);
+			ExtComm->Stats.PaintUs += PaintTimeUs;
+			ExtComm->Stats.ScriptUs += ScriptTimeUs;
+		}
+		break;
+
+	case ERemoteCommand::ScriptResult:
+	case ERemoteCommand::ScriptEvent:
+		{
+			QPair<QString, QString> ScriptPair;
+			Stream >> ScriptPair.first >> ScriptPair.second;
+
+			std::lock_guard<std::mutex> guard(Page->mutex);
+
+			if (Header.Command == ERemoteCommand::ScriptResult)
+			{
+				// Script could be failed already with the host it was sent to
+				if (Remote->InFlightScripts.remove(ScriptPair.first))
+				{
+					ExtComm->ScriptResults.append(ScriptPair);
+				}
+			}
+			else
+			{
+				ExtComm->ScriptEvents.append(ScriptPair);
+			}
+		}
+		break;
+
+	case ERemoteCommand::ScriptCallResults:
+		{
+			QList< QPair<quint32, ScriptValue> > CallResults;
+			Stream >> CallResults;
+
+			// Calls could be failed already with the host they were sent to
+			for (int i = CallResults.size() - 1; i >= 0; i--)
+			{
+				if (!Remote->InFlightCallIds.remove(CallResults[i].first))
+				{
+					CallResults.removeAt(i);
+				}
+			}
+
+			// Asynchronous calls of the page are completed here, the rest waits for GetScriptCallResults()
+			PublishScriptCallResults(Page, CallResults);
+		}
+		break;
+
+	default:
+		qDebug() << "Unknown host command:" << Header.Command;
+		break;
+	}
+}
+
+void VaQuoleRemoteUIManager::HandleFrame(int HostIndex, VaQuoleWebUI *Page, RemotePage *Remote, QDataStream& Stream)
+{
+	quint32 Generation = 0;
+	qint32 SegmentSize = 0;
+	qint32 FrameWidth = 0;
+	qint32 FrameHeight = 0;
+	QVector<QRect> Rects;
+	Stream >> Generation >> SegmentSize >> FrameWidth >> FrameHeight >> Rects;
+
+	// Host recreates memory segment when frame size changes
+	if (Generation != Remote->FrameGeneration || Remote->FrameMemory.GetData() == NULL)
+	{
+		if (!Remote->FrameMemory.Open(GetSharedFrameName(Hosts[HostIndex].Pid, Remote->PageId, Generation), SegmentSize))
+		{
+			return;
+		}
+
+		Remote->FrameGeneration = Generation;
+	}
+
+	if (FrameWidth != Remote->ImageWidth || FrameHeight != Remote->ImageHeight)
+	{
+		Remote->Image = QByteArray(FrameWidth * FrameHeight * 4, 0);
+		Remote->ImageWidth = FrameWidth;
+		Remote->ImageHeight = FrameHeight;
+	}
+
+	const QRect ImageRect(0, 0, FrameWidth, FrameHeight);
+	const int Stride = FrameWidth * 4;
+	const uchar* FrameBits = Remote->FrameMemory.GetData();
+	uchar* ImageBits = (uchar*)Remote->Image.data();
+
+	TraceScope CopyTrace("ReceiveFrame", Page->GetData());
+
+	QElapsedTimer CopyTimer;
+	CopyTimer.start();
+
+	// Frame rects are packed one after another
+	QRegion FrameRegion;
+	int Offset = 0;
+	foreach (const QRect& Rect, Rects)
+	{
+		const int LineSize = Rect.width() * 4;
+		if (!ImageRect.contains(Rect) || Offset + LineSize * Rect.height() > Remote->FrameMemory.GetSize())
+		{
+			qDebug() << "Broken frame rect from UI host:" << Rect;
+			break;
+		}
+
+		for (int Line = 0; Line < Rect.height(); Line++)
+		{
+			memcpy(ImageBits + (Rect.y() + Line) * Stride + Rect.x() * 4, FrameBits + Offset, LineSize);
+			Offset += LineSize;
+		}
+
+		FrameRegion += Rect;
+	}
+
+	qint64 BytesCopied = Offset;
+
+	UIDataKeeper* ExtComm = Page->GetData();
+	if (ExtComm->Framebuffer.Bits)
+	{
+		UpdateExternalFramebuffer(ExtComm, Remote, FrameRegion);
+	}
+	else
+	{
+		// 32-bit frames are converted by host already
+		BytesCopied += ExtComm->Frames.PublishFrame(ImageBits, Remote->Image.size(), Stride, FrameRegion,
+			Remote->PublishedFormat, IsFormat32Bit(Remote->PublishedFormat.PixelFormat));
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(Page->mutex);
+		ExtComm->Stats.FramesProduced++;
+		ExtComm->Stats.BytesCopied += BytesCopied;
+		ExtComm->Stats.CopyUs += CopyTimer.nsecsElapsed() / 1000;
+		ExtComm->Stats.ImageBytes = Remote->Image.size();
+	}
+
+	MarkFirstFrame();
+}
+
+void VaQuoleRemoteUIManager::UpdateExternalFramebuffer(UIDataKeeper *ExtComm, RemotePage *Remote, const QRegion& Region)
+{
+	ExternalFramebuffer& Framebuffer = ExtComm->Framebuffer;
+	if (Framebuffer.Bits == NULL)
+	{
+		return;
+	}
+
+	Remote->PendingExternalRegion += Region;
+	if (Remote->PendingExternalRegion.isEmpty())
+	{
+		return;
+	}
+
+	// Host is reading the buffer now, so we'll copy it later
+	if (!Framebuffer.TryAcquire(EFramebufferState::Painting))
+	{
+		return;
+	}
+
+	const QRect CopyRect(0, 0, qMin(Remote->ImageWidth, Framebuffer.Width), qMin(Remote->ImageHeight, Framebuffer.Height));
+	const int Stride = Remote->ImageWidth * 4;
+	const uchar* ImageBits = (const uchar*)Remote->Image.constData();
+
+	foreach (const QRect& Rect, Remote->PendingExternalRegion.intersected(CopyRect).rects())
+	{
+		for (int Line = 0; Line < Rect.height(); Line++)
+		{
+			memcpy((uchar*)Framebuffer.Bits + (Rect.y() + Line) * Framebuffer.Stride + Rect.x() * 4,
+				ImageBits + (Rect.y() + Line) * Stride + Rect.x() * 4,
+				Rect.width() * 4);
+		}
+	}
+
+	Framebuffer.Release(EFramebufferState::Painting);
+
+	Remote->PendingExternalRegion = QRegion();
+	ExtComm->Frames.PublishExternalFrame();
+}
+
+} // namespace VaQuole
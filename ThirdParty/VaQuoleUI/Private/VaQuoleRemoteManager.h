@@ -0,0 +1,224 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#ifndef VAQUOLEREMOTEMANAGER_H
+#define VAQUOLEREMOTEMANAGER_H
+
+#include "VaQuoleAppThread.h"
+#include "VaQuoleRemoteProtocol.h"
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QRegion>
+#include <QSet>
+#include <QString>
+#include <QVector>
+
+#include <sys/types.h>
+
+namespace VaQuole
+{
+
+/**
+ * Game side state of the page rendered by host process
+ */
+struct RemotePage
+{
+	/** Id of the page in host process */
+	quint32 PageId;
+
+	/** Host process that renders the page */
+	int HostIndex;
+
+	/** Host time spent on the page (microseconds per second) */
+	qint64 Load;
+
+	/** When page was moved to another host last time */
+	qint64 LastMigrationMs;
+
+	/** Is page created in current host process? */
+	bool bCreated;
+
+	/** Last state sent to host */
+	QString URL;
+	quint32 URLSerial;
+	int Width;
+	int Height;
+	bool bTransparent;
+	bool bEnabled;
+	EPixelFormat::Type OutputFormat;
+	int Priority;
+	int TargetFrameRate;
+
+	/** Format of published frames, compressed ones are made by us from host 32-bit frames */
+	FrameFormat PublishedFormat;
+
+	/** Frame memory shared by host */
+	SharedFrameMemory FrameMemory;
+	quint32 FrameGeneration;
+
+	/** Complete page image assembled from frame rects */
+	QByteArray Image;
+	int ImageWidth;
+	int ImageHeight;
+
+	/** Region that wasn't copied into external framebuffer because host was reading it */
+	QRegion PendingExternalRegion;
+
+	/** Scripts sent to host and not answered yet */
+	QSet<quint32> InFlightCallIds;
+	QSet<QString> InFlightScripts;
+
+	/** Scripts host will never answer, they are failed by manager */
+	QList<quint32> LostCallIds;
+	QList<QString> LostScripts;
+
+	/** Defaults */
+	RemotePage()
+	{
+		PageId = 0;
+		HostIndex = 0;
+		Load = 0;
+		LastMigrationMs = 0;
+
+		ImageWidth = 0;
+		ImageHeight = 0;
+
+		ResetHostState();
+	}
+
+	/** Forget all that was sent to host (it was restarted or page was moved) */
+	void ResetHostState()
+	{
+		bCreated = false;
+		URLSerial = 0;
+		Width = -1;
+		Height = -1;
+		bTransparent = false;
+		bEnabled = false;
+		OutputFormat = EPixelFormat::BGRA8;
+		Priority = EPagePriority::Visible;
+		TargetFrameRate = 0;
+
+		FrameMemory.Close();
+		FrameGeneration = 0;
+
+		// Scripts sent to host are lost with it
+		LostCallIds.append(InFlightCallIds.toList());
+		LostScripts.append(InFlightScripts.toList());
+		InFlightCallIds.clear();
+		InFlightScripts.clear();
+	}
+};
+
+/** Fail scripts host will never answer: calls get error, scripts get empty result. Call it without manager and page locks */
+void FailLostPageScripts(VaQuoleWebUI* Page, RemotePage* Remote);
+
+/**
+ * Renderer host process connection
+ */
+struct RemoteHost
+{
+	int Socket;
+	pid_t Pid;
+	RemoteMessageReader Reader;
+	QByteArray Outgoing;
+
+	/** Don't respawn broken host too often */
+	qint64 NextStartTimeMs;
+
+	/** Defaults */
+	RemoteHost()
+	{
+		Socket = -1;
+		Pid = 0;
+		NextStartTimeMs = 0;
+	}
+};
+
+/**
+ * Forwards all pages to the pool of renderer host processes and publishes their frames,
+ * so the page crash or heavy page can't take the game down. Pages are spread between
+ * hosts by their load, so each host uses its own core
+ */
+class VaQuoleRemoteUIManager : public VaQuoleUIManager
+{
+public:
+	VaQuoleRemoteUIManager(const QString& HostExecutablePath, int HostsNum = 1);
+	~VaQuoleRemoteUIManager();
+
+	// Begin VaThread Interface
+public:
+	void wakeUp();
+
+protected:
+	void run();
+	// End VaThread Interface
+
+private:
+	/** Spawn host process connected with socket pair */
+	bool StartHost(int HostIndex);
+
+	/** Close connection and wait for host to exit, hung host is killed */
+	void StopHost(int HostIndex, bool bKill = false);
+
+	/** Least loaded host for the new page, the one with fewer pages if loads are equal */
+	int SelectHost() const;
+
+	/** Sum of loads of all pages rendered by host */
+	qint64 GetHostLoad(int HostIndex) const;
+
+	/** Number of pages rendered by host */
+	int GetHostPagesNum(int HostIndex) const;
+
+	/** Move one page from the most loaded host to the least loaded one if it's worth it */
+	void RebalancePages();
+
+	/** Send all changes of the page state to host */
+	void SendPageCommands(UIDataKeeper *ExtComm, RemotePage *Remote);
+
+	/** Read and process messages from all hosts, waits for them not longer than Timeout */
+	void ProcessHostMessages(int TimeoutMs);
+
+	/** Process one message from host */
+	void HandleHostMessage(int HostIndex, const RemoteMessageHeader& Header, const QByteArray& Payload);
+
+	/** Apply frame rects from shared memory to page image and publish it */
+	void HandleFrame(int HostIndex, VaQuoleWebUI *Page, RemotePage *Remote, QDataStream& Stream);
+
+	/** Copy changed parts of page image into host framebuffer in zero-copy mode */
+	void UpdateExternalFramebuffer(UIDataKeeper *ExtComm, RemotePage *Remote, const QRegion& Region);
+
+	/** Queue message for host */
+	void Send(int HostIndex, quint32 PageId, ERemoteCommand::Type Command, const QByteArray& Payload = QByteArray());
+
+	/** Write queued messages without blocking */
+	void FlushOutgoing(int HostIndex);
+
+	/** Fail scripts lost with stopped hosts or moved pages. Call it without manager and page locks */
+	void FailLostScripts();
+
+private:
+	/** Path to VaQuoleUIHost executable */
+	QString HostExecutable;
+
+	/** Host processes pool */
+	QVector<RemoteHost> Hosts;
+
+	/** Remote state of all pages */
+	QHash<QString, RemotePage*> RemotePages;	// ObjectId, Page
+	QHash<quint32, VaQuoleWebUI*> PagesById;
+	quint32 NextPageId;
+
+	/** Manager time used for host restarts and balancing */
+	QElapsedTimer Clock;
+	qint64 NextRebalanceMs;
+
+	/** Page commands interrupt waiting for host messages with it */
+	int WakeUpPipe[2];
+
+};
+
+} // namespace VaQuole
+
+#endif // VAQUOLEREMOTEMANAGER_H
@@ -0,0 +1,301 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#include "VaQuoleRemoteProtocol.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QStringList>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace VaQuole
+{
+
+//////////////////////////////////////////////////////////////////////////
+// Messages
+
+void AppendRemoteMessage(QByteArray& Buffer, quint32 PageId, ERemoteCommand::Type Command, const QByteArray& Payload)
+{
+	RemoteMessageHeader Header;
+	Header.PageId = PageId;
+	Header.Command = (quint16)Command;
+	Header.PayloadSize = Payload.size();
+
+	Buffer.append((const char*)&Header, sizeof(Header));
+	Buffer.append(Payload);
+}
+
+bool FlushRemoteMessages(int Socket, QByteArray& Buffer)
+{
+	int Written = 0;
+
+	while (Written < Buffer.size())
+	{
+		ssize_t Sent = send(Socket, Buffer.constData() + Written, Buffer.size() - Written, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (Sent < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				break;
+			}
+
+			qDebug() << "Remote message write failed:" << strerror(errno);
+			return false;
+		}
+
+		Written += Sent;
+	}
+
+	Buffer.remove(0, Written);
+
+	return true;
+}
+
+RemoteMessageReader::RemoteMessageReader()
+{
+	bBroken = false;
+}
+
+bool RemoteMessageReader::ReadAvailable(int Socket)
+{
+	char Chunk[16 * 1024];
+
+	while (true)
+	{
+		ssize_t Received = recv(Socket, Chunk, sizeof(Chunk), MSG_DONTWAIT);
+		if (Received > 0)
+		{
+			Buffer.append(Chunk, Received);
+			continue;
+		}
+
+		if (Received == 0)
+		{
+			// Other side has closed the connection
+			return false;
+		}
+
+		if (errno == EINTR)
+		{
+			continue;
+		}
+
+		return (errno == EAGAIN || errno == EWOULDBLOCK);
+	}
+}
+
+bool RemoteMessageReader::NextMessage(RemoteMessageHeader& Header, QByteArray& Payload)
+{
+	if (bBroken || Buffer.size() < (int)sizeof(RemoteMessageHeader))
+	{
+		return false;
+	}
+
+	memcpy(&Header, Buffer.constData(), sizeof(RemoteMessageHeader));
+
+	if (Header.PayloadSize > MaxRemotePayloadSize)
+	{
+		// We don't know where the next message starts, so everything after it would be garbage
+		qDebug() << "Broken remote message, payload size:" << Header.PayloadSize;
+		Buffer.clear();
+		bBroken = true;
+		return false;
+	}
+
+	const int MessageSize = sizeof(RemoteMessageHeader) + Header.PayloadSize;
+	if (Buffer.size() < MessageSize)
+	{
+		return false;
+	}
+
+	Payload = Buffer.mid(sizeof(RemoteMessageHeader), Header.PayloadSize);
+	Buffer.remove(0, MessageSize);
+
+	return true;
+}
+
+void RemoteMessageReader::Reset()
+{
+	Buffer.clear();
+	bBroken = false;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// Input events
+
+QDataStream& operator<<(QDataStream& Stream, const MouseEvent& Event)
+{
+	Stream << Event.eventPos << (qint32)Event.button << (qint32)Event.modifiers
+		<< Event.bButtonPressed << Event.bScrollUp << Event.bScrollDown;
+
+	return Stream;
+}
+
+QDataStream& operator>>(QDataStream& Stream, MouseEvent& Event)
+{
+	qint32 Button = 0;
+	qint32 Modifiers = 0;
+
+	Stream >> Event.eventPos >> Button >> Modifiers
+		>> Event.bButtonPressed >> Event.bScrollUp >> Event.bScrollDown;
+
+	Event.button = (Qt::MouseButton)Button;
+	Event.modifiers = (Qt::KeyboardModifiers)Modifiers;
+
+	return Stream;
+}
+
+QDataStream& operator<<(QDataStream& Stream, const KeyEvent& Event)
+{
+	Stream << (qint32)Event.key << (qint32)Event.modifiers << Event.bKeyPressed << Event.text;
+
+	return Stream;
+}
+
+QDataStream& operator>>(QDataStream& Stream, KeyEvent& Event)
+{
+	qint32 Key = 0;
+	qint32 Modifiers = 0;
+
+	Stream >> Key >> Modifiers >> Event.bKeyPressed >> Event.text;
+
+	Event.key = (Qt::Key)Key;
+	Event.modifiers = (Qt::KeyboardModifiers)Modifiers;
+
+	return Stream;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// Shared memory
+
+SharedFrameMemory::SharedFrameMemory()
+{
+	Data = NULL;
+	Size = 0;
+	bOwner = false;
+}
+
+SharedFrameMemory::~SharedFrameMemory()
+{
+	Close();
+}
+
+bool SharedFrameMemory::Create(const QString& SegmentName, int SegmentSize)
+{
+	Close();
+
+	QByteArray NameBytes = SegmentName.toLocal8Bit();
+	int Fd = shm_open(NameBytes.constData(), O_CREAT | O_RDWR | O_TRUNC, S_IRUSR | S_IWUSR);
+	if (Fd < 0)
+	{
+		qDebug() << "Can't create shared memory" << SegmentName << strerror(errno);
+		return false;
+	}
+
+	if (ftruncate(Fd, SegmentSize) != 0)
+	{
+		qDebug() << "Can't resize shared memory" << SegmentName << strerror(errno);
+		close(Fd);
+		shm_unlink(NameBytes.constData());
+		return false;
+	}
+
+	Name = SegmentName;
+	bOwner = true;
+
+	return Map(Fd, SegmentSize);
+}
+
+bool SharedFrameMemory::Open(const QString& SegmentName, int SegmentSize)
+{
+	Close();
+
+	int Fd = shm_open(SegmentName.toLocal8Bit().constData(), O_RDONLY, 0);
+	if (Fd < 0)
+	{
+		qDebug() << "Can't open shared memory" << SegmentName << strerror(errno);
+		return false;
+	}
+
+	Name = SegmentName;
+	bOwner = false;
+
+	if (!Map(Fd, SegmentSize))
+	{
+		return false;
+	}
+
+	// We're the only reader, so name isn't needed anymore
+	shm_unlink(SegmentName.toLocal8Bit().constData());
+
+	return true;
+}
+
+bool SharedFrameMemory::Map(int Fd, int SegmentSize)
+{
+	void* Mapped = mmap(NULL, SegmentSize, bOwner ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, Fd, 0);
+	close(Fd);
+
+	if (Mapped == MAP_FAILED)
+	{
+		qDebug() << "Can't map shared memory" << Name << strerror(errno);
+		Close();
+		return false;
+	}
+
+	Data = (uchar*)Mapped;
+	Size = SegmentSize;
+
+	return true;
+}
+
+void SharedFrameMemory::Close()
+{
+	if (Data)
+	{
+		munmap(Data, Size);
+	}
+
+	if (bOwner && !Name.isEmpty())
+	{
+		shm_unlink(Name.toLocal8Bit().constData());
+	}
+
+	Name = QString();
+	Data = NULL;
+	Size = 0;
+	bOwner = false;
+}
+
+QString GetSharedFrameName(qint64 HostPid, quint32 PageId, quint32 Generation)
+{
+	return QString("/VaQuoleUI_%1_%2_%3").arg(HostPid).arg(PageId).arg(Generation);
+}
+
+void UnlinkSharedFrames(qint64 HostPid)
+{
+#ifdef Q_OS_LINUX
+	const QStringList Segments = QDir("/dev/shm").entryList(QStringList(QString("VaQuoleUI_%1_*").arg(HostPid)), QDir::Files);
+	foreach (const QString& Segment, Segments)
+	{
+		shm_unlink(("/" + Segment).toLocal8Bit().constData());
+	}
+#else
+	Q_UNUSED(HostPid);
+#endif
+}
+
+} // namespace VaQuole
@@ -0,0 +1,144 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#ifndef VAQUOLEREMOTEPROTOCOL_H
+#define VAQUOLEREMOTEPROTOCOL_H
+
+#include "../Include/VaQuolePublicPCH.h"
+
+#include "VaQuoleInputHelpers.h"
+
+#include <QByteArray>
+#include <QDataStream>
+#include <QString>
+
+namespace VaQuole
+{
+
+/**
+ * Commands sent between the game process and the renderer host.
+ * Payloads are written with QDataStream in the listed order
+ */
+namespace ERemoteCommand
+{
+	enum Type
+	{
+		// Game -> Host
+		CreatePage,				// -
+		DestroyPage,			// -
+		OpenURL,				// QString URL
+		Resize,					// qint32 Width, qint32 Height
+		SetTransparent,			// bool Transparent
+		SetEnabled,				// bool Enabled
+		InputMouse,				// MouseEvent
+		InputKey,				// KeyEvent
+		EvaluateJavaScript,		// QString Uuid, QString ScriptSource
+		FrameAck,				// - (host can reuse frame memory)
+		SetOutputFormat,		// qint32 EPixelFormat
+		SetPriority,			// qint32 EPagePriority
+		SetTargetFrameRate,		// qint32 FrameRate
+		EvaluateJavaScriptBatch,	// quint32 FirstCallId, QStringList ScriptSources
+
+		// Host -> Game
+		PageState,				// quint32 URLSerial, bool PageLoaded, bool Transparent, qint32 Width, qint32 Height
+		FrameReady,				// quint32 Generation, qint32 SegmentSize, qint32 Width, qint32 Height, QVector<QRect> Rects
+		ScriptResult,			// QString Uuid, QString ReturnValue
+		ScriptEvent,			// QString Event, QString Message
+		PageLoad,				// qint32 IntervalMs, qint64 PaintTimeUs, qint64 ScriptTimeUs
+		ScriptCallResults		// QList< QPair<quint32, ScriptValue> > CallId, Result
+	};
+}
+
+/**
+ * Fixed size header of each message, payload follows it
+ */
+#pragma pack(push, 1)
+struct RemoteMessageHeader
+{
+	quint32 PageId;
+	quint16 Command;
+	quint32 PayloadSize;
+};
+#pragma pack(pop)
+
+/** Max payload size to protect us from broken streams */
+static const quint32 MaxRemotePayloadSize = 16 * 1024 * 1024;
+
+/** Add one message to outgoing buffer */
+void AppendRemoteMessage(QByteArray& Buffer, quint32 PageId, ERemoteCommand::Type Command, const QByteArray& Payload = QByteArray());
+
+/** Write as much of outgoing buffer as socket accepts without blocking, returns false if connection is broken */
+bool FlushRemoteMessages(int Socket, QByteArray& Buffer);
+
+/**
+ * Accumulates data from the socket and splits it into messages
+ */
+class RemoteMessageReader
+{
+public:
+	RemoteMessageReader();
+
+	/** Read all available data without blocking, returns false if connection is closed */
+	bool ReadAvailable(int Socket);
+
+	/** Extract next complete message */
+	bool NextMessage(RemoteMessageHeader& Header, QByteArray& Payload);
+
+	/** Is stream out of sync? Connection can't be used anymore then */
+	bool IsBroken() const { return bBroken; }
+
+	/** Drop all cached data */
+	void Reset();
+
+private:
+	QByteArray Buffer;
+	bool bBroken;
+};
+
+/**
+ * POSIX shared memory segment to pass frame pixels
+ */
+class SharedFrameMemory
+{
+public:
+	SharedFrameMemory();
+	~SharedFrameMemory();
+
+	SharedFrameMemory(SharedFrameMemory const&) = delete;
+	SharedFrameMemory& operator =(SharedFrameMemory const&) = delete;
+
+	/** Create new segment (host side), it's unlinked on close */
+	bool Create(const QString& SegmentName, int SegmentSize);
+
+	/** Map existing segment (game side) and unlink its name, so memory is freed with the last mapping even if host crashes */
+	bool Open(const QString& SegmentName, int SegmentSize);
+
+	/** Unmap segment */
+	void Close();
+
+	uchar* GetData() const { return Data; }
+	int GetSize() const { return Size; }
+
+private:
+	bool Map(int Fd, int SegmentSize);
+
+	QString Name;
+	uchar* Data;
+	int Size;
+	bool bOwner;
+};
+
+/** Input events serialization */
+QDataStream& operator<<(QDataStream& Stream, const MouseEvent& Event);
+QDataStream& operator>>(QDataStream& Stream, MouseEvent& Event);
+QDataStream& operator<<(QDataStream& Stream, const KeyEvent& Event);
+QDataStream& operator>>(QDataStream& Stream, KeyEvent& Event);
+
+/** Name of shared memory segment with page frame. Pixels of frame rects are packed one after another */
+QString GetSharedFrameName(qint64 HostPid, quint32 PageId, quint32 Generation);
+
+/** Remove segments left by stopped host that game hasn't opened yet (Linux only, other systems don't list them) */
+void UnlinkSharedFrames(qint64 HostPid);
+
+} // namespace VaQuole
+
+#endif // VAQUOLEREMOTEPROTOCOL_H
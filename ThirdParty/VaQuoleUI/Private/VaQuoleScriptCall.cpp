@@ -0,0 +1,292 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#include "VaQuoleScriptCall.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <chrono>
+
+namespace VaQuole
+{
+
+/** Returned for strings of not completed calls */
+static const TCHAR EmptyString[] = { 0 };
+
+//////////////////////////////////////////////////////////////////////////
+// ScriptValue
+
+ScriptValue::ScriptValue()
+{
+	Status = EScriptCallStatus::Succeeded;
+	Type = EScriptValueType::Null;
+	BoolValue = false;
+	NumberValue = 0.0;
+}
+
+ScriptValue ScriptValue::FromVariant(const QVariant& Value)
+{
+	ScriptValue Result;
+
+	const int ValueType = Value.userType();
+	switch (ValueType)
+	{
+	case QMetaType::QString:
+		Result.Type = EScriptValueType::String;
+		Result.Text = Value.toString();
+		break;
+
+	case QMetaType::Bool:
+		Result.Type = EScriptValueType::Bool;
+		Result.BoolValue = Value.toBool();
+		Result.Text = Value.toString();
+		break;
+
+	case QMetaType::Int:
+	case QMetaType::UInt:
+	case QMetaType::LongLong:
+	case QMetaType::ULongLong:
+	case QMetaType::Float:
+	case QMetaType::Double:
+		Result.Type = EScriptValueType::Number;
+		Result.NumberValue = Value.toDouble();
+		Result.Text = Value.toString();
+		break;
+
+	case QMetaType::QVariantList:
+	case QMetaType::QStringList:
+		Result.Type = EScriptValueType::Array;
+		Result.Text = QString::fromUtf8(QJsonDocument(QJsonArray::fromVariantList(Value.toList())).toJson(QJsonDocument::Compact));
+		break;
+
+	case QMetaType::QVariantMap:
+	case QMetaType::QVariantHash:
+		Result.Type = EScriptValueType::Object;
+		Result.Text = QString::fromUtf8(QJsonDocument(QJsonObject::fromVariantMap(Value.toMap())).toJson(QJsonDocument::Compact));
+		break;
+
+	default:
+		// WebKit passes undefined and null as invalid or null pointer values, dates and regexps are kept as text
+		if (Value.isValid() && !Value.isNull() && ValueType != QMetaType::VoidStar && ValueType != QMetaType::QObjectStar)
+		{
+			Result.Type = EScriptValueType::String;
+			Result.Text = Value.toString();
+		}
+		break;
+	}
+
+	return Result;
+}
+
+ScriptValue ScriptValue::FromError(const QString& Error)
+{
+	ScriptValue Result;
+	Result.Status = EScriptCallStatus::Failed;
+	Result.Text = Error;
+
+	return Result;
+}
+
+QString ScriptValue::ToString() const
+{
+	return (Status == EScriptCallStatus::Succeeded) ? Text : QString();
+}
+
+QDataStream& operator<<(QDataStream& Stream, const ScriptValue& Value)
+{
+	Stream << (qint32)Value.Status << (qint32)Value.Type << Value.BoolValue << Value.NumberValue << Value.Text;
+	return Stream;
+}
+
+QDataStream& operator>>(QDataStream& Stream, ScriptValue& Value)
+{
+	qint32 Status = 0;
+	qint32 Type = 0;
+	Stream >> Status >> Type >> Value.BoolValue >> Value.NumberValue >> Value.Text;
+
+	Value.Status = (EScriptCallStatus::Type)Status;
+	Value.Type = (EScriptValueType::Type)Type;
+
+	return Stream;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ScriptCallState
+
+void ScriptCallState::Complete(const std::shared_ptr<ScriptCallState>& State, const ScriptValue& Value)
+{
+	Q_CHECK_PTR(State.get());
+
+	{
+		std::lock_guard<std::mutex> guard(State->mutex);
+
+		if (State->bCompleted.load(std::memory_order_relaxed))
+		{
+			return;
+		}
+
+		State->Value = Value;
+		if (Value.Status == EScriptCallStatus::Succeeded)
+		{
+			State->TextString = ToTCHAR(Value.Text);
+		}
+		else
+		{
+			State->ErrorString = ToTCHAR(Value.Text);
+		}
+
+		State->bCompleted.store(true, std::memory_order_release);
+	}
+
+	State->CompletedCondition.notify_all();
+
+	if (!State->Callback)
+	{
+		return;
+	}
+
+	if (State->CallbackThread == EScriptCallbackThread::Immediate)
+	{
+		// Callback often keeps the handle, so it's released to not hold the call forever
+		ScriptCallback Callback;
+		Callback.swap(State->Callback);
+		Callback(ScriptCall(State));
+	}
+	else
+	{
+		ScriptCallbackQueue::Get().Push(State);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ScriptCallbackQueue
+
+ScriptCallbackQueue& ScriptCallbackQueue::Get()
+{
+	static ScriptCallbackQueue Queue;
+	return Queue;
+}
+
+void ScriptCallbackQueue::Push(const std::shared_ptr<ScriptCallState>& State)
+{
+	std::lock_guard<std::mutex> guard(mutex);
+
+	States.push_back(State);
+}
+
+int ScriptCallbackQueue::Dispatch(int MaxCallbacks)
+{
+	int CallbacksRun = 0;
+
+	while (MaxCallbacks < 0 || CallbacksRun < MaxCallbacks)
+	{
+		std::shared_ptr<ScriptCallState> State;
+
+		{
+			std::lock_guard<std::mutex> guard(mutex);
+
+			if (States.empty())
+			{
+				break;
+			}
+
+			State = States.front();
+			States.pop_front();
+		}
+
+		// Queue is unlocked, so callback can start new calls
+		ScriptCallback Callback;
+		Callback.swap(State->Callback);
+		Callback(ScriptCall(State));
+
+		CallbacksRun++;
+	}
+
+	return CallbacksRun;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ScriptCall
+
+ScriptCall::ScriptCall()
+{
+}
+
+ScriptCall::ScriptCall(const std::shared_ptr<ScriptCallState>& InState)
+	: State(InState)
+{
+}
+
+bool ScriptCall::IsValid() const
+{
+	return State.get() != NULL;
+}
+
+unsigned int ScriptCall::GetCallId() const
+{
+	return State ? State->CallId : 0;
+}
+
+bool ScriptCall::IsCompleted() const
+{
+	return State && State->bCompleted.load(std::memory_order_acquire);
+}
+
+bool ScriptCall::Wait(int TimeoutMs) const
+{
+	if (!State)
+	{
+		return false;
+	}
+
+	std::unique_lock<std::mutex> lock(State->mutex);
+
+	ScriptCallState* CallState = State.get();
+	auto IsDone = [CallState]() { return CallState->bCompleted.load(std::memory_order_acquire); };
+
+	if (TimeoutMs < 0)
+	{
+		State->CompletedCondition.wait(lock, IsDone);
+		return true;
+	}
+
+	return State->CompletedCondition.wait_for(lock, std::chrono::milliseconds(TimeoutMs), IsDone);
+}
+
+EScriptCallStatus::Type ScriptCall::GetStatus() const
+{
+	if (!State)
+	{
+		return EScriptCallStatus::Failed;
+	}
+
+	return IsCompleted() ? State->Value.Status : EScriptCallStatus::Pending;
+}
+
+EScriptValueType::Type ScriptCall::GetType() const
+{
+	return (GetStatus() == EScriptCallStatus::Succeeded) ? State->Value.Type : EScriptValueType::Null;
+}
+
+bool ScriptCall::GetBool() const
+{
+	return (GetType() == EScriptValueType::Bool) ? State->Value.BoolValue : false;
+}
+
+double ScriptCall::GetNumber() const
+{
+	return (GetType() == EScriptValueType::Number) ? State->Value.NumberValue : 0.0;
+}
+
+const TCHAR* ScriptCall::GetString() const
+{
+	return IsCompleted() ? State->TextString.c_str() : EmptyString;
+}
+
+const TCHAR* ScriptCall::GetError() const
+{
+	return IsCompleted() ? State->ErrorString.c_str() : EmptyString;
+}
+
+} // namespace VaQuole
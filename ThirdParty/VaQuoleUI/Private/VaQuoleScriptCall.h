@@ -0,0 +1,111 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#ifndef VAQUOLESCRIPTCALL_H
+#define VAQUOLESCRIPTCALL_H
+
+#include "../Include/VaQuoleUILib.h"
+#include "VaQuoleStringHelpers.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+#include <QDataStream>
+#include <QString>
+#include <QVariant>
+
+namespace VaQuole
+{
+
+/**
+ * Typed result of JavaScript call
+ */
+struct ScriptValue
+{
+	/** Succeeded or Failed */
+	EScriptCallStatus::Type Status;
+
+	EScriptValueType::Type Type;
+	bool BoolValue;
+	double NumberValue;
+
+	/** Value as text (JSON for arrays and objects), or error message of failed call */
+	QString Text;
+
+	/** Defaults */
+	ScriptValue();
+
+	/** Convert value returned by WebKit */
+	static ScriptValue FromVariant(const QVariant& Value);
+
+	/** Failed call */
+	static ScriptValue FromError(const QString& Error);
+
+	/** Value as text, empty if call failed */
+	QString ToString() const;
+};
+
+QDataStream& operator<<(QDataStream& Stream, const ScriptValue& Value);
+QDataStream& operator>>(QDataStream& Stream, ScriptValue& Value);
+
+/**
+ * Data shared by all handles of asynchronous JavaScript call
+ */
+struct ScriptCallState
+{
+	quint32 CallId;
+
+	ScriptCallback Callback;
+	EScriptCallbackThread::Type CallbackThread;
+
+	/** Result and its engine strings are written once, before bCompleted is set */
+	std::atomic<bool> bCompleted;
+	ScriptValue Value;
+	TCHARString TextString;
+	TCHARString ErrorString;
+
+	/** Waiters of the result */
+	std::mutex mutex;
+	std::condition_variable CompletedCondition;
+
+	/** Defaults */
+	ScriptCallState()
+		: bCompleted(false)
+	{
+		CallId = 0;
+		CallbackThread = EScriptCallbackThread::Dispatched;
+	}
+
+	/** Set result, wake up waiters and run or queue callback. Call it without page locks: callback can call the page */
+	static void Complete(const std::shared_ptr<ScriptCallState>& State, const ScriptValue& Value);
+};
+
+/**
+ * Completed calls waiting for DispatchScriptCallbacks()
+ */
+class ScriptCallbackQueue
+{
+public:
+	/** Queue shared by all pages */
+	static ScriptCallbackQueue& Get();
+
+	void Push(const std::shared_ptr<ScriptCallState>& State);
+
+	/** Run callbacks on calling thread. Returns number of callbacks run */
+	int Dispatch(int MaxCallbacks);
+
+private:
+	ScriptCallbackQueue() { }
+
+	ScriptCallbackQueue(ScriptCallbackQueue const&) = delete;
+	ScriptCallbackQueue& operator =(ScriptCallbackQueue const&) = delete;
+
+	std::mutex mutex;
+	std::deque< std::shared_ptr<ScriptCallState> > States;
+};
+
+} // namespace VaQuole
+
+#endif // VAQUOLESCRIPTCALL_H
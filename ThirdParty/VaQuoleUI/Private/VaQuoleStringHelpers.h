@@ -0,0 +1,48 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#ifndef VAQUOLESTRINGHELPERS_H
+#define VAQUOLESTRINGHELPERS_H
+
+#include "../Include/VaQuolePublicPCH.h"
+
+#include <string>
+
+#include <QString>
+
+namespace VaQuole
+{
+
+/** Engine string storage */
+typedef std::basic_string<TCHAR> TCHARString;
+
+/**
+ * Convert engine string to QString. Wide chars are UTF-16 on Windows and UTF-32 on Linux,
+ * so they can't be just reinterpreted as QString data
+ */
+inline QString FromTCHAR(const TCHAR* Str)
+{
+	if (Str == NULL)
+	{
+		return QString();
+	}
+
+#ifdef UNICODE
+	return QString::fromWCharArray(Str);
+#else
+	return QString::fromUtf8(Str);
+#endif
+}
+
+/** Convert QString to engine string */
+inline TCHARString ToTCHAR(const QString& Str)
+{
+#ifdef UNICODE
+	return Str.toStdWString();
+#else
+	return Str.toStdString();
+#endif
+}
+
+} // namespace VaQuole
+
+#endif // VAQUOLESTRINGHELPERS_H
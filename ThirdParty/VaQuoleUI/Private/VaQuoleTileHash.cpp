@@ -0,0 +1,172 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#include "VaQuoleTileHash.h"
+
+#include <string.h>
+
+namespace VaQuole
+{
+
+//////////////////////////////////////////////////////////////////////////
+// Hashing
+
+/** xxHash64 primes */
+static const quint64 Prime1 = 11400714785074694791ULL;
+static const quint64 Prime2 = 14029467366897019727ULL;
+static const quint64 Prime3 = 1609587929392839161ULL;
+static const quint64 Prime4 = 9650029242287828579ULL;
+
+static inline quint64 RotateLeft(quint64 Value, int Bits)
+{
+	return (Value << Bits) | (Value >> (64 - Bits));
+}
+
+static inline quint64 HashRound(quint64 Acc, quint64 Input)
+{
+	Acc += Input * Prime2;
+	Acc = RotateLeft(Acc, 31);
+	return Acc * Prime1;
+}
+
+static inline quint64 MergeRound(quint64 Acc, quint64 Lane)
+{
+	Acc ^= HashRound(0, Lane);
+	return Acc * Prime1 + Prime4;
+}
+
+static inline quint64 ReadWord(const uchar* Bits)
+{
+	quint64 Value;
+	memcpy(&Value, Bits, sizeof(Value));
+	return Value;
+}
+
+quint64 HashImageRect(const uchar* Bits, int Stride, const QRect& Rect)
+{
+	// Four independent lanes (xxHash64 rounds) keep the CPU pipeline busy
+	quint64 Lanes[4] = { Prime1 + Prime2, Prime2, 0, 0 - Prime1 };
+
+	const int LineSize = Rect.width() * 4;
+	for (int Line = 0; Line < Rect.height(); Line++)
+	{
+		const uchar* Data = Bits + (Rect.y() + Line) * Stride + Rect.x() * 4;
+		const uchar* End = Data + LineSize;
+
+		for (; Data + 32 <= End; Data += 32)
+		{
+			Lanes[0] = HashRound(Lanes[0], ReadWord(Data));
+			Lanes[1] = HashRound(Lanes[1], ReadWord(Data + 8));
+			Lanes[2] = HashRound(Lanes[2], ReadWord(Data + 16));
+			Lanes[3] = HashRound(Lanes[3], ReadWord(Data + 24));
+		}
+
+		// Rest of the line goes pixel by pixel
+		for (; Data < End; Data += 4)
+		{
+			quint32 Pixel;
+			memcpy(&Pixel, Data, sizeof(Pixel));
+			Lanes[0] = HashRound(Lanes[0], Pixel);
+		}
+	}
+
+	quint64 Hash = RotateLeft(Lanes[0], 1) + RotateLeft(Lanes[1], 7) + RotateLeft(Lanes[2], 12) + RotateLeft(Lanes[3], 18);
+	for (int i = 0; i < 4; i++)
+	{
+		Hash = MergeRound(Hash, Lanes[i]);
+	}
+
+	// Size matters too, so tiles of different shape never match
+	Hash += (quint64)Rect.width() << 32 | (quint64)Rect.height();
+
+	Hash ^= Hash >> 33;
+	Hash *= Prime2;
+	Hash ^= Hash >> 29;
+	Hash *= Prime3;
+	Hash ^= Hash >> 32;
+
+	return Hash;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// Tiles grid
+
+TileHashGrid::TileHashGrid()
+{
+	Columns = 0;
+	Rows = 0;
+}
+
+QRegion TileHashGrid::FilterChangedTiles(const uchar* Bits, int Stride, const QSize& ImageSize, const QRegion& PaintedRegion)
+{
+	// View was resized, so old hashes are useless
+	if (ImageSize != GridImageSize)
+	{
+		GridImageSize = ImageSize;
+		Columns = (ImageSize.width() + TileSize - 1) / TileSize;
+		Rows = (ImageSize.height() + TileSize - 1) / TileSize;
+
+		Hashes.fill(0, Columns * Rows);
+		HashValid.fill(false, Columns * Rows);
+	}
+
+	QRegion ChangedRegion;
+	QRect ChangedRun;
+
+	// Tiles come row by row, so neighbours are merged before they're added to region
+	foreach (const QRect& Tile, SplitToTiles(PaintedRegion, ImageSize))
+	{
+		const int TileIndex = (Tile.y() / TileSize) * Columns + Tile.x() / TileSize;
+		const quint64 Hash = HashImageRect(Bits, Stride, Tile);
+
+		if (HashValid[TileIndex] && Hashes[TileIndex] == Hash)
+		{
+			continue;
+		}
+
+		Hashes[TileIndex] = Hash;
+		HashValid[TileIndex] = true;
+
+		if (!ChangedRun.isEmpty() && ChangedRun.y() == Tile.y() && ChangedRun.right() + 1 == Tile.left())
+		{
+			ChangedRun.setRight(Tile.right());
+		}
+		else
+		{
+			ChangedRegion += ChangedRun;
+			ChangedRun = Tile;
+		}
+	}
+
+	ChangedRegion += ChangedRun;
+
+	return ChangedRegion;
+}
+
+QVector<QRect> TileHashGrid::SplitToTiles(const QRegion& Region, const QSize& ImageSize)
+{
+	QVector<QRect> Tiles;
+
+	const QRect ImageRect(QPoint(0, 0), ImageSize);
+	const QRect Bounds = Region.boundingRect().intersected(ImageRect);
+	if (Bounds.isEmpty())
+	{
+		return Tiles;
+	}
+
+	for (int Row = Bounds.top() / TileSize; Row <= Bounds.bottom() / TileSize; Row++)
+	{
+		for (int Column = Bounds.left() / TileSize; Column <= Bounds.right() / TileSize; Column++)
+		{
+			const QRect Tile = QRect(Column * TileSize, Row * TileSize, TileSize, TileSize).intersected(ImageRect);
+			if (Region.intersects(Tile))
+			{
+				Tiles.append(Tile);
+			}
+		}
+	}
+
+	return Tiles;
+}
+
+} // namespace VaQuole
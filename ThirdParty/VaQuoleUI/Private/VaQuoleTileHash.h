@@ -0,0 +1,50 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#ifndef VAQUOLETILEHASH_H
+#define VAQUOLETILEHASH_H
+
+#include "../Include/VaQuolePublicPCH.h"
+
+#include <QRect>
+#include <QRegion>
+#include <QSize>
+#include <QVector>
+
+namespace VaQuole
+{
+
+/** Hash of pixels inside the rect of the image (4 bytes per pixel) */
+quint64 HashImageRect(const uchar* Bits, int Stride, const QRect& Rect);
+
+/**
+ * Grid of tile hashes over the view image. WebKit often repaints much more than
+ * was really changed, so painted tiles are hashed and only changed ones are published
+ */
+class TileHashGrid
+{
+public:
+	/** Tile side in pixels (multiple of compression block size) */
+	static const int TileSize = 64;
+
+	TileHashGrid();
+
+	/** Hash tiles touched by painted region and get the ones whose pixels have changed */
+	QRegion FilterChangedTiles(const uchar* Bits, int Stride, const QSize& ImageSize, const QRegion& PaintedRegion);
+
+	/** Split region into rects of the tiles it touches */
+	static QVector<QRect> SplitToTiles(const QRegion& Region, const QSize& ImageSize);
+
+private:
+	/** Image the grid was built for */
+	QSize GridImageSize;
+	int Columns;
+	int Rows;
+
+	/** Hashes of published tiles */
+	QVector<quint64> Hashes;
+	QVector<bool> HashValid;
+};
+
+} // namespace VaQuole
+
+#endif // VAQUOLETILEHASH_H
@@ -0,0 +1,183 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#include "VaQuoleTrace.h"
+
+#include <QCoreApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <chrono>
+#include <functional>
+#include <thread>
+
+namespace VaQuole
+{
+
+TraceRecorder::TraceRecorder()
+	: bEnabled(false)
+	, WritePos(0)
+{
+	Events = NULL;
+	Capacity = 0;
+}
+
+TraceRecorder& TraceRecorder::Get()
+{
+	// Never destroyed: UI thread can record events during static destruction
+	static TraceRecorder* Recorder = new TraceRecorder();
+	return *Recorder;
+}
+
+void TraceRecorder::Start(int MaxEvents)
+{
+	std::lock_guard<std::mutex> guard(mutex);
+
+	// Writers could still use the ring of previous session, so it's never reallocated
+	if (Events == NULL)
+	{
+		Capacity = qMax(MaxEvents, 1024);
+		Events = new TraceEvent[Capacity];
+
+		for (quint32 i = 0; i < Capacity; i++)
+		{
+			Events[i].Sequence.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	// Events of previous session are skipped by readers
+	WritePos.fetch_add(Capacity);
+
+	bEnabled.store(true);
+}
+
+void TraceRecorder::Stop()
+{
+	bEnabled.store(false);
+}
+
+void TraceRecorder::Record(const char* Name, quint64 StartUs, quint64 DurationUs, const void* Page)
+{
+	if (Events == NULL)
+	{
+		return;
+	}
+
+	const quint64 Pos = WritePos.fetch_add(1, std::memory_order_relaxed);
+	TraceEvent& Event = Events[Pos % Capacity];
+
+	// Odd sequence tells readers that slot is being written
+	Event.Sequence.store(Pos * 2 + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	Event.Name = Name;
+	Event.StartUs = StartUs;
+	Event.DurationUs = DurationUs;
+	Event.ThreadId = GetThreadId();
+	Event.Page = Page;
+
+	Event.Sequence.store(Pos * 2 + 2, std::memory_order_release);
+}
+
+void TraceRecorder::SetThreadName(const QString& Name)
+{
+	std::lock_guard<std::mutex> guard(mutex);
+
+	ThreadNames.insert(GetThreadId(), Name);
+}
+
+QByteArray TraceRecorder::ToChromeTrace()
+{
+	const qint64 ProcessId = QCoreApplication::applicationPid();
+
+	QJsonArray TraceEvents;
+
+	std::lock_guard<std::mutex> guard(mutex);
+
+	if (Events != NULL)
+	{
+		const quint64 End = WritePos.load(std::memory_order_acquire);
+		const quint64 Begin = (End > Capacity) ? End - Capacity : 0;
+
+		for (quint64 Pos = Begin; Pos < End; Pos++)
+		{
+			TraceEvent& Event = Events[Pos % Capacity];
+
+			// Slot can be rewritten while we're reading it, so check it hasn't changed
+			const quint64 Sequence = Event.Sequence.load(std::memory_order_acquire);
+			if (Sequence != Pos * 2 + 2)
+			{
+				continue;
+			}
+
+			const char* Name = Event.Name;
+			const quint64 StartUs = Event.StartUs;
+			const quint64 DurationUs = Event.DurationUs;
+			const quint64 ThreadId = Event.ThreadId;
+			const void* Page = Event.Page;
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (Event.Sequence.load(std::memory_order_relaxed) != Sequence)
+			{
+				continue;
+			}
+
+			QJsonObject Json;
+			Json["name"] = QString::fromLatin1(Name);
+			Json["cat"] = QStringLiteral("VaQuoleUI");
+			Json["ph"] = QStringLiteral("X");
+			Json["ts"] = (double)StartUs;
+			Json["dur"] = (double)DurationUs;
+			Json["pid"] = (double)ProcessId;
+			Json["tid"] = (double)ThreadId;
+
+			if (Page != NULL)
+			{
+				QJsonObject Args;
+				Args["page"] = QString("0x%1").arg((quintptr)Page, 0, 16);
+				Json["args"] = Args;
+			}
+
+			TraceEvents.append(Json);
+		}
+	}
+
+	// Metadata events give threads readable names
+	QHash<quint64, QString>::const_iterator It;
+	for (It = ThreadNames.constBegin(); It != ThreadNames.constEnd(); ++It)
+	{
+		QJsonObject Args;
+		Args["name"] = It.value();
+
+		QJsonObject Json;
+		Json["name"] = QStringLiteral("thread_name");
+		Json["ph"] = QStringLiteral("M");
+		Json["pid"] = (double)ProcessId;
+		Json["tid"] = (double)It.key();
+		Json["args"] = Args;
+
+		TraceEvents.append(Json);
+	}
+
+	QJsonObject Trace;
+	Trace["traceEvents"] = TraceEvents;
+	Trace["displayTimeUnit"] = QStringLiteral("ms");
+
+	return QJsonDocument(Trace).toJson(QJsonDocument::Compact);
+}
+
+quint64 TraceRecorder::GetTimeUs()
+{
+	// Steady clock is the platform monotonic one (QueryPerformanceCounter, CLOCK_MONOTONIC),
+	// so timestamps line up with engine ones
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+quint64 TraceRecorder::GetThreadId()
+{
+	// Trace viewer wants numbers, and 53 bits are safe for JSON
+	return std::hash<std::thread::id>()(std::this_thread::get_id()) & ((1ULL << 53) - 1);
+}
+
+} // namespace VaQuole
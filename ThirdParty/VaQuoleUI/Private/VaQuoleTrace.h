@@ -0,0 +1,117 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#ifndef VAQUOLETRACE_H
+#define VAQUOLETRACE_H
+
+#include <atomic>
+#include <mutex>
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+
+namespace VaQuole
+{
+
+/**
+ * Recorder of UI work events for chrome://tracing and Perfetto.
+ * Events are written to a ring without locks, so the oldest ones are overwritten
+ * when it's full. Recording costs one atomic load while tracing is off
+ */
+class TraceRecorder
+{
+public:
+	/** Recorder shared by all threads */
+	static TraceRecorder& Get();
+
+	/** Start recording. Ring size is set by the first call */
+	void Start(int MaxEvents);
+
+	/** Stop recording, recorded events are kept until the next Start() */
+	void Stop();
+
+	/** Is recording on? */
+	bool IsEnabled() const
+	{
+		return bEnabled.load(std::memory_order_acquire);
+	}
+
+	/** Add complete event. Name should be a string literal */
+	void Record(const char* Name, quint64 StartUs, quint64 DurationUs, const void* Page = NULL);
+
+	/** Name the calling thread in trace viewer */
+	void SetThreadName(const QString& Name);
+
+	/** Convert recorded events to Chrome trace event JSON */
+	QByteArray ToChromeTrace();
+
+	/** Monotonic clock shared with engine traces (microseconds) */
+	static quint64 GetTimeUs();
+
+	/** Id of the calling thread */
+	static quint64 GetThreadId();
+
+private:
+	TraceRecorder();
+
+	TraceRecorder(TraceRecorder const&) = delete;
+	TraceRecorder& operator =(TraceRecorder const&) = delete;
+
+	/** Ring slot, its sequence is odd while it's being written (seqlock) */
+	struct TraceEvent
+	{
+		std::atomic<quint64> Sequence;
+
+		const char* Name;
+		quint64 StartUs;
+		quint64 DurationUs;
+		quint64 ThreadId;
+		const void* Page;
+	};
+
+	std::atomic<bool> bEnabled;
+
+	TraceEvent* Events;
+	quint32 Capacity;
+
+	/** Next event number */
+	std::atomic<quint64> WritePos;
+
+	/** Thread names and ring allocation */
+	std::mutex mutex;
+	QHash<quint64, QString> ThreadNames;
+};
+
+/**
+ * Records event for the scope it lives in
+ */
+class TraceScope
+{
+public:
+	TraceScope(const char* InName, const void* InPage = NULL)
+		: Name(InName)
+		, Page(InPage)
+		, StartUs(TraceRecorder::Get().IsEnabled() ? TraceRecorder::GetTimeUs() : 0)
+	{
+	}
+
+	~TraceScope()
+	{
+		if (StartUs != 0 && TraceRecorder::Get().IsEnabled())
+		{
+			TraceRecorder::Get().Record(Name, StartUs, TraceRecorder::GetTimeUs() - StartUs, Page);
+		}
+	}
+
+private:
+	TraceScope(TraceScope const&) = delete;
+	TraceScope& operator =(TraceScope const&) = delete;
+
+	const char* Name;
+	const void* Page;
+	quint64 StartUs;
+};
+
+} // namespace VaQuole
+
+#endif // VAQUOLETRACE_H
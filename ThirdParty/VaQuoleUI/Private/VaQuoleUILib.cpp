@@ -2,21 +2,39 @@
 
 #include "../Include/VaQuoleUILib.h"
 #include "VaQuoleAppThread.h"
+#include "VaQuoleFramePool.h"
+#include "VaQuoleStringHelpers.h"
+#include "VaQuoleTrace.h"
+
+#ifdef Q_OS_UNIX
+#include "VaQuoleRemoteManager.h"
+#endif
 
 #include <QApplication>
 #include <QDebug>
+#include <QFile>
 
 #include <QImage>
 #include <QWebFrame>
 #include <QString>
 #include <QHash>
 
+#include <string.h>
+
 namespace VaQuole
 {
 
 /** Main app thread with QApplication */
 static VaQuoleUIManager* pAppThread = NULL;
 
+void WakeUpManager()
+{
+	if (pAppThread != NULL)
+	{
+		pAppThread->wakeUp();
+	}
+}
+
 /** Key map to convert UE4 keys to Qt ones */
 QHash<QString, Qt::Key> KeyMap;
 
@@ -36,7 +54,7 @@ QHash<QString, QString> KeyShiftMap;
 void Init()
 {
 	// Check that we haven't qApp already
-	if (QApplication::instance() == nullptr)
+	if (pAppThread == NULL && QApplication::instance() == nullptr)
 	{
 		pAppThread = new VaQuoleUIManager();
 		pAppThread->start();
@@ -45,6 +63,34 @@ void Init()
 	InitKeyMaps();
 }
 
+void InitHeadless()
+{
+	if (pAppThread == NULL && QApplication::instance() == nullptr)
+	{
+		pAppThread = new VaQuoleUIManager(true);
+		pAppThread->start();
+	}
+
+	InitKeyMaps();
+}
+
+void InitOutOfProcess(const TCHAR* HostExecutable, int HostsNum)
+{
+#ifdef Q_OS_UNIX
+	if (pAppThread == NULL)
+	{
+		pAppThread = new VaQuoleRemoteUIManager(FromTCHAR(HostExecutable), HostsNum);
+		pAppThread->start();
+	}
+
+	InitKeyMaps();
+#else
+	qDebug() << "Out-of-process rendering isn't supported on this platform, pages are rendered in-process";
+
+	Init();
+#endif
+}
+
 void Cleanup()
 {
 	qDebug() << "Clean so clean";
@@ -55,6 +101,22 @@ void Cleanup()
 	}
 }
 
+std::shared_future<void> InitAsync()
+{
+	Init();
+
+	if (pAppThread != NULL)
+	{
+		return pAppThread->GetReadyFuture();
+	}
+
+	// Host application runs Qt itself, so there is nothing to wait for
+	std::promise<void> Ready;
+	Ready.set_value();
+
+	return Ready.get_future().share();
+}
+
 VaQuoleWebUI* ConstructNewUI()
 {
 	VaQuoleWebUI* NewUI = new VaQuoleWebUI();
@@ -63,6 +125,64 @@ VaQuoleWebUI* ConstructNewUI()
 	return NewUI;
 }
 
+void GetFramePoolStats(FramePoolStats& Stats)
+{
+	Stats = FrameBufferPool::Get().GetStats();
+}
+
+void GetStartupTiming(StartupTiming& Timing)
+{
+	Timing = (pAppThread != NULL) ? pAppThread->GetStartupTiming() : StartupTiming();
+}
+
+void GetUIThreadStats(UIThreadStats& Stats)
+{
+	Stats = (pAppThread != NULL) ? pAppThread->GetStats() : UIThreadStats();
+}
+
+void StartTracing(int MaxEvents)
+{
+	TraceRecorder::Get().Start(MaxEvents);
+}
+
+void StopTracing()
+{
+	TraceRecorder::Get().Stop();
+}
+
+bool SaveTrace(const TCHAR* FilePath)
+{
+	QFile TraceFile(FromTCHAR(FilePath));
+	if (!TraceFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+	{
+		qDebug() << "Can't write trace to" << TraceFile.fileName();
+		return false;
+	}
+
+	return TraceFile.write(TraceRecorder::Get().ToChromeTrace()) >= 0;
+}
+
+void SetSchedulerBudget(int BudgetUs)
+{
+	if (pAppThread != NULL)
+	{
+		pAppThread->SetTickBudget(BudgetUs);
+	}
+}
+
+void SetWebViewPoolSize(int Size)
+{
+	if (pAppThread != NULL)
+	{
+		pAppThread->SetViewPoolSize(Size);
+	}
+}
+
+int DispatchScriptCallbacks(int MaxCallbacks)
+{
+	return ScriptCallbackQueue::Get().Dispatch(MaxCallbacks);
+}
+
 void InitKeyMaps()
 {
 	KeyMap.clear();
@@ -230,6 +350,8 @@ void VaQuoleWebUI::Destroy()
 
 	Q_CHECK_PTR(ExtComm);
 	ExtComm->bMarkedForDelete = true;
+
+	WakeUpManager();
 }
 
 UIDataKeeper* VaQuoleWebUI::GetData()
@@ -248,10 +370,10 @@ void VaQuoleWebUI::Register()
 
 void VaQuoleWebUI::OpenURL(const TCHAR* NewURL)
 {
-	std::lock_guard<std::mutex> guard(mutex);
-
 	Q_CHECK_PTR(ExtComm);
-	ExtComm->NewURL = QString::fromUtf16((const ushort*)NewURL);
+	ExtComm->Commands.PushURL(FromTCHAR(NewURL));
+
+	WakeUpManager();
 }
 
 void VaQuoleWebUI::OpenBenchmark()
@@ -259,28 +381,265 @@ void VaQuoleWebUI::OpenBenchmark()
 	OpenURL(L"http://www.smashcat.org/av/canvas_test/");
 }
 
+void VaQuoleWebUI::EvaluateJavaScript(const TCHAR* ScriptSource, TCHAR* OutUuid)
+{
+	QString ScriptUuid = QUuid::createUuid().toString();
+
+	Q_CHECK_PTR(ExtComm);
+	const bool bQueued = ExtComm->Commands.PushScript(ScriptUuid, FromTCHAR(ScriptSource));
+
+	if (bQueued)
+	{
+		WakeUpManager();
+	}
+	else
+	{
+		// Script that didn't fit the queue gets empty result, so nobody waits for it forever
+		std::lock_guard<std::mutex> guard(mutex);
+		ExtComm->ScriptResults.append(qMakePair(ScriptUuid, QString()));
+	}
+
+	const TCHARString Uuid = ToTCHAR(ScriptUuid);
+	Q_ASSERT(Uuid.size() + 1 == ScriptUuidLength);
+	memcpy(OutUuid, Uuid.c_str(), ScriptUuidLength * sizeof(TCHAR));
+}
+
 TCHAR* VaQuoleWebUI::EvaluateJavaScript(const TCHAR *ScriptSource)
 {
+	TCHAR Uuid[ScriptUuidLength];
+	EvaluateJavaScript(ScriptSource, Uuid);
+
+	// Returned string should outlive this call
 	std::lock_guard<std::mutex> guard(mutex);
+	ExtComm->LastScriptUuid = Uuid;
 
-	QString ScriptUuid = QUuid::createUuid().toString();
+	return (TCHAR *)ExtComm->LastScriptUuid.c_str();
+}
 
-	QPair<QString, QString> ScriptCommand;
-	ScriptCommand.first = ScriptUuid;
-	ScriptCommand.second = QString::fromUtf16((const ushort*)ScriptSource);
+unsigned int VaQuoleWebUI::EvaluateJavaScriptBatch(const TCHAR* const* ScriptSources, int ScriptsNum)
+{
+	Q_CHECK_PTR(ExtComm);
+
+	if (ScriptsNum <= 0)
+	{
+		return 0;
+	}
+
+	QStringList Scripts;
+	for (int i = 0; i < ScriptsNum; i++)
+	{
+		Scripts.append(FromTCHAR(ScriptSources[i]));
+	}
+
+	// Ids are reserved for the whole batch at once
+	const quint32 FirstCallId = ExtComm->LastScriptCallId.fetch_add(ScriptsNum) + 1;
+
+	if (ExtComm->Commands.PushScriptBatch(FirstCallId, Scripts))
+	{
+		WakeUpManager();
+	}
+	else
+	{
+		// Every call still gets its result, so nobody waits for it forever
+		QList< QPair<quint32, ScriptValue> > FailedCalls;
+		for (int i = 0; i < ScriptsNum; i++)
+		{
+			FailedCalls.append(qMakePair(FirstCallId + i, ScriptValue::FromError(QLatin1String("Command queue is full"))));
+		}
+
+		PublishScriptCallResults(this, FailedCalls);
+	}
+
+	return FirstCallId;
+}
 
+ScriptCall VaQuoleWebUI::EvaluateJavaScriptAsync(const TCHAR* ScriptSource, ScriptCallback Callback, EScriptCallbackThread::Type CallbackThread)
+{
 	Q_CHECK_PTR(ExtComm);
-	ExtComm->ScriptCommands.append(ScriptCommand);
 
-	return (TCHAR *)ScriptUuid.utf16();
+	std::shared_ptr<ScriptCallState> State = std::make_shared<ScriptCallState>();
+	State->CallId = ExtComm->LastScriptCallId.fetch_add(1) + 1;
+	State->Callback = Callback;
+	State->CallbackThread = CallbackThread;
+
+	// Call is registered before it's queued, so its result can't come first
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		ExtComm->ScriptCalls.insert(State->CallId, State);
+	}
+
+	// Single script is passed as a batch, so it gets typed result and error
+	if (ExtComm->Commands.PushScriptBatch(State->CallId, QStringList(FromTCHAR(ScriptSource))))
+	{
+		WakeUpManager();
+	}
+	else
+	{
+		{
+			std::lock_guard<std::mutex> guard(mutex);
+			ExtComm->ScriptCalls.remove(State->CallId);
+		}
+
+		ScriptCallState::Complete(State, ScriptValue::FromError(QLatin1String("Command queue is full")));
+	}
+
+	return ScriptCall(State);
 }
 
 const uchar * VaQuoleWebUI::GrabView()
+{
+	std::lock_guard<std::mutex> guard(FrameMutex);
+
+	Q_CHECK_PTR(ExtComm);
+	return ExtComm->Frames.AcquireFrame().Bits;
+}
+
+const uchar * VaQuoleWebUI::GrabViewIfNewer(unsigned int& LastSerial)
+{
+	std::lock_guard<std::mutex> guard(FrameMutex);
+
+	Q_CHECK_PTR(ExtComm);
+	if (ExtComm->Frames.GetPublishedSerial() == LastSerial)
+	{
+		return NULL;
+	}
+
+	const FrameSlot& Frame = ExtComm->Frames.AcquireFrame();
+	if (Frame.Bits == NULL || Frame.Serial == LastSerial)
+	{
+		return NULL;
+	}
+
+	LastSerial = Frame.Serial;
+	return Frame.Bits;
+}
+
+unsigned int VaQuoleWebUI::GetFrameSerial()
+{
+	Q_CHECK_PTR(ExtComm);
+	return ExtComm->Frames.GetPublishedSerial();
+}
+
+/** Copy frame rects one after another (compressed ones by lines of blocks) */
+static void PackFrameRects(const FrameSlot& Frame, const QVector<QRect>& Regions, std::vector<DirtyRect>& Rects, std::vector<uchar>& Bits)
+{
+	// Compressed formats are copied by lines of blocks
+	const int BlockSize = GetPixelFormatBlockSize(Frame.Format);
+	const int BlockBytes = GetPixelFormatBlockBytes(Frame.Format);
+
+	size_t BitsSize = 0;
+	foreach (const QRect& Rect, Regions)
+	{
+		BitsSize += GetFormatStride(Frame.Format, Rect.width()) * GetFormatLines(Frame.Format, Rect.height());
+	}
+
+	Rects.reserve(Rects.size() + Regions.size());
+	Bits.reserve(Bits.size() + BitsSize);
+
+	foreach (const QRect& Rect, Regions)
+	{
+		DirtyRect Dirty;
+		Dirty.X = Rect.x();
+		Dirty.Y = Rect.y();
+		Dirty.Width = Rect.width();
+		Dirty.Height = Rect.height();
+		Rects.push_back(Dirty);
+
+		const int LineSize = GetFormatStride(Frame.Format, Rect.width());
+		const int FirstLine = Rect.y() / BlockSize;
+		const int LinesNum = GetFormatLines(Frame.Format, Rect.height());
+
+		for (int Line = 0; Line < LinesNum; Line++)
+		{
+			const uchar* LineBits = Frame.Bits + (FirstLine + Line) * Frame.Stride + Rect.x() / BlockSize * BlockBytes;
+			Bits.insert(Bits.end(), LineBits, LineBits + LineSize);
+		}
+	}
+}
+
+bool VaQuoleWebUI::GrabDirtyRegions(std::vector<DirtyRect>& Rects, std::vector<uchar>& Bits)
+{
+	TraceScope GrabTrace("GrabFrame", ExtComm);
+
+	std::lock_guard<std::mutex> guard(FrameMutex);
+
+	Q_CHECK_PTR(ExtComm);
+	const FrameSlot& Frame = ExtComm->Frames.AcquireFrame();
+	if (Frame.Bits == NULL)
+	{
+		return false;
+	}
+
+	const QRect ImageRect(0, 0, Frame.Width, Frame.Height);
+	QRegion DirtyRegion = ExtComm->Frames.TakeDirtyRegion().intersected(ImageRect);
+	if (DirtyRegion.isEmpty())
+	{
+		return false;
+	}
+
+	// Too many small pieces are slower to upload than one bigger rect
+	QVector<QRect> Regions = DirtyRegion.rects();
+	if (Regions.size() > MaxDirtyRects)
+	{
+		Regions.clear();
+		Regions.append(DirtyRegion.boundingRect());
+	}
+
+	PackFrameRects(Frame, Regions, Rects, Bits);
+
+	return true;
+}
+
+bool VaQuoleWebUI::GrabDirtyTiles(std::vector<DirtyRect>& Tiles, std::vector<uchar>& Bits)
+{
+	TraceScope GrabTrace("GrabFrame", ExtComm);
+
+	std::lock_guard<std::mutex> guard(FrameMutex);
+
+	Q_CHECK_PTR(ExtComm);
+	const FrameSlot& Frame = ExtComm->Frames.AcquireFrame();
+	if (Frame.Bits == NULL)
+	{
+		return false;
+	}
+
+	const QSize ImageSize(Frame.Width, Frame.Height);
+	QVector<QRect> FrameTiles = TileHashGrid::SplitToTiles(ExtComm->Frames.TakeDirtyRegion(), ImageSize);
+	if (FrameTiles.isEmpty())
+	{
+		return false;
+	}
+
+	PackFrameRects(Frame, FrameTiles, Tiles, Bits);
+
+	return true;
+}
+
+void VaQuoleWebUI::SetExternalFramebuffer(void* Bits, int Stride, int Width, int Height)
 {
 	std::lock_guard<std::mutex> guard(mutex);
 
 	Q_CHECK_PTR(ExtComm);
-	return ExtComm->ImageBits;
+	ExtComm->DesiredFramebufferBits = Bits;
+	ExtComm->DesiredFramebufferStride = Bits ? Stride : 0;
+	ExtComm->DesiredFramebufferWidth = Bits ? Width : 0;
+	ExtComm->DesiredFramebufferHeight = Bits ? Height : 0;
+
+	WakeUpManager();
+}
+
+bool VaQuoleWebUI::LockExternalFramebuffer()
+{
+	Q_CHECK_PTR(ExtComm);
+	return ExtComm->Framebuffer.TryAcquire(EFramebufferState::HostLocked);
+}
+
+void VaQuoleWebUI::UnlockExternalFramebuffer()
+{
+	Q_CHECK_PTR(ExtComm);
+	ExtComm->Framebuffer.Release(EFramebufferState::HostLocked);
+
+	WakeUpManager();
 }
 
 bool VaQuoleWebUI::IsEnabled()
@@ -297,6 +656,8 @@ void VaQuoleWebUI::SetEnabled(bool Enabled)
 
 	Q_CHECK_PTR(ExtComm);
 	ExtComm->bEnabled = Enabled;
+
+	WakeUpManager();
 }
 
 bool VaQuoleWebUI::IsTransparent()
@@ -313,6 +674,28 @@ void VaQuoleWebUI::SetTransparent(bool Transparent)
 
 	Q_CHECK_PTR(ExtComm);
 	ExtComm->bDesiredTransparency = Transparent;
+
+	WakeUpManager();
+}
+
+void VaQuoleWebUI::SetOutputFormat(EPixelFormat::Type Format)
+{
+	std::lock_guard<std::mutex> guard(mutex);
+
+	Q_CHECK_PTR(ExtComm);
+	ExtComm->OutputFormat = Format;
+
+	WakeUpManager();
+}
+
+void VaQuoleWebUI::SetCompressionQuality(ECompressionQuality::Type Quality)
+{
+	std::lock_guard<std::mutex> guard(mutex);
+
+	Q_CHECK_PTR(ExtComm);
+	ExtComm->CompressionQuality = Quality;
+
+	WakeUpManager();
 }
 
 bool VaQuoleWebUI::IsPageLoaded()
@@ -323,6 +706,48 @@ bool VaQuoleWebUI::IsPageLoaded()
 	return ExtComm->bPageLoaded;
 }
 
+void VaQuoleWebUI::SetPriority(EPagePriority::Type Priority)
+{
+	Q_CHECK_PTR(ExtComm);
+	ExtComm->Priority = Priority;
+
+	WakeUpManager();
+}
+
+bool VaQuoleWebUI::IsHibernating()
+{
+	std::lock_guard<std::mutex> guard(mutex);
+
+	Q_CHECK_PTR(ExtComm);
+	return ExtComm->bHibernating;
+}
+
+void VaQuoleWebUI::GetScheduleStats(PageScheduleStats& Stats)
+{
+	std::lock_guard<std::mutex> guard(mutex);
+
+	Q_CHECK_PTR(ExtComm);
+	Stats = ExtComm->ScheduleStats;
+}
+
+void VaQuoleWebUI::SetTargetFrameRate(int FrameRate)
+{
+	std::lock_guard<std::mutex> guard(mutex);
+
+	Q_CHECK_PTR(ExtComm);
+	ExtComm->TargetFrameRate = qMax(FrameRate, 0);
+
+	WakeUpManager();
+}
+
+void VaQuoleWebUI::GetFramePacingStats(FramePacingStats& Stats)
+{
+	std::lock_guard<std::mutex> guard(mutex);
+
+	Q_CHECK_PTR(ExtComm);
+	Stats = ExtComm->PacingStats;
+}
+
 void VaQuoleWebUI::Resize(int w, int h)
 {
 	std::lock_guard<std::mutex> guard(mutex);
@@ -330,6 +755,8 @@ void VaQuoleWebUI::Resize(int w, int h)
 	Q_CHECK_PTR(ExtComm);
 	ExtComm->DesiredWidth = w;
 	ExtComm->DesiredHeight = h;
+
+	WakeUpManager();
 }
 
 bool VaQuoleWebUI::IsPendingVisualEvents()
@@ -339,8 +766,13 @@ bool VaQuoleWebUI::IsPendingVisualEvents()
 	Q_CHECK_PTR(ExtComm);
 	bool bPendingTransparency = ExtComm->bTransparent != ExtComm->bDesiredTransparency;
 	bool bPendingSize = (ExtComm->Width != ExtComm->DesiredWidth) || (ExtComm->Height != ExtComm->DesiredHeight);
+	bool bPendingFramebuffer = (ExtComm->Framebuffer.Bits != ExtComm->DesiredFramebufferBits) ||
+		(ExtComm->Framebuffer.Width != ExtComm->DesiredFramebufferWidth) ||
+		(ExtComm->Framebuffer.Height != ExtComm->DesiredFramebufferHeight);
+	bool bPendingFormat = (ExtComm->DesiredFramebufferBits == NULL) &&
+		(ExtComm->Frames.GetPublishedFormat() != ExtComm->OutputFormat);
 
-	return (bPendingTransparency || bPendingSize);
+	return (bPendingTransparency || bPendingSize || bPendingFramebuffer || bPendingFormat);
 }
 
 
@@ -353,12 +785,20 @@ void VaQuoleWebUI::GetScriptResults(std::vector<ScriptEval>& Evals)
 
 	Q_CHECK_PTR(ExtComm);
 
+	// Strings are kept until the next call, storage is never reallocated while pointers are taken
+	std::vector<TCHARString>& Strings = ExtComm->ScriptResultStrings;
+	Strings.clear();
+	Strings.reserve(ExtComm->ScriptResults.size() * 2);
+
 	QPair<QString, QString> ScriptResult;
 	foreach (ScriptResult, ExtComm->ScriptResults)
 	{
+		Strings.push_back(ToTCHAR(ScriptResult.first));
+		Strings.push_back(ToTCHAR(ScriptResult.second));
+
 		ScriptEval Eval;
-		Eval.ScriptUuid = (TCHAR *)ScriptResult.first.utf16();
-		Eval.ScriptResult = (TCHAR *)ScriptResult.second.utf16();
+		Eval.ScriptUuid = (TCHAR *)Strings[Strings.size() - 2].c_str();
+		Eval.ScriptResult = (TCHAR *)Strings[Strings.size() - 1].c_str();
 		Evals.push_back(Eval);
 	}
 
@@ -372,12 +812,20 @@ void VaQuoleWebUI::GetScriptEvents(std::vector<ScriptEvent>& Events)
 
 	Q_CHECK_PTR(ExtComm);
 
+	// Strings are kept until the next call, storage is never reallocated while pointers are taken
+	std::vector<TCHARString>& Strings = ExtComm->ScriptEventStrings;
+	Strings.clear();
+	Strings.reserve(ExtComm->ScriptEvents.size() * 2);
+
 	QPair<QString, QString> EventPair;
 	foreach (EventPair, ExtComm->ScriptEvents)
 	{
+		Strings.push_back(ToTCHAR(EventPair.first));
+		Strings.push_back(ToTCHAR(EventPair.second));
+
 		ScriptEvent Event;
-		Event.EventName = (TCHAR *)EventPair.first.utf16();
-		Event.EventMessage = (TCHAR *)EventPair.second.utf16();
+		Event.EventName = (TCHAR *)Strings[Strings.size() - 2].c_str();
+		Event.EventMessage = (TCHAR *)Strings[Strings.size() - 1].c_str();
 		Events.push_back(Event);
 	}
 
@@ -385,6 +833,73 @@ void VaQuoleWebUI::GetScriptEvents(std::vector<ScriptEvent>& Events)
 	ExtComm->ScriptEvents.clear();
 }
 
+void VaQuoleWebUI::GetScriptCallResults(std::vector<ScriptCallResult>& Results)
+{
+	std::lock_guard<std::mutex> guard(mutex);
+
+	Q_CHECK_PTR(ExtComm);
+
+	// Strings are kept until the next call, storage is never reallocated while pointers are taken
+	std::vector<TCHARString>& Strings = ExtComm->ScriptCallResultStrings;
+	Strings.clear();
+	Strings.reserve(ExtComm->ScriptCallResults.size());
+
+	typedef QPair<quint32, ScriptValue> CallResultPair;
+	foreach (const CallResultPair& CallResult, ExtComm->ScriptCallResults)
+	{
+		Strings.push_back(ToTCHAR(CallResult.second.ToString()));
+
+		ScriptCallResult Result;
+		Result.CallId = CallResult.first;
+		Result.Result = (TCHAR *)Strings.back().c_str();
+		Results.push_back(Result);
+	}
+
+	// Clear cached results
+	ExtComm->ScriptCallResults.clear();
+}
+
+void VaQuoleWebUI::GetCommandQueueStats(CommandQueueStats& Stats)
+{
+	Q_CHECK_PTR(ExtComm);
+	Stats = ExtComm->Commands.GetStats();
+}
+
+void VaQuoleWebUI::GetStats(PageStats& Stats)
+{
+	Q_CHECK_PTR(ExtComm);
+	const unsigned int QueueDepth = ExtComm->Commands.GetStats().Depth;
+
+	std::lock_guard<std::mutex> guard(mutex);
+
+	Stats = ExtComm->Stats;
+	Stats.CommandQueueDepth = QueueDepth;
+	Stats.PendingScriptResults = ExtComm->ScriptResults.size();
+	Stats.PendingScriptEvents = ExtComm->ScriptEvents.size();
+}
+
+void VaQuoleWebUI::GetInputLatencyStats(InputLatencyStats& Stats)
+{
+	std::lock_guard<std::mutex> guard(mutex);
+
+	Q_CHECK_PTR(ExtComm);
+	Stats.Delivered = ExtComm->DeliveryLatency.GetCount();
+	Stats.Presented = ExtComm->InputLatency.GetCount();
+	Stats.NoResponse = ExtComm->InputsNoResponse;
+	Stats.DeliveryP50Us = ExtComm->DeliveryLatency.GetPercentile(50);
+	Stats.DeliveryP99Us = ExtComm->DeliveryLatency.GetPercentile(99);
+	Stats.P50Us = ExtComm->InputLatency.GetPercentile(50);
+	Stats.P95Us = ExtComm->InputLatency.GetPercentile(95);
+	Stats.P99Us = ExtComm->InputLatency.GetPercentile(99);
+	Stats.MaxUs = ExtComm->InputLatency.GetMax();
+}
+
+unsigned int VaQuoleWebUI::GetFrameInputId()
+{
+	Q_CHECK_PTR(ExtComm);
+	return ExtComm->PresentedInputId;
+}
+
 
 //////////////////////////////////////////////////////////////////////////
 // Player input
@@ -393,8 +908,6 @@ void VaQuoleWebUI::InputMouse(int X, int Y, VaQuole::EMouseButton::Type Button,
 								bool bMouseDown,
 								const VaQuole::KeyModifiers Modifiers)
 {
-	std::lock_guard<std::mutex> guard(mutex);
-
 	MouseEvent Event;
 	Event.eventPos = QPoint(X,Y);
 	Event.bButtonPressed = bMouseDown;
@@ -447,7 +960,23 @@ void VaQuoleWebUI::InputMouse(int X, int Y, VaQuole::EMouseButton::Type Button,
 	}
 
 	Q_CHECK_PTR(ExtComm);
-	ExtComm->MouseEvents.append(Event);
+
+	// Engine sends cursor position each tick, so don't wake Qt thread while it stays still
+	const bool bMouseMove = (Event.button == Qt::NoButton && !Event.bScrollUp && !Event.bScrollDown);
+	quint64 MousePos = (quint64)(quint32)Event.eventPos.x() << 32 | (quint32)Event.eventPos.y();
+	if (ExtComm->LastMousePos.exchange(MousePos) == MousePos && bMouseMove)
+	{
+		return;
+	}
+
+	if (!ExtComm->Commands.PushMouseEvent(Event))
+	{
+		// Dropped position was never sent, so the next event isn't skipped (unless other thread has sent newer one)
+		ExtComm->LastMousePos.compare_exchange_strong(MousePos, ~0ULL);
+		return;
+	}
+
+	WakeUpManager();
 }
 
 void VaQuoleWebUI::InputKey(const TCHAR *Key,
@@ -455,8 +984,6 @@ void VaQuoleWebUI::InputKey(const TCHAR *Key,
 							const bool bPressed,
 							const VaQuole::KeyModifiers Modifiers)
 {
-	std::lock_guard<std::mutex> guard(mutex);
-
 	KeyEvent Event;
 	Event.bKeyPressed = bPressed;
 
@@ -466,7 +993,7 @@ void VaQuoleWebUI::InputKey(const TCHAR *Key,
 	if(Modifiers.bShiftDown) Event.modifiers |= Qt::ShiftModifier;
 
 	// Prepare key
-	QString KeyStr = QString::fromUtf16((const ushort*)Key);
+	QString KeyStr = FromTCHAR(Key);
 	Event.key = KeyMap.value(KeyStr, Qt::Key_unknown);
 	Event.text = KeyTextMap.value(KeyStr);
 
@@ -507,7 +1034,9 @@ void VaQuoleWebUI::InputKey(const TCHAR *Key,
 	}
 
 	Q_CHECK_PTR(ExtComm);
-	ExtComm->KeyEvents.append(Event);
+	ExtComm->Commands.PushKeyEvent(Event);
+
+	WakeUpManager();
 }
 
 } // namespace VaQuole
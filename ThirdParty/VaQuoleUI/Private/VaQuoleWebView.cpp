@@ -1,15 +1,39 @@
 // Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
 
 #include "VaQuoleWebView.h"
+#include "VaQuoleFrameExchange.h"
+#include "VaQuoleFramePool.h"
 #include "VaQuoleInputHelpers.h"
+#include "VaQuolePixelFormat.h"
+#include "VaQuoleTrace.h"
 
 #include <QWebFrame>
 #include <QPaintEvent>
 #include <QBackingStore>
+#include <QElapsedTimer>
+#include <QGuiApplication>
+#include <QWebHistory>
 
 namespace VaQuole
 {
 
+/** Pauses CSS animations and transitions of hibernated page */
+static const char* PauseAnimationsScript =
+	"(function() {"
+	"	if (!document.documentElement || document.getElementById('vaquole-hibernate')) return;"
+	"	var style = document.createElement('style');"
+	"	style.id = 'vaquole-hibernate';"
+	"	style.textContent = '*, *:before, *:after { -webkit-animation-play-state: paused !important; animation-play-state: paused !important;"
+	" -webkit-transition: none !important; transition: none !important; }';"
+	"	(document.head || document.documentElement).appendChild(style);"
+	"})();";
+
+static const char* ResumeAnimationsScript =
+	"(function() {"
+	"	var style = document.getElementById('vaquole-hibernate');"
+	"	if (style) style.parentNode.removeChild(style);"
+	"})();";
+
 VaQuoleWebView::VaQuoleWebView(QWidget *parent) :
 	QWebView(parent)
 {
@@ -17,15 +41,36 @@ VaQuoleWebView::VaQuoleWebView(QWidget *parent) :
 	ImageCache = QImage(32,32,QImage::Format_RGB32);
 
 	// Defaults
+	bTransparent = false;
 	bPageLoaded = false;
+	LoadGeneration = 0;
+	StartedLoadGeneration = 0;
+	ExternalBuffer = NULL;
+	bHibernated = false;
+	PaintTimeUs = 0;
+	TraceId = NULL;
+	OutputFormat = EPixelFormat::BGRA8;
+
+	FrameClock.start();
+
+	PostponedPaintTimer.setSingleShot(true);
+	PostponedPaintTimer.setTimerType(Qt::PreciseTimer);
+	connect(&PostponedPaintTimer, SIGNAL(timeout()), this, SLOT(paintPostponedRegion()));
 
 #ifndef VA_DEBUG
+#ifdef Q_OS_WIN
 	// Hide window in taskbar
 	setWindowFlags(Qt::SplashScreen);
+#else
+	// X11 window managers show splash screens centered and on top, so ask them to leave us alone
+	setWindowFlags(Qt::Tool | Qt::FramelessWindowHint | Qt::X11BypassWindowManagerHint | Qt::WindowDoesNotAcceptFocus);
+	setAttribute(Qt::WA_ShowWithoutActivating);
+#endif
 #endif
 
 	// Register us with JavaScript
 	connect(this, SIGNAL(loadFinished(bool)), this, SLOT(registerJavaScriptWindowObject(bool)));
+	connect(this, SIGNAL(loadStarted()), this, SLOT(markLoadStarted()));
 	connect(this, SIGNAL(loadFinished(bool)), this, SLOT(markLoadFinished(bool)));
 }
 
@@ -38,19 +83,44 @@ void VaQuoleWebView::updateImageCache(QSize ImageSize)
 
 	if(bTransparent)
 	{
-		ImageCache = QImage(ImageSize, QImage::Format_ARGB32);
+		// Memory is taken from frame pool, so resizes don't churn big allocations
+		const int Stride = ImageSize.width() * 4;
+		uchar* Bits = FrameBufferPool::Get().Allocate(Stride * ImageSize.height());
+
+		ImageCache = QImage(Bits, ImageSize.width(), ImageSize.height(), Stride, QImage::Format_ARGB32,
+			&FrameBufferPool::ReleaseImageData, Bits);
 		ImageCache.fill(Qt::transparent);
 	}
 	else
 	{
 		ImageCache = QImage();
 	}
+
+	// Buffer is recreated so the whole view should be grabbed again
+	DirtyRegion = QRegion(QRect(QPoint(0,0), ImageSize));
+}
+
+void VaQuoleWebView::markLoadStarted()
+{
+	StartedLoadGeneration = LoadGeneration;
 }
 
 void VaQuoleWebView::markLoadFinished(bool ok)
 {
+	// about:blank of recycled view or aborted previous URL can finish after the new URL was asked for
+	if (StartedLoadGeneration != LoadGeneration)
+	{
+		return;
+	}
+
 	// We just want to know is it finished or not, but not the result
 	bPageLoaded = true;
+
+	// New document should be paused too
+	if (bHibernated)
+	{
+		page()->mainFrame()->evaluateJavaScript(PauseAnimationsScript);
+	}
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -85,6 +155,7 @@ bool VaQuoleWebView::isLoadFinished() const
 void VaQuoleWebView::resetPageLoadState()
 {
 	bPageLoaded = false;
+	LoadGeneration++;
 }
 
 void VaQuoleWebView::resize(int w, int h)
@@ -95,8 +166,11 @@ void VaQuoleWebView::resize(int w, int h)
 	updateImageCache(QSize(w,h));
 
 #ifndef VA_DEBUG
-	// Place our black empty widget out of screen
-	move(-width(),-height());
+	// Place our black empty widget out of screen (there is no screen on offscreen platform)
+	if (QGuiApplication::platformName() != QLatin1String("offscreen"))
+	{
+		move(-width(),-height());
+	}
 #endif
 }
 
@@ -126,6 +200,154 @@ int VaQuoleWebView::getImageDataSize()
 	return backBuffer->byteCount();
 }
 
+int VaQuoleWebView::getImageStride()
+{
+	if (bTransparent)
+	{
+		return ImageCache.bytesPerLine();
+	}
+
+	QImage *backBuffer = dynamic_cast<QImage*>(backingStore()->paintDevice());
+	return backBuffer->bytesPerLine();
+}
+
+void VaQuoleWebView::getDirtyRegion(QRegion& Region, bool bClearRegion)
+{
+	Region = DirtyRegion;
+
+	if (bClearRegion)
+	{
+		DirtyRegion = QRegion();
+	}
+}
+
+void VaQuoleWebView::setExternalFramebuffer(ExternalFramebuffer* Framebuffer)
+{
+	ExternalBuffer = Framebuffer;
+	PendingExternalRegion = QRegion();
+
+	// New buffer should be painted completely
+	if (ExternalBuffer)
+	{
+		update();
+	}
+}
+
+void VaQuoleWebView::setOutputFormat(EPixelFormat::Type Format)
+{
+	if (OutputFormat == Format)
+	{
+		return;
+	}
+
+	OutputFormat = Format;
+
+	// External framebuffer has pixels of the old format
+	if (ExternalBuffer)
+	{
+		update();
+	}
+}
+
+bool VaQuoleWebView::hasExternalFramebuffer() const
+{
+	return ExternalBuffer != NULL;
+}
+
+void VaQuoleWebView::flushPendingExternalPaint()
+{
+	if (ExternalBuffer == NULL || PendingExternalRegion.isEmpty())
+	{
+		return;
+	}
+
+	// Wait for host to unlock the buffer
+	if (ExternalBuffer->State.load(std::memory_order_acquire) == EFramebufferState::Idle)
+	{
+		update(PendingExternalRegion);
+	}
+}
+
+void VaQuoleWebView::setTargetFrameRate(int FrameRate)
+{
+	// Don't keep postponed paint for the old frame time
+	if (Pacer.SetTargetFrameRate(FrameRate))
+	{
+		paintPostponedRegion();
+	}
+}
+
+const FramePacingStats& VaQuoleWebView::getFramePacingStats() const
+{
+	return Pacer.GetStats();
+}
+
+void VaQuoleWebView::setHibernated(bool bHibernate)
+{
+	if (bHibernated == bHibernate)
+	{
+		return;
+	}
+
+	bHibernated = bHibernate;
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 5, 0)
+	// WebKit throttles timers and stops animation frames of hidden pages itself
+	page()->setVisibilityState(bHibernated ? QWebPage::VisibilityStateHidden : QWebPage::VisibilityStateVisible);
+#endif
+	page()->mainFrame()->evaluateJavaScript(bHibernated ? PauseAnimationsScript : ResumeAnimationsScript);
+
+	setUpdatesEnabled(!bHibernated);
+
+	// Frame paced paint would be lost anyway
+	if (bHibernated)
+	{
+		PostponedPaintTimer.stop();
+		PostponedRegion = QRegion();
+	}
+
+	// Suppressed repaints are lost, so the whole page is painted on resume
+	if (!bHibernated)
+	{
+		update();
+	}
+}
+
+bool VaQuoleWebView::isHibernated() const
+{
+	return bHibernated;
+}
+
+void VaQuoleWebView::setTraceId(const void* Id)
+{
+	TraceId = Id;
+}
+
+void VaQuoleWebView::resetForReuse()
+{
+	TraceId = NULL;
+	stop();
+	setHibernated(false);
+	setTargetFrameRate(0);
+	setExternalFramebuffer(NULL);
+	setOutputFormat(EPixelFormat::BGRA8);
+
+	if (bTransparent)
+	{
+		setTransparent(false);
+	}
+
+	setUrl(QUrl("about:blank"));
+	page()->history()->clear();
+
+	resetPageLoadState();
+	DirtyRegion = QRegion();
+	PaintTimeUs = 0;
+	CachedScriptEvents.clear();
+
+	Pacer.Reset();
+}
+
 void VaQuoleWebView::getCachedEvents(QList< QPair<QString, QString> >& Events, bool bClearCache)
 {
 	Events = CachedScriptEvents;
@@ -142,37 +364,134 @@ void VaQuoleWebView::getCachedEvents(QList< QPair<QString, QString> >& Events, b
 
 void VaQuoleWebView::paintEvent(QPaintEvent *ev)
 {
-	QWebPage *page = this->page();
-	if (!page)
+	if (!page())
 	{
 		return;
 	}
 
-	QWebFrame *frame = page->mainFrame();
-	QPainter p;
+	// Repaints are merged until the next frame time, so the page isn't rendered more often than necessary
+	const QRegion PaintRegion = ev->region();
+	qint64 WaitUs = 0;
+	if (!Pacer.BeginFrame(FrameClock.nsecsElapsed() / 1000, WaitUs))
+	{
+		PostponedRegion += PaintRegion;
 
-	if (bTransparent)
+		if (!PostponedPaintTimer.isActive())
+		{
+			PostponedPaintTimer.start((int)((WaitUs + 999) / 1000));
+		}
+
+		return;
+	}
+
+	// Postponed parts are repainted by timer, painter of the widget is clipped to event region anyway
+	PostponedRegion -= PaintRegion;
+	if (PostponedRegion.isEmpty())
 	{
-		p.begin(&ImageCache);
+		PostponedPaintTimer.stop();
+	}
+
+	TraceScope PaintTrace("Paint", TraceId);
+
+	QElapsedTimer PaintTimer;
+	PaintTimer.start();
+
+	// Zero-copy mode
+	if (ExternalBuffer)
+	{
+		paintExternal(PaintRegion);
 	}
 	else
 	{
-		p.begin(this);
+		QPainter p;
+
+		if (bTransparent)
+		{
+			p.begin(&ImageCache);
+		}
+		else
+		{
+			p.begin(this);
+		}
+
+		renderRegion(p, PaintRegion);
+		p.end();
+
+		// Remember what was changed to copy only these parts
+		DirtyRegion += PaintRegion;
+	}
+
+	PaintTimeUs += PaintTimer.nsecsElapsed() / 1000;
+}
+
+void VaQuoleWebView::paintPostponedRegion()
+{
+	if (!PostponedRegion.isEmpty())
+	{
+		update(PostponedRegion);
+		PostponedRegion = QRegion();
 	}
+}
+
+qint64 VaQuoleWebView::takePaintTime()
+{
+	qint64 Result = PaintTimeUs;
+	PaintTimeUs = 0;
+
+	return Result;
+}
+
+void VaQuoleWebView::paintExternal(const QRegion& Region)
+{
+	// Qt can't paint compressed formats
+	const QImage::Format TargetFormat = GetQtImageFormat(OutputFormat, !bTransparent);
+	if (TargetFormat == QImage::Format_Invalid)
+	{
+		return;
+	}
+
+	// Host is reading the buffer now, so we'll paint it later
+	if (!ExternalBuffer->TryAcquire(EFramebufferState::Painting))
+	{
+		PendingExternalRegion += Region;
+		return;
+	}
+
+	// Qt paints in desired format itself, so no conversion is necessary
+	QImage Target((uchar*)ExternalBuffer->Bits, ExternalBuffer->Width, ExternalBuffer->Height, ExternalBuffer->Stride, TargetFormat);
+
+	QRegion PaintRegion = Region.united(PendingExternalRegion).intersected(Target.rect());
+	PendingExternalRegion = QRegion();
+
+	QPainter p;
+	p.begin(&Target);
+	renderRegion(p, PaintRegion);
+	p.end();
+
+	ExternalBuffer->Release(EFramebufferState::Painting);
+
+	DirtyRegion += PaintRegion;
+}
+
+void VaQuoleWebView::renderRegion(QPainter& p, const QRegion& Region)
+{
+	QWebFrame *frame = page()->mainFrame();
 
 	p.setRenderHints(renderHints());
 
 	if(bTransparent)
 	{
-		// Clear background of current rect
+		// Clear background of repainted rects only, the rest of their bounding rect keeps its pixels
 		p.setBackgroundMode(Qt::TransparentMode);
 		p.setCompositionMode (QPainter::CompositionMode_Source);
-		p.fillRect(ev->rect(), Qt::transparent);
+		foreach (const QRect& Rect, Region.rects())
+		{
+			p.fillRect(Rect, Qt::transparent);
+		}
 		p.setCompositionMode (QPainter::CompositionMode_SourceOver);
 	}
 
-	frame->render(&p, ev->region());
-	p.end();
+	frame->render(&p, Region);
 }
 
 
@@ -4,14 +4,21 @@
 #define VAQUOLEWEBVIEW_H
 
 #include "../Include/VaQuolePublicPCH.h"
+#include "VaQuoleFramePacing.h"
 
+#include <QElapsedTimer>
+#include <QRegion>
+#include <QTimer>
 #include <QWebView>
 
 class QImage;
+class QPainter;
 
 namespace VaQuole
 {
 
+struct ExternalFramebuffer;
+
 class VaQuoleWebView : public QWebView
 {
 	Q_OBJECT
@@ -40,6 +47,45 @@ public:
 	/** Cached image data size to make a memcopy */
 	int getImageDataSize();
 
+	/** Number of bytes per one image line */
+	int getImageStride();
+
+	/** Get region painted since the last call and optionally clear it */
+	void getDirtyRegion(QRegion& Region, bool bClearRegion = true);
+
+	/** Paint directly into host memory instead of own buffers (NULL to disable) */
+	void setExternalFramebuffer(ExternalFramebuffer* Framebuffer);
+
+	/** Pixel format of external framebuffer */
+	void setOutputFormat(EPixelFormat::Type Format);
+
+	/** Is view painted into host memory? */
+	bool hasExternalFramebuffer() const;
+
+	/** Repaint regions skipped while host was reading external framebuffer */
+	void flushPendingExternalPaint();
+
+	/** Get time spent on painting since the last call (microseconds) and reset it */
+	qint64 takePaintTime();
+
+	/** Limit frame rate: repaints are merged until the next frame time (0 to paint at once) */
+	void setTargetFrameRate(int FrameRate);
+
+	/** Painted frames and their timing */
+	const FramePacingStats& getFramePacingStats() const;
+
+	/** Suspend page: it's hidden for scripts, animations are paused and nothing is painted */
+	void setHibernated(bool bHibernate);
+
+	/** Is page suspended now? */
+	bool isHibernated() const;
+
+	/** Bring view to its initial state with blank page, so it can be used by another page */
+	void resetForReuse();
+
+	/** Set id of the page view belongs to, its paints are marked with it in trace */
+	void setTraceId(const void* Id);
+
 	/** Get cached events from JavaScript and optionally clear cache */
 	void getCachedEvents(QList< QPair<QString, QString> >& Events, bool bClearCache = true);
 
@@ -48,6 +94,12 @@ private:
 	/** Recreates image cache buffer */
 	void updateImageCache(QSize ImageSize = QSize());
 
+	/** Render page region with painter that is already started */
+	void renderRegion(QPainter& p, const QRegion& Region);
+
+	/** Render page region into external framebuffer */
+	void paintExternal(const QRegion& Region);
+
 	/** Rendered widget buffer */
 	QImage ImageCache;
 
@@ -57,6 +109,39 @@ private:
 	/** Is last desired page loaded or nor */
 	bool bPageLoaded;
 
+	/** Incremented when page is reset for new URL, so late signals of older loads are ignored */
+	quint32 LoadGeneration;
+	quint32 StartedLoadGeneration;
+
+	/** Region painted but not grabbed yet */
+	QRegion DirtyRegion;
+
+	/** Host memory to paint into */
+	ExternalFramebuffer* ExternalBuffer;
+
+	/** Region that wasn't painted into external framebuffer because host was reading it */
+	QRegion PendingExternalRegion;
+
+	/** Is page suspended */
+	bool bHibernated;
+
+	/** Pixel format of external framebuffer */
+	EPixelFormat::Type OutputFormat;
+
+	/** Time spent on painting since the last take */
+	qint64 PaintTimeUs;
+
+	/** Page id for trace events */
+	const void* TraceId;
+
+	/** Frame pacing and its clock */
+	FramePacer Pacer;
+	QElapsedTimer FrameClock;
+
+	/** Region that waits for the next frame time */
+	QRegion PostponedRegion;
+	QTimer PostponedPaintTimer;
+
 	/** Events received from JavaScript */
 	QList< QPair<QString, QString> > CachedScriptEvents;		// Event, Message
 
@@ -65,9 +150,15 @@ protected:
 	void paintEvent(QPaintEvent*);
 
 private slots:
+	/** Repaint region postponed by frame pacing */
+	void paintPostponedRegion();
+
 	/** Puts reference to this class object into JS code */
 	void registerJavaScriptWindowObject(bool pageLoaded);
 
+	/** Remembers the URL generation the load belongs to */
+	void markLoadStarted();
+
 	/** Marks page as loaded for engine */
 	void markLoadFinished(bool ok);
 
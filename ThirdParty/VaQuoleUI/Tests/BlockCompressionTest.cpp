@@ -0,0 +1,294 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#include "VaQuoleUITests.h"
+#include "VaQuolePixelFormat.h"
+
+#include <QObject>
+#include <QRegion>
+#include <QSize>
+#include <QVector>
+#include <QtTest>
+
+using namespace VaQuole;
+
+/** Image sizes to encode, most of them aren't multiples of 4 to get edge blocks */
+static const int TestSizes[][2] = { { 1, 1 }, { 3, 2 }, { 5, 7 }, { 16, 16 }, { 37, 23 }, { 64, 61 } };
+
+/** The largest channel difference allowed between source and decoded pixels */
+static const int MaxColorError = 12;
+
+/** Half of 8-value palette step when block has both 0 and 255 alpha, high quality switches to 6-value mode then */
+static const int MaxAlphaError = 19;
+static const int MaxHighQualityAlphaError = 4;
+
+/**
+ * Pixel of decoded block
+ */
+struct DecodedPixel
+{
+	int R;
+	int G;
+	int B;
+	int A;
+};
+
+/** Reference BC1 color block decoder, BC3 color blocks are always decoded in 4-color mode */
+static void DecodeColorBlock(const uchar* Block, bool bForceFourColors, DecodedPixel* Pixels)
+{
+	const int Color0 = Block[0] | (Block[1] << 8);
+	const int Color1 = Block[2] | (Block[3] << 8);
+
+	DecodedPixel Palette[4];
+	const int Packed[2] = { Color0, Color1 };
+	for (int i = 0; i < 2; i++)
+	{
+		const int R = (Packed[i] >> 11) & 31;
+		const int G = (Packed[i] >> 5) & 63;
+		const int B = Packed[i] & 31;
+
+		Palette[i].R = (R << 3) | (R >> 2);
+		Palette[i].G = (G << 2) | (G >> 4);
+		Palette[i].B = (B << 3) | (B >> 2);
+		Palette[i].A = 255;
+	}
+
+	if (Color0 > Color1 || bForceFourColors)
+	{
+		Palette[2].R = (2 * Palette[0].R + Palette[1].R) / 3;
+		Palette[2].G = (2 * Palette[0].G + Palette[1].G) / 3;
+		Palette[2].B = (2 * Palette[0].B + Palette[1].B) / 3;
+		Palette[2].A = 255;
+
+		Palette[3].R = (Palette[0].R + 2 * Palette[1].R) / 3;
+		Palette[3].G = (Palette[0].G + 2 * Palette[1].G) / 3;
+		Palette[3].B = (Palette[0].B + 2 * Palette[1].B) / 3;
+		Palette[3].A = 255;
+	}
+	else
+	{
+		Palette[2].R = (Palette[0].R + Palette[1].R) / 2;
+		Palette[2].G = (Palette[0].G + Palette[1].G) / 2;
+		Palette[2].B = (Palette[0].B + Palette[1].B) / 2;
+		Palette[2].A = 255;
+
+		// Transparent black
+		Palette[3].R = 0;
+		Palette[3].G = 0;
+		Palette[3].B = 0;
+		Palette[3].A = 0;
+	}
+
+	const quint32 Indices = Block[4] | (Block[5] << 8) | (Block[6] << 16) | ((quint32)Block[7] << 24);
+	for (int i = 0; i < 16; i++)
+	{
+		Pixels[i] = Palette[(Indices >> (i * 2)) & 3];
+	}
+}
+
+/** Reference BC3 alpha block decoder */
+static void DecodeAlphaBlock(const uchar* Block, DecodedPixel* Pixels)
+{
+	int Palette[8];
+	Palette[0] = Block[0];
+	Palette[1] = Block[1];
+
+	if (Palette[0] > Palette[1])
+	{
+		for (int i = 1; i <= 6; i++)
+		{
+			Palette[i + 1] = ((7 - i) * Palette[0] + i * Palette[1]) / 7;
+		}
+	}
+	else
+	{
+		for (int i = 1; i <= 4; i++)
+		{
+			Palette[i + 1] = ((5 - i) * Palette[0] + i * Palette[1]) / 5;
+		}
+
+		Palette[6] = 0;
+		Palette[7] = 255;
+	}
+
+	quint64 Indices = 0;
+	for (int i = 0; i < 6; i++)
+	{
+		Indices |= (quint64)Block[2 + i] << (i * 8);
+	}
+
+	for (int i = 0; i < 16; i++)
+	{
+		Pixels[i].A = Palette[(Indices >> (i * 3)) & 7];
+	}
+}
+
+/**
+ * Qt ARGB32 image (BGRA bytes) up to 64x64: color gradients, alpha ramp in the top half and hard edged circle
+ * in the bottom one. Slopes don't depend on image size, so the same error bound fits all of them
+ */
+static QVector<uchar> MakeTestImage(int Width, int Height)
+{
+	QVector<uchar> Bits(Width * Height * 4);
+
+	for (int y = 0; y < Height; y++)
+	{
+		for (int x = 0; x < Width; x++)
+		{
+			uchar* Pixel = Bits.data() + (y * Width + x) * 4;
+
+			Pixel[0] = (uchar)(x * 4);
+			Pixel[1] = (uchar)(y * 4);
+			Pixel[2] = (uchar)(255 - (x + y) * 2);
+
+			if (y < Height / 2)
+			{
+				Pixel[3] = (uchar)(x * 4);
+			}
+			else
+			{
+				const int DX = x - Width / 2;
+				const int DY = y - Height * 3 / 4;
+				Pixel[3] = (DX * DX + DY * DY * 4 <= Width * Width / 9) ? 255 : 0;
+			}
+		}
+	}
+
+	return Bits;
+}
+
+/**
+ * Encodes test images and checks them with reference decoder
+ */
+class BlockCompressionTest : public QObject
+{
+	Q_OBJECT
+
+private:
+	/** Encode image, decode it back and return the largest channel errors */
+	static void EncodeAndCompare(EPixelFormat::Type PixelFormat, ECompressionQuality::Type Quality, int Width, int Height,
+		int& ColorError, int& AlphaError)
+	{
+		const QVector<uchar> Src = MakeTestImage(Width, Height);
+
+		// BC1 is used for opaque pages only
+		const bool bOpaque = (PixelFormat == EPixelFormat::BC1);
+		const FrameFormat Format(PixelFormat, bOpaque, Quality);
+
+		const int DstStride = GetFormatStride(PixelFormat, Width);
+		QVector<uchar> Dst(DstStride * GetFormatLines(PixelFormat, Height));
+		ConvertRegion(Dst.data(), DstStride, Src.constData(), Width * 4, QSize(Width, Height), QRegion(0, 0, Width, Height), Format);
+
+		const int BlockBytes = GetPixelFormatBlockBytes(PixelFormat);
+
+		ColorError = 0;
+		AlphaError = 0;
+
+		for (int BlockY = 0; BlockY < GetFormatLines(PixelFormat, Height); BlockY++)
+		{
+			for (int BlockX = 0; BlockX < (Width + 3) / 4; BlockX++)
+			{
+				const uchar* Block = Dst.constData() + BlockY * DstStride + BlockX * BlockBytes;
+
+				DecodedPixel Pixels[16];
+				if (PixelFormat == EPixelFormat::BC1)
+				{
+					DecodeColorBlock(Block, false, Pixels);
+				}
+				else
+				{
+					DecodeColorBlock(Block + 8, true, Pixels);
+					DecodeAlphaBlock(Block, Pixels);
+				}
+
+				// Pixels of edge blocks outside the image are padding
+				for (int i = 0; i < 16; i++)
+				{
+					const int x = BlockX * 4 + i % 4;
+					const int y = BlockY * 4 + i / 4;
+					if (x >= Width || y >= Height)
+					{
+						continue;
+					}
+
+					const uchar* Source = Src.constData() + (y * Width + x) * 4;
+					ColorError = qMax(ColorError, qAbs(Pixels[i].B - Source[0]));
+					ColorError = qMax(ColorError, qAbs(Pixels[i].G - Source[1]));
+					ColorError = qMax(ColorError, qAbs(Pixels[i].R - Source[2]));
+					AlphaError = qMax(AlphaError, qAbs(Pixels[i].A - (bOpaque ? 255 : Source[3])));
+				}
+			}
+		}
+	}
+
+	static void CheckFormat(EPixelFormat::Type PixelFormat)
+	{
+		const ECompressionQuality::Type Qualities[] = { ECompressionQuality::Fast, ECompressionQuality::Normal, ECompressionQuality::High };
+
+		for (int q = 0; q < 3; q++)
+		{
+			for (int s = 0; s < (int)(sizeof(TestSizes) / sizeof(TestSizes[0])); s++)
+			{
+				int ColorError = 0;
+				int AlphaError = 0;
+				EncodeAndCompare(PixelFormat, Qualities[q], TestSizes[s][0], TestSizes[s][1], ColorError, AlphaError);
+
+				const QByteArray Case = QString("quality %1, %2x%3, color error %4, alpha error %5").arg(q)
+					.arg(TestSizes[s][0]).arg(TestSizes[s][1]).arg(ColorError).arg(AlphaError).toLatin1();
+				QVERIFY2(ColorError <= MaxColorError, Case.constData());
+				QVERIFY2(AlphaError <= ((Qualities[q] == ECompressionQuality::High) ? MaxHighQualityAlphaError : MaxAlphaError), Case.constData());
+			}
+		}
+	}
+
+private slots:
+	void encodeBC1()
+	{
+		CheckFormat(EPixelFormat::BC1);
+	}
+
+	void encodeBC3()
+	{
+		CheckFormat(EPixelFormat::BC3);
+	}
+
+	void flatBlockIsExact()
+	{
+		// Flat colors representable in 565 and any alpha are encoded without loss
+		QVector<uchar> Src(6 * 5 * 4);
+		for (int i = 0; i < 6 * 5; i++)
+		{
+			Src[i * 4 + 0] = 0x42;
+			Src[i * 4 + 1] = 0x82;
+			Src[i * 4 + 2] = 0xCE;
+			Src[i * 4 + 3] = 0x37;
+		}
+
+		const int DstStride = GetFormatStride(EPixelFormat::BC3, 6);
+		QVector<uchar> Dst(DstStride * GetFormatLines(EPixelFormat::BC3, 5));
+		ConvertRegion(Dst.data(), DstStride, Src.constData(), 6 * 4, QSize(6, 5), QRegion(0, 0, 6, 5),
+			FrameFormat(EPixelFormat::BC3, false, ECompressionQuality::Normal));
+
+		for (int Block = 0; Block < Dst.size() / 16; Block++)
+		{
+			DecodedPixel Pixels[16];
+			DecodeColorBlock(Dst.constData() + Block * 16 + 8, true, Pixels);
+			DecodeAlphaBlock(Dst.constData() + Block * 16, Pixels);
+
+			for (int i = 0; i < 16; i++)
+			{
+				QCOMPARE(Pixels[i].B, 0x42);
+				QCOMPARE(Pixels[i].G, 0x82);
+				QCOMPARE(Pixels[i].R, 0xCE);
+				QCOMPARE(Pixels[i].A, 0x37);
+			}
+		}
+	}
+};
+
+int RunBlockCompressionTest(int argc, char** argv)
+{
+	BlockCompressionTest Test;
+	return QTest::qExec(&Test, argc, argv);
+}
+
+#include "BlockCompressionTest.moc"
@@ -0,0 +1,328 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#include "VaQuoleUITests.h"
+#include "VaQuoleAppThread.h"
+#include "VaQuoleCommandQueue.h"
+#include "VaQuoleStringHelpers.h"
+#include "../Include/VaQuoleUILib.h"
+
+#include <QByteArray>
+#include <QChar>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QtTest>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace VaQuole;
+
+/** Script of desired length that starts with its id, so its content can be checked */
+static QString MakeScript(const QString& Id, int Length)
+{
+	return (Id + QString(":")).leftJustified(Length, QChar('x'));
+}
+
+/**
+ * Checks the command queue with one and many producers
+ */
+class CommandQueueTest : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void commandsKeepOrderAndContent()
+	{
+		CommandQueue Queue;
+
+		MouseEvent Mouse;
+		Mouse.eventPos = QPoint(12, 34);
+		Mouse.button = Qt::LeftButton;
+		Mouse.bButtonPressed = true;
+
+		KeyEvent Key;
+		Key.key = Qt::Key_A;
+		Key.text = QString("a");
+		Key.bKeyPressed = true;
+
+		QStringList BatchScripts;
+		BatchScripts.append(QString("1 + 1"));
+		BatchScripts.append(QString("document.title"));
+
+		QVERIFY(Queue.PushURL(QString("http://first/")));
+		QVERIFY(Queue.PushMouseEvent(Mouse));
+		QVERIFY(Queue.PushKeyEvent(Key));
+		QVERIFY(Queue.PushScript(QString("uuid"), QString("alert(1)")));
+		QVERIFY(Queue.PushScriptBatch(7, BatchScripts));
+		QVERIFY(Queue.PushURL(QString("http://second/")));
+
+		PageCommands Commands;
+		Queue.Drain(Commands);
+
+		// Only the last URL matters
+		QVERIFY(Commands.NewURL == QString("http://second/"));
+
+		QCOMPARE(Commands.MouseEvents.size(), 1);
+		QCOMPARE(Commands.MouseEvents[0].eventPos.x(), 12);
+		QCOMPARE(Commands.MouseEvents[0].eventPos.y(), 34);
+		QVERIFY(Commands.MouseEvents[0].button == Qt::LeftButton);
+		QVERIFY(Commands.MouseEvents[0].bButtonPressed);
+		QCOMPARE(Commands.MouseEvents[0].InputId, (quint32)1);
+
+		QCOMPARE(Commands.KeyEvents.size(), 1);
+		QVERIFY(Commands.KeyEvents[0].key == Qt::Key_A);
+		QVERIFY(Commands.KeyEvents[0].text == QString("a"));
+		QCOMPARE(Commands.KeyEvents[0].InputId, (quint32)2);
+
+		QCOMPARE(Commands.ScriptCommands.size(), 1);
+		QVERIFY(Commands.ScriptCommands[0].first == QString("uuid"));
+		QVERIFY(Commands.ScriptCommands[0].second == QString("alert(1)"));
+
+		QCOMPARE(Commands.ScriptBatches.size(), 1);
+		QCOMPARE(Commands.ScriptBatches[0].FirstCallId, (quint32)7);
+		QCOMPARE(Commands.ScriptBatches[0].ScriptCommandsBefore, 1);
+		QVERIFY(Commands.ScriptBatches[0].Scripts == BatchScripts);
+
+		PageCommands Empty;
+		Queue.Drain(Empty);
+		QVERIFY(Empty.IsEmpty());
+	}
+
+	void fullQueueDropsCommands()
+	{
+		CommandQueue Queue;
+
+		int Pushed = 0;
+		for (quint32 i = 0; i < CommandQueue::Capacity + 5; i++)
+		{
+			MouseEvent Mouse;
+			Mouse.eventPos = QPoint((int)i, 0);
+			Pushed += Queue.PushMouseEvent(Mouse) ? 1 : 0;
+		}
+
+		QCOMPARE(Pushed, (int)CommandQueue::Capacity);
+		QCOMPARE(Queue.GetStats().Depth, (unsigned int)CommandQueue::Capacity);
+		QCOMPARE(Queue.GetStats().Dropped, 5ULL);
+
+		// The oldest commands are kept
+		PageCommands Commands;
+		Queue.Drain(Commands);
+		QCOMPARE(Commands.MouseEvents.size(), (int)CommandQueue::Capacity);
+		QCOMPARE(Commands.MouseEvents.last().eventPos.x(), (int)CommandQueue::Capacity - 1);
+
+		// Drained queue accepts commands again
+		QVERIFY(Queue.PushURL(QString("http://again/")));
+		QCOMPARE(Queue.GetStats().Depth, 1U);
+	}
+
+	void bigPayloadGoesToHeap()
+	{
+		CommandQueue Queue;
+
+		const QString Script = MakeScript(QString("big"), CommandQueue::ArenaSize);
+		QVERIFY(Queue.PushScript(QString("uuid"), Script));
+		QCOMPARE(Queue.GetStats().HeapPayloads, 1ULL);
+
+		PageCommands Commands;
+		Queue.Drain(Commands);
+		QCOMPARE(Commands.ScriptCommands.size(), 1);
+		QVERIFY(Commands.ScriptCommands[0].second == Script);
+	}
+
+	void arenasAreRecycled()
+	{
+		// Each round fills most of one arena, so arenas are switched and reset all the time
+		CommandQueue Queue;
+
+		for (int Round = 0; Round < 50; Round++)
+		{
+			for (int i = 0; i < 40; i++)
+			{
+				const QString Id = QString("%1-%2").arg(Round).arg(i);
+				QVERIFY(Queue.PushScript(Id, MakeScript(Id, 700)));
+			}
+
+			PageCommands Commands;
+			Queue.Drain(Commands);
+
+			QCOMPARE(Commands.ScriptCommands.size(), 40);
+			for (int i = 0; i < 40; i++)
+			{
+				const QString Id = QString("%1-%2").arg(Round).arg(i);
+				QVERIFY(Commands.ScriptCommands[i].first == Id);
+				QVERIFY(Commands.ScriptCommands[i].second == MakeScript(Id, 700));
+			}
+		}
+
+		QCOMPARE(Queue.GetStats().HeapPayloads, 0ULL);
+		QCOMPARE(Queue.GetStats().Dropped, 0ULL);
+	}
+
+	void manyProducers()
+	{
+		// Producers push while consumer drains, each producer's commands should come in its order
+		static const int ProducersNum = 4;
+		static const int CommandsNum = 20000;
+
+		CommandQueue Queue;
+		std::atomic<int> ProducersDone(0);
+		std::atomic<int> Accepted(0);
+
+		std::vector<std::thread> Producers;
+		for (int p = 0; p < ProducersNum; p++)
+		{
+			Producers.push_back(std::thread([&Queue, &ProducersDone, &Accepted, p]()
+			{
+				for (int i = 0; i < CommandsNum; i++)
+				{
+					// Scripts go to arenas, every 100th one to heap
+					const QString Id = QString("%1:%2").arg(p).arg(i);
+					if (Queue.PushScript(Id, MakeScript(Id, (i % 100 == 0) ? CommandQueue::ArenaSize / 2 : 16)))
+					{
+						Accepted++;
+					}
+
+					if (i % 64 == 0)
+					{
+						std::this_thread::yield();
+					}
+				}
+
+				ProducersDone++;
+			}));
+		}
+
+		QVector<int> LastCommands(ProducersNum, -1);
+		int Received = 0;
+		int Broken = 0;
+
+		for (;;)
+		{
+			const bool bLastDrain = (ProducersDone.load() == ProducersNum);
+
+			PageCommands Commands;
+			Queue.Drain(Commands);
+
+			typedef QPair<QString, QString> ScriptPair;
+			foreach (const ScriptPair& Script, Commands.ScriptCommands)
+			{
+				const int Producer = Script.first.section(':', 0, 0).toInt();
+				const int Command = Script.first.section(':', 1, 1).toInt();
+
+				if (Command <= LastCommands[Producer] || !Script.second.startsWith(Script.first + QString(":")))
+				{
+					Broken++;
+				}
+
+				LastCommands[Producer] = Command;
+				Received++;
+			}
+
+			if (bLastDrain)
+			{
+				break;
+			}
+
+			std::this_thread::yield();
+		}
+
+		for (int p = 0; p < ProducersNum; p++)
+		{
+			Producers[p].join();
+		}
+
+		const CommandQueueStats Stats = Queue.GetStats();
+
+		QCOMPARE(Broken, 0);
+		QCOMPARE(Received, Accepted.load());
+		QCOMPARE((quint64)Received + Stats.Dropped, (quint64)ProducersNum * CommandsNum);
+		QCOMPARE(Stats.Depth, 0U);
+	}
+
+	void droppedMouseMoveIsResent()
+	{
+		// Page isn't registered, so its commands stay in the queue
+		VaQuoleWebUI* Page = new VaQuoleWebUI();
+		CommandQueue& Queue = Page->GetData()->Commands;
+
+		for (quint32 i = 0; i < CommandQueue::Capacity; i++)
+		{
+			QVERIFY(Queue.PushURL(QString("http://fill/")));
+		}
+
+		// Cursor moves while queue is full, so the move is dropped
+		Page->InputMouse(5, 5);
+		QCOMPARE(Queue.GetStats().Dropped, 1ULL);
+
+		PageCommands Commands;
+		Queue.Drain(Commands);
+		QVERIFY(Commands.MouseEvents.isEmpty());
+
+		// The same position is sent again, and it's skipped only after it was queued
+		Page->InputMouse(5, 5);
+		Page->InputMouse(5, 5);
+
+		Queue.Drain(Commands);
+		QCOMPARE(Commands.MouseEvents.size(), 1);
+		QCOMPARE(Commands.MouseEvents[0].eventPos.x(), 5);
+
+		delete Page->GetData();
+		delete Page;
+	}
+
+	void scriptUuidsArentShared()
+	{
+		// Each thread should get uuid of its own script
+		static const int ThreadsNum = 4;
+		static const int ScriptsNum = 100;
+
+		VaQuoleWebUI* Page = new VaQuoleWebUI();
+		QVector<QStringList> ThreadUuids(ThreadsNum);
+
+		std::vector<std::thread> Threads;
+		for (int t = 0; t < ThreadsNum; t++)
+		{
+			Threads.push_back(std::thread([Page, &ThreadUuids, t]()
+			{
+				for (int i = 0; i < ScriptsNum; i++)
+				{
+					TCHAR Uuid[VaQuoleWebUI::ScriptUuidLength];
+					const QString Script = QString("%1:%2").arg(t).arg(i);
+					Page->EvaluateJavaScript(ToTCHAR(Script).c_str(), Uuid);
+					ThreadUuids[t].append(FromTCHAR(Uuid));
+				}
+			}));
+		}
+
+		for (int t = 0; t < ThreadsNum; t++)
+		{
+			Threads[t].join();
+		}
+
+		PageCommands Commands;
+		Page->GetData()->Commands.Drain(Commands);
+		QCOMPARE(Commands.ScriptCommands.size(), ThreadsNum * ScriptsNum);
+
+		typedef QPair<QString, QString> ScriptPair;
+		foreach (const ScriptPair& Script, Commands.ScriptCommands)
+		{
+			const int Thread = Script.second.section(':', 0, 0).toInt();
+			const int Index = Script.second.section(':', 1, 1).toInt();
+			QVERIFY(ThreadUuids[Thread][Index] == Script.first);
+		}
+
+		delete Page->GetData();
+		delete Page;
+	}
+};
+
+int RunCommandQueueTest(int argc, char** argv)
+{
+	CommandQueueTest Test;
+	return QTest::qExec(&Test, argc, argv);
+}
+
+#include "CommandQueueTest.moc"
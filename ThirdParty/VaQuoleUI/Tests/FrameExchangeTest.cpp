@@ -0,0 +1,148 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#include "VaQuoleUITests.h"
+#include "VaQuoleFrameExchange.h"
+
+#include <QByteArray>
+#include <QObject>
+#include <QRect>
+#include <QRegion>
+#include <QString>
+#include <QVector>
+#include <QtTest>
+
+#include <string.h>
+
+using namespace VaQuole;
+
+static const int ImageWidth = 32;
+static const int ImageHeight = 24;
+static const int ImageStride = ImageWidth * 4;
+
+/**
+ * View image painted by test, each pixel keeps the number of the frame that painted it last
+ */
+struct TestImage
+{
+	QVector<uchar> Bits;
+
+	TestImage()
+		: Bits(ImageStride * ImageHeight, 0)
+	{
+	}
+
+	void Paint(const QRect& Rect, uchar FrameNum)
+	{
+		for (int y = Rect.top(); y <= Rect.bottom(); y++)
+		{
+			memset(Bits.data() + y * ImageStride + Rect.left() * 4, FrameNum, Rect.width() * 4);
+		}
+	}
+
+	qint64 Publish(FrameExchange& Frames, const QRegion& Region) const
+	{
+		return Frames.PublishFrame(Bits.constData(), Bits.size(), ImageStride, Region);
+	}
+
+	/** Is slot the same as image? */
+	bool Matches(const FrameSlot& Slot) const
+	{
+		return Slot.Bits != NULL && Slot.Width == ImageWidth && Slot.Height == ImageHeight && Slot.Stride == ImageStride &&
+			memcmp(Slot.Bits, Bits.constData(), Bits.size()) == 0;
+	}
+};
+
+/**
+ * Checks that reader of the triple buffer always gets complete frames and their changes
+ */
+class FrameExchangeTest : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void firstFrameIsComplete()
+	{
+		FrameExchange Frames;
+		TestImage Image;
+		const QRect ImageRect(0, 0, ImageWidth, ImageHeight);
+
+		// Nothing is published yet
+		QVERIFY(Frames.AcquireFrame().Bits == NULL);
+
+		Image.Paint(ImageRect, 1);
+		QCOMPARE(Image.Publish(Frames, QRegion(ImageRect)), (qint64)Image.Bits.size());
+		QCOMPARE(Frames.GetPublishedSerial(), 1U);
+
+		const FrameSlot& Slot = Frames.AcquireFrame();
+		QVERIFY(Image.Matches(Slot));
+		QCOMPARE(Slot.Serial, 1U);
+		QVERIFY(Frames.TakeDirtyRegion() == QRegion(ImageRect));
+
+		// The same frame is kept until new one is published
+		QVERIFY(&Frames.AcquireFrame() == &Slot);
+		QVERIFY(Frames.TakeDirtyRegion().isEmpty());
+	}
+
+	void emptyRegionPublishesNothing()
+	{
+		FrameExchange Frames;
+		TestImage Image;
+
+		// Writer alternates between two slots while reader doesn't take frames, so fill them both
+		Image.Paint(QRect(0, 0, ImageWidth, ImageHeight), 1);
+		Image.Publish(Frames, QRegion(0, 0, ImageWidth, ImageHeight));
+		Image.Publish(Frames, QRegion(0, 0, ImageWidth, ImageHeight));
+
+		QCOMPARE(Image.Publish(Frames, QRegion()), (qint64)0);
+		QCOMPARE(Frames.GetPublishedSerial(), 2U);
+	}
+
+	void staleRegionsAreRefreshed()
+	{
+		// Slots written two frames ago get the changes they missed, and reader gets all changes since it looked last time
+		FrameExchange Frames;
+		TestImage Image;
+
+		Image.Paint(QRect(0, 0, ImageWidth, ImageHeight), 1);
+		Image.Publish(Frames, QRegion(0, 0, ImageWidth, ImageHeight));
+		Frames.AcquireFrame();
+		Frames.TakeDirtyRegion();
+
+		QRegion ChangedRegion;
+		quint32 Seed = 7;
+
+		for (int FrameNum = 2; FrameNum < 200; FrameNum++)
+		{
+			Seed = Seed * 1103515245 + 12345;
+			const int X = (Seed >> 8) % ImageWidth;
+			const int Y = (Seed >> 16) % ImageHeight;
+			const QRect Rect(X, Y, 1 + (Seed >> 4) % (ImageWidth - X), 1 + (Seed >> 12) % (ImageHeight - Y));
+
+			Image.Paint(Rect, (uchar)FrameNum);
+			Image.Publish(Frames, QRegion(Rect));
+			ChangedRegion += Rect;
+
+			// Reader skips frames from time to time
+			if ((Seed >> 24) % 3 == 0)
+			{
+				const FrameSlot& Slot = Frames.AcquireFrame();
+				const QRegion DirtyRegion = Frames.TakeDirtyRegion();
+
+				const QByteArray Case = QString("frame %1").arg(FrameNum).toLatin1();
+				QVERIFY2(Image.Matches(Slot), Case.constData());
+				QVERIFY2(Slot.Serial == Frames.GetPublishedSerial(), Case.constData());
+				QVERIFY2(ChangedRegion.subtracted(DirtyRegion).isEmpty(), Case.constData());
+
+				ChangedRegion = QRegion();
+			}
+		}
+	}
+};
+
+int RunFrameExchangeTest(int argc, char** argv)
+{
+	FrameExchangeTest Test;
+	return QTest::qExec(&Test, argc, argv);
+}
+
+#include "FrameExchangeTest.moc"
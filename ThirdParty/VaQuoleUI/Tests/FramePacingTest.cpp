@@ -0,0 +1,165 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#include "VaQuoleUITests.h"
+#include "VaQuoleFramePacing.h"
+
+#include <QObject>
+#include <QtTest>
+
+using namespace VaQuole;
+
+/** 50 fps, so the interval is exact in microseconds */
+static const int FrameRate = 50;
+static const qint64 IntervalUs = 20000;
+
+/**
+ * Checks when paced view may paint and how its jitter is measured
+ */
+class FramePacingTest : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void unpacedViewPaintsAtOnce()
+	{
+		FramePacer Pacer;
+		qint64 WaitUs = -1;
+
+		for (int i = 0; i < 5; i++)
+		{
+			QVERIFY(Pacer.BeginFrame(100, WaitUs));
+			QCOMPARE(WaitUs, (qint64)0);
+		}
+
+		QCOMPARE(Pacer.GetStats().FramesPainted, 5ULL);
+		QCOMPARE(Pacer.GetStats().RepaintsCoalesced, 0ULL);
+		QCOMPARE(Pacer.GetStats().TargetFrameRate, 0);
+	}
+
+	void earlyRepaintsAreCoalesced()
+	{
+		FramePacer Pacer;
+		QVERIFY(Pacer.SetTargetFrameRate(FrameRate));
+		QCOMPARE(Pacer.GetStats().TargetFrameRate, FrameRate);
+
+		// The first frame is painted at once
+		qint64 WaitUs = 0;
+		QVERIFY(Pacer.BeginFrame(0, WaitUs));
+
+		// Repaints before the next frame time wait for it
+		QVERIFY(!Pacer.BeginFrame(0, WaitUs));
+		QCOMPARE(WaitUs, IntervalUs);
+		QVERIFY(!Pacer.BeginFrame(IntervalUs - 1, WaitUs));
+		QCOMPARE(WaitUs, (qint64)1);
+
+		QVERIFY(Pacer.BeginFrame(IntervalUs, WaitUs));
+
+		QCOMPARE(Pacer.GetStats().FramesPainted, 2ULL);
+		QCOMPARE(Pacer.GetStats().RepaintsCoalesced, 2ULL);
+	}
+
+	void lateFrameKeepsCadence()
+	{
+		FramePacer Pacer;
+		Pacer.SetTargetFrameRate(FrameRate);
+
+		qint64 WaitUs = 0;
+		QVERIFY(Pacer.BeginFrame(0, WaitUs));
+
+		// Frame painted 5 ms late, the next one is still due at 40 ms
+		QVERIFY(Pacer.BeginFrame(IntervalUs + 5000, WaitUs));
+		QVERIFY(!Pacer.BeginFrame(2 * IntervalUs - 1, WaitUs));
+		QCOMPARE(WaitUs, (qint64)1);
+		QVERIFY(Pacer.BeginFrame(2 * IntervalUs, WaitUs));
+	}
+
+	void idlePageDoesntCatchUp()
+	{
+		FramePacer Pacer;
+		Pacer.SetTargetFrameRate(FrameRate);
+
+		qint64 WaitUs = 0;
+		QVERIFY(Pacer.BeginFrame(0, WaitUs));
+
+		// After a second of idle, missed frames aren't painted in a burst
+		const qint64 WakeUpUs = 1000000 + 123;
+		QVERIFY(Pacer.BeginFrame(WakeUpUs, WaitUs));
+		QVERIFY(!Pacer.BeginFrame(WakeUpUs + 1, WaitUs));
+		QCOMPARE(WaitUs, IntervalUs - 1);
+	}
+
+	void jitterOfContinuousAnimation()
+	{
+		FramePacer Pacer;
+		Pacer.SetTargetFrameRate(FrameRate);
+
+		qint64 WaitUs = 0;
+		Pacer.BeginFrame(0, WaitUs);
+		Pacer.BeginFrame(IntervalUs + 3000, WaitUs);
+		QCOMPARE(Pacer.GetStats().LastJitterUs, 3000U);
+
+		// Early by 1 ms from the last frame
+		Pacer.BeginFrame(2 * IntervalUs + 2000, WaitUs);
+		QCOMPARE(Pacer.GetStats().LastJitterUs, 1000U);
+		QCOMPARE(Pacer.GetStats().MaxJitterUs, 3000U);
+		QCOMPARE(Pacer.GetStats().MeanJitterUs, 2000U);
+
+		// Frame after a pause isn't counted
+		Pacer.BeginFrame(10 * IntervalUs, WaitUs);
+		QCOMPARE(Pacer.GetStats().LastJitterUs, 1000U);
+		QCOMPARE(Pacer.GetStats().MeanJitterUs, 2000U);
+		QCOMPARE(Pacer.GetStats().FramesPainted, 4ULL);
+	}
+
+	void rateChangeDropsFrameTime()
+	{
+		FramePacer Pacer;
+		Pacer.SetTargetFrameRate(FrameRate);
+
+		qint64 WaitUs = 0;
+		QVERIFY(Pacer.BeginFrame(0, WaitUs));
+
+		// The same interval isn't a change
+		QVERIFY(!Pacer.SetTargetFrameRate(FrameRate));
+		QVERIFY(!Pacer.BeginFrame(1, WaitUs));
+
+		// New rate doesn't wait for the frame time of the old one
+		QVERIFY(Pacer.SetTargetFrameRate(FrameRate * 2));
+		QVERIFY(Pacer.BeginFrame(1, WaitUs));
+
+		QVERIFY(Pacer.SetTargetFrameRate(0));
+		QVERIFY(Pacer.BeginFrame(2, WaitUs));
+		QCOMPARE(Pacer.GetStats().TargetFrameRate, 0);
+	}
+
+	void resetKeepsFrameRate()
+	{
+		FramePacer Pacer;
+		Pacer.SetTargetFrameRate(FrameRate);
+
+		qint64 WaitUs = 0;
+		Pacer.BeginFrame(0, WaitUs);
+		Pacer.BeginFrame(IntervalUs + 3000, WaitUs);
+		Pacer.BeginFrame(IntervalUs + 4000, WaitUs);
+
+		Pacer.Reset();
+
+		const FramePacingStats& Stats = Pacer.GetStats();
+		QCOMPARE(Stats.TargetFrameRate, FrameRate);
+		QCOMPARE(Stats.FramesPainted, 0ULL);
+		QCOMPARE(Stats.RepaintsCoalesced, 0ULL);
+		QCOMPARE(Stats.MaxJitterUs, 0U);
+
+		// New page paints its first frame at once and has no jitter for it
+		QVERIFY(Pacer.BeginFrame(IntervalUs + 5000, WaitUs));
+		QCOMPARE(Pacer.GetStats().LastJitterUs, 0U);
+	}
+};
+
+int RunFramePacingTest(int argc, char** argv)
+{
+	FramePacingTest Test;
+	return QTest::qExec(&Test, argc, argv);
+}
+
+#include "FramePacingTest.moc"
@@ -0,0 +1,182 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#include "VaQuoleUITests.h"
+#include "VaQuoleFramePool.h"
+
+#include <QByteArray>
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <QtTest>
+
+#include <string.h>
+
+using namespace VaQuole;
+
+/**
+ * Checks size classes, alignment, reuse and memory limit of frame buffer pool
+ */
+class FramePoolTest : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void sizesAreRoundedToClasses()
+	{
+		// Four classes per power of two, starting from 4 KB
+		const quint64 Cases[][2] =
+		{
+			{ 1, 4096 },
+			{ 4096, 4096 },
+			{ 4097, 5120 },
+			{ 5121, 6144 },
+			{ 7169, 8192 },
+			{ 8193, 10240 },
+			{ 1000000, 1048576 },
+			{ 1048577, 1310720 },
+			{ 1920 * 1080 * 4, 8388608 }
+		};
+
+		for (int i = 0; i < (int)(sizeof(Cases) / sizeof(Cases[0])); i++)
+		{
+			FrameBufferPool Pool;
+
+			uchar* Bits = Pool.Allocate((size_t)Cases[i][0]);
+			const quint64 AllocatedBytes = Pool.GetStats().AllocatedBytes;
+			Pool.Release(Bits);
+
+			const QByteArray Case = QString("size %1, allocated %2").arg(Cases[i][0]).arg(AllocatedBytes).toLatin1();
+			QVERIFY2(AllocatedBytes == Cases[i][1], Case.constData());
+		}
+	}
+
+	void buffersAreAligned()
+	{
+		FrameBufferPool Pool;
+		QVector<uchar*> Buffers;
+
+		for (size_t Size = 1; Size < 4 * 1024 * 1024; Size = Size * 3 + 7)
+		{
+			uchar* Bits = Pool.Allocate(Size);
+			QVERIFY(Bits != NULL);
+			QCOMPARE((int)((quintptr)Bits % FrameBufferPool::Alignment), 0);
+
+			// The whole requested size is usable
+			memset(Bits, 0xAB, Size);
+			Buffers.append(Bits);
+		}
+
+		foreach (uchar* Bits, Buffers)
+		{
+			Pool.Release(Bits);
+		}
+	}
+
+	void releasedBufferIsReused()
+	{
+		FrameBufferPool Pool;
+
+		// Resized frame of the same size class takes memory of the old one
+		uchar* Bits = Pool.Allocate(800 * 600 * 4);
+		Pool.Release(Bits);
+		uchar* ResizedBits = Pool.Allocate(790 * 600 * 4);
+		QVERIFY(ResizedBits == Bits);
+
+		// Frame of another class gets new memory
+		uchar* BigBits = Pool.Allocate(1920 * 1080 * 4);
+		QVERIFY(BigBits != Bits);
+
+		const FramePoolStats Stats = Pool.GetStats();
+		QCOMPARE(Stats.Hits, 1ULL);
+		QCOMPARE(Stats.Misses, 2ULL);
+		QCOMPARE(Stats.PooledBytes, 0ULL);
+
+		Pool.Release(ResizedBits);
+		Pool.Release(BigBits);
+	}
+
+	void statsFollowBuffers()
+	{
+		FrameBufferPool Pool;
+
+		uchar* First = Pool.Allocate(4096);
+		uchar* Second = Pool.Allocate(8192);
+		QCOMPARE(Pool.GetStats().AllocatedBytes, 12288ULL);
+		QCOMPARE(Pool.GetStats().PooledBytes, 0ULL);
+
+		Pool.Release(First);
+		QCOMPARE(Pool.GetStats().PooledBytes, 4096ULL);
+
+		First = Pool.Allocate(100);
+		QCOMPARE(Pool.GetStats().PooledBytes, 0ULL);
+
+		Pool.Release(First);
+		Pool.Release(Second);
+
+		const FramePoolStats Stats = Pool.GetStats();
+		QCOMPARE(Stats.Hits, 1ULL);
+		QCOMPARE(Stats.Misses, 2ULL);
+		QCOMPARE(Stats.PooledBytes, 12288ULL);
+		QCOMPARE(Stats.AllocatedBytes, 12288ULL);
+		QCOMPARE(Stats.PeakBytes, 12288ULL);
+
+		// Released NULL is ignored
+		Pool.Release(NULL);
+		QCOMPARE(Pool.GetStats().PooledBytes, 12288ULL);
+	}
+
+	void freeBuffersAreCapped()
+	{
+		// Small buffer is pooled first, so only three of five 16 MB buffers fit the 64 MB limit
+		static const int BuffersNum = 5;
+		static const size_t BufferSize = 16 * 1024 * 1024;
+		static const size_t SmallSize = 4096;
+
+		FrameBufferPool Pool;
+
+		uchar* SmallBits = Pool.Allocate(SmallSize);
+		uchar* Buffers[BuffersNum];
+		for (int i = 0; i < BuffersNum; i++)
+		{
+			Buffers[i] = Pool.Allocate(BufferSize);
+		}
+
+		Pool.Release(SmallBits);
+		for (int i = 0; i < BuffersNum; i++)
+		{
+			Pool.Release(Buffers[i]);
+		}
+
+		const quint64 PooledBytes = SmallSize + 3 * BufferSize;
+
+		FramePoolStats Stats = Pool.GetStats();
+		QVERIFY(Stats.PooledBytes <= (quint64)FrameBufferPool::MaxPooledBytes);
+		QCOMPARE(Stats.PooledBytes, PooledBytes);
+		QCOMPARE(Stats.AllocatedBytes, PooledBytes);
+		QCOMPARE(Stats.PeakBytes, (quint64)(SmallSize + BuffersNum * BufferSize));
+
+		// Pooled ones are given away again, the rest are allocated
+		for (int i = 0; i < BuffersNum; i++)
+		{
+			Buffers[i] = Pool.Allocate(BufferSize);
+		}
+
+		Stats = Pool.GetStats();
+		QCOMPARE(Stats.Hits, 3ULL);
+		QCOMPARE(Stats.Misses, (quint64)(1 + BuffersNum + 2));
+		QCOMPARE(Stats.PooledBytes, (quint64)SmallSize);
+
+		for (int i = 0; i < BuffersNum; i++)
+		{
+			Pool.Release(Buffers[i]);
+		}
+	}
+};
+
+int RunFramePoolTest(int argc, char** argv)
+{
+	FramePoolTest Test;
+	return QTest::qExec(&Test, argc, argv);
+}
+
+#include "FramePoolTest.moc"
@@ -0,0 +1,106 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#include "VaQuoleUITests.h"
+#include "VaQuoleLatency.h"
+
+#include <QByteArray>
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <QtTest>
+
+#include <algorithm>
+
+using namespace VaQuole;
+
+/**
+ * Checks histogram bucketing against exact percentiles
+ */
+class LatencyHistogramTest : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void emptyHistogram()
+	{
+		LatencyHistogram Histogram;
+
+		QCOMPARE(Histogram.GetCount(), (quint64)0);
+		QCOMPARE(Histogram.GetMax(), (quint64)0);
+		QCOMPARE(Histogram.GetPercentile(50), (quint64)0);
+		QCOMPARE(Histogram.GetPercentile(100), (quint64)0);
+	}
+
+	void smallValuesAreExact()
+	{
+		// Each value below the sub-bucket count has its own bucket
+		LatencyHistogram Histogram;
+		for (quint64 Value = 0; Value < 8; Value++)
+		{
+			Histogram.Add(Value);
+		}
+
+		QCOMPARE(Histogram.GetCount(), (quint64)8);
+		QCOMPARE(Histogram.GetMax(), (quint64)7);
+		QCOMPARE(Histogram.GetPercentile(1), (quint64)0);
+		QCOMPARE(Histogram.GetPercentile(50), (quint64)3);
+		QCOMPARE(Histogram.GetPercentile(100), (quint64)7);
+	}
+
+	void percentilesAreWithinBucketError()
+	{
+		// Values of all scales, from microseconds to minutes
+		LatencyHistogram Histogram;
+		QVector<quint64> Values;
+
+		quint64 Seed = 42;
+		for (int i = 0; i < 20000; i++)
+		{
+			Seed = Seed * 6364136223846793005ULL + 1442695040888963407ULL;
+			const int Power = (int)((Seed >> 33) % 28);
+			const quint64 Value = (Seed >> 8) & ((1ULL << Power) - 1);
+
+			Values.append(Value);
+			Histogram.Add(Value);
+		}
+
+		std::sort(Values.begin(), Values.end());
+
+		const int Percents[] = { 1, 10, 50, 90, 95, 99, 100 };
+		for (int p = 0; p < (int)(sizeof(Percents) / sizeof(Percents[0])); p++)
+		{
+			// Nearest rank
+			const quint64 Exact = Values[(Values.size() * Percents[p] + 99) / 100 - 1];
+			const quint64 Reported = Histogram.GetPercentile(Percents[p]);
+
+			// Upper bound of the bucket is never below the value and at most 1/8 above it
+			const QByteArray Case = QString("p%1: exact %2, reported %3").arg(Percents[p]).arg(Exact).arg(Reported).toLatin1();
+			QVERIFY2(Reported >= Exact, Case.constData());
+			QVERIFY2(Reported <= Exact + Exact / 8, Case.constData());
+		}
+
+		QCOMPARE(Histogram.GetMax(), Values.last());
+		QCOMPARE(Histogram.GetPercentile(100), Values.last());
+	}
+
+	void hugeValuesAreClamped()
+	{
+		// Values beyond the last power share the last bucket, percentile never exceeds the max seen
+		LatencyHistogram Histogram;
+		Histogram.Add(10);
+		Histogram.Add(1ULL << 40);
+
+		QCOMPARE(Histogram.GetMax(), 1ULL << 40);
+		QVERIFY(Histogram.GetPercentile(100) <= Histogram.GetMax());
+		QVERIFY(Histogram.GetPercentile(100) >= (1ULL << 27) - 1);
+		QCOMPARE(Histogram.GetPercentile(50), (quint64)10);
+	}
+};
+
+int RunLatencyHistogramTest(int argc, char** argv)
+{
+	LatencyHistogramTest Test;
+	return QTest::qExec(&Test, argc, argv);
+}
+
+#include "LatencyHistogramTest.moc"
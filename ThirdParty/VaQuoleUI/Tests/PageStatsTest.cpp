@@ -0,0 +1,101 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#include "VaQuoleUITests.h"
+#include "VaQuoleAppThread.h"
+#include "../Include/VaQuoleUILib.h"
+
+#include <QObject>
+#include <QtTest>
+
+using namespace VaQuole;
+
+/** Counters of the page as UI thread would leave them, each one is different */
+static void FillPageStats(PageStats& Stats, unsigned long long Base)
+{
+	Stats.PaintUs = Base + 1;
+	Stats.ScriptUs = Base + 2;
+	Stats.CopyUs = Base + 3;
+	Stats.FramesProduced = Base + 4;
+	Stats.BytesCopied = Base + 5;
+	Stats.ScriptsEvaluated = Base + 6;
+	Stats.InputEventsProcessed = Base + 7;
+	Stats.CommandQueueDepth = (unsigned int)Base + 8;
+	Stats.PendingScriptResults = (unsigned int)Base + 9;
+	Stats.PendingScriptEvents = (unsigned int)Base + 10;
+	Stats.ImageBytes = Base + 11;
+	Stats.ContentBytes = Base + 12;
+}
+
+/**
+ * Checks that work of deleted pages stays in thread totals, but their memory doesn't
+ */
+class PageStatsTest : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void retiredPagesAreAccumulated()
+	{
+		VaQuoleWebUI* FirstPage = new VaQuoleWebUI();
+		VaQuoleWebUI* SecondPage = new VaQuoleWebUI();
+		FillPageStats(FirstPage->GetData()->Stats, 100);
+		FillPageStats(SecondPage->GetData()->Stats, 1000);
+
+		UIThreadStats Stats;
+		Stats.Ticks = 7;
+		Stats.EventLoopUs = 70;
+
+		VaQuoleUIManager::RetirePageStats(Stats, FirstPage->GetData());
+		VaQuoleUIManager::RetirePageStats(Stats, SecondPage->GetData());
+
+		const PageStats& Totals = Stats.Totals;
+		QCOMPARE(Totals.PaintUs, 1102ULL);
+		QCOMPARE(Totals.ScriptUs, 1104ULL);
+		QCOMPARE(Totals.CopyUs, 1106ULL);
+		QCOMPARE(Totals.FramesProduced, 1108ULL);
+		QCOMPARE(Totals.BytesCopied, 1110ULL);
+		QCOMPARE(Totals.ScriptsEvaluated, 1112ULL);
+		QCOMPARE(Totals.InputEventsProcessed, 1114ULL);
+
+		// Queues and memory of deleted pages are gone
+		QCOMPARE(Totals.CommandQueueDepth, 0U);
+		QCOMPARE(Totals.PendingScriptResults, 0U);
+		QCOMPARE(Totals.PendingScriptEvents, 0U);
+		QCOMPARE(Totals.ImageBytes, 0ULL);
+		QCOMPARE(Totals.ContentBytes, 0ULL);
+
+		// Loop counters aren't touched
+		QCOMPARE(Stats.Ticks, 7ULL);
+		QCOMPARE(Stats.EventLoopUs, 70ULL);
+		QCOMPARE(Stats.Pages, 0U);
+
+		delete FirstPage->GetData();
+		delete FirstPage;
+		delete SecondPage->GetData();
+		delete SecondPage;
+	}
+
+	void alivePagesKeepMemory()
+	{
+		// Totals of alive pages are summed as is
+		PageStats Alive;
+		FillPageStats(Alive, 100);
+
+		UIThreadStats Stats;
+		Stats.Totals.Accumulate(Alive);
+		Stats.Totals.Accumulate(Alive);
+
+		QCOMPARE(Stats.Totals.PaintUs, 202ULL);
+		QCOMPARE(Stats.Totals.CommandQueueDepth, 216U);
+		QCOMPARE(Stats.Totals.ImageBytes, 222ULL);
+		QCOMPARE(Stats.Totals.ContentBytes, 224ULL);
+	}
+};
+
+int RunPageStatsTest(int argc, char** argv)
+{
+	PageStatsTest Test;
+	return QTest::qExec(&Test, argc, argv);
+}
+
+#include "PageStatsTest.moc"
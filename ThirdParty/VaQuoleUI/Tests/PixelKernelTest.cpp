@@ -0,0 +1,178 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#include "VaQuoleUITests.h"
+#include "VaQuolePixelFormat.h"
+
+#include <QByteArray>
+#include <QDebug>
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <QtTest>
+
+#include <string.h>
+
+using namespace VaQuole;
+
+/** 32-bit formats converted by kernels */
+static const EPixelFormat::Type KernelFormats[] = { EPixelFormat::BGRA8, EPixelFormat::BGRA8_Premultiplied, EPixelFormat::RGBA8, EPixelFormat::RGBA8_Premultiplied };
+
+static const char* KernelNames[] = { "scalar", "SSE2", "AVX2" };
+
+/** Reference conversion of one pixel, premultiplication is rounded to nearest */
+static void ConvertReference(uchar* Dst, const uchar* Src, EPixelFormat::Type Format, bool bOpaque)
+{
+	const bool bSwizzle = (Format == EPixelFormat::RGBA8 || Format == EPixelFormat::RGBA8_Premultiplied);
+	const bool bPremultiply = (Format == EPixelFormat::BGRA8_Premultiplied || Format == EPixelFormat::RGBA8_Premultiplied);
+
+	const int A = bOpaque ? 255 : Src[3];
+	int B = Src[0];
+	int G = Src[1];
+	int R = Src[2];
+
+	if (bPremultiply)
+	{
+		B = (B * A * 2 + 255) / 510;
+		G = (G * A * 2 + 255) / 510;
+		R = (R * A * 2 + 255) / 510;
+	}
+
+	Dst[0] = (uchar)(bSwizzle ? R : B);
+	Dst[1] = (uchar)G;
+	Dst[2] = (uchar)(bSwizzle ? B : R);
+	Dst[3] = (uchar)A;
+}
+
+/** Pseudo-random pixels, the same on each run */
+static QVector<uchar> MakePixels(int PixelsNum)
+{
+	QVector<uchar> Bits(PixelsNum * 4);
+
+	quint32 Seed = 12345;
+	for (int i = 0; i < Bits.size(); i++)
+	{
+		Seed = Seed * 1103515245 + 12345;
+		Bits[i] = (uchar)(Seed >> 16);
+	}
+
+	return Bits;
+}
+
+/**
+ * Compares each kernel supported by CPU with reference conversion
+ */
+class PixelKernelTest : public QObject
+{
+	Q_OBJECT
+
+private:
+	/** Convert pixels with kernel and return index of the first wrong pixel (-1 if all are right) */
+	static int CheckKernel(EPixelKernel::Type Kernel, const uchar* Src, int PixelsNum, EPixelFormat::Type Format, bool bOpaque, bool bInPlace)
+	{
+		QVector<uchar> Dst(PixelsNum * 4 + 4);
+		if (bInPlace)
+		{
+			memcpy(Dst.data(), Src, PixelsNum * 4);
+			ConvertPixelsWithKernel(Kernel, Dst.data(), Dst.constData(), PixelsNum, Format, bOpaque);
+		}
+		else
+		{
+			ConvertPixelsWithKernel(Kernel, Dst.data(), Src, PixelsNum, Format, bOpaque);
+		}
+
+		for (int i = 0; i < PixelsNum; i++)
+		{
+			uchar Expected[4];
+			ConvertReference(Expected, Src + i * 4, Format, bOpaque);
+
+			if (memcmp(Expected, Dst.constData() + i * 4, 4) != 0)
+			{
+				return i;
+			}
+		}
+
+		return -1;
+	}
+
+private slots:
+	void scalarIsAlwaysSupported()
+	{
+		QVERIFY(IsPixelKernelSupported(EPixelKernel::Scalar));
+	}
+
+	void kernelsMatchReference()
+	{
+		// Lines of any length and alignment, so vector loops and their tails are covered
+		const QVector<uchar> Pixels = MakePixels(64 + 1);
+
+		for (int k = EPixelKernel::Scalar; k <= EPixelKernel::AVX2; k++)
+		{
+			const EPixelKernel::Type Kernel = (EPixelKernel::Type)k;
+			if (!IsPixelKernelSupported(Kernel))
+			{
+				qDebug() << "Kernel isn't supported:" << KernelNames[k];
+				continue;
+			}
+
+			for (int f = 0; f < (int)(sizeof(KernelFormats) / sizeof(KernelFormats[0])); f++)
+			{
+				for (int Opaque = 0; Opaque < 2; Opaque++)
+				{
+					for (int PixelsNum = 0; PixelsNum <= 37; PixelsNum++)
+					{
+						for (int Offset = 0; Offset < 2; Offset++)
+						{
+							for (int InPlace = 0; InPlace < 2; InPlace++)
+							{
+								const int WrongPixel = CheckKernel(Kernel, Pixels.constData() + Offset * 4, PixelsNum, KernelFormats[f], Opaque != 0, InPlace != 0);
+
+								const QByteArray Case = QString("%1 kernel, format %2, opaque %3, %4 pixels, offset %5, in place %6, wrong pixel %7")
+									.arg(KernelNames[k]).arg(KernelFormats[f]).arg(Opaque).arg(PixelsNum).arg(Offset).arg(InPlace).arg(WrongPixel).toLatin1();
+								QVERIFY2(WrongPixel < 0, Case.constData());
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+	void premultiplyIsExact()
+	{
+		// Every value with every alpha
+		QVector<uchar> Pixels(256 * 256 * 4);
+		for (int Value = 0; Value < 256; Value++)
+		{
+			for (int Alpha = 0; Alpha < 256; Alpha++)
+			{
+				uchar* Pixel = Pixels.data() + (Value * 256 + Alpha) * 4;
+				Pixel[0] = (uchar)Value;
+				Pixel[1] = (uchar)(255 - Value);
+				Pixel[2] = (uchar)(Value ^ Alpha);
+				Pixel[3] = (uchar)Alpha;
+			}
+		}
+
+		for (int k = EPixelKernel::Scalar; k <= EPixelKernel::AVX2; k++)
+		{
+			const EPixelKernel::Type Kernel = (EPixelKernel::Type)k;
+			if (!IsPixelKernelSupported(Kernel))
+			{
+				continue;
+			}
+
+			const int WrongPixel = CheckKernel(Kernel, Pixels.constData(), 256 * 256, EPixelFormat::RGBA8_Premultiplied, false, false);
+
+			const QByteArray Case = QString("%1 kernel, wrong pixel %2").arg(KernelNames[k]).arg(WrongPixel).toLatin1();
+			QVERIFY2(WrongPixel < 0, Case.constData());
+		}
+	}
+};
+
+int RunPixelKernelTest(int argc, char** argv)
+{
+	PixelKernelTest Test;
+	return QTest::qExec(&Test, argc, argv);
+}
+
+#include "PixelKernelTest.moc"
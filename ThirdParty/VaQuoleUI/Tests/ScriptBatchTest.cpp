@@ -0,0 +1,232 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#include "VaQuoleUITests.h"
+#include "VaQuoleAppThread.h"
+#include "VaQuoleCommandQueue.h"
+#include "VaQuoleStringHelpers.h"
+#include "../Include/VaQuoleUILib.h"
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QtTest>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+using namespace VaQuole;
+
+/** Engine strings of the scripts */
+struct ScriptSources
+{
+	std::vector<TCHARString> Strings;
+	std::vector<const TCHAR*> Pointers;
+
+	explicit ScriptSources(const QStringList& Scripts)
+	{
+		foreach (const QString& Script, Scripts)
+		{
+			Strings.push_back(ToTCHAR(Script));
+		}
+
+		for (size_t i = 0; i < Strings.size(); i++)
+		{
+			Pointers.push_back(Strings[i].c_str());
+		}
+	}
+
+	unsigned int Evaluate(VaQuoleWebUI* Page) const
+	{
+		return Page->EvaluateJavaScriptBatch(Pointers.empty() ? NULL : &Pointers[0], (int)Pointers.size());
+	}
+};
+
+/** Page that isn't registered, so its commands stay in the queue */
+static VaQuoleWebUI* CreatePage()
+{
+	return new VaQuoleWebUI();
+}
+
+static void DestroyPage(VaQuoleWebUI* Page)
+{
+	delete Page->GetData();
+	delete Page;
+}
+
+/**
+ * Checks call ids of script batches, their order with single scripts and results of dropped batches
+ */
+class ScriptBatchTest : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void idsAreReservedForWholeBatch()
+	{
+		VaQuoleWebUI* Page = CreatePage();
+
+		// Empty batch takes no ids
+		QCOMPARE(ScriptSources(QStringList()).Evaluate(Page), 0U);
+
+		QStringList Scripts;
+		Scripts << QString("1") << QString("2") << QString("3");
+		QCOMPARE(ScriptSources(Scripts).Evaluate(Page), 1U);
+		QCOMPARE(ScriptSources(QStringList(QString("4"))).Evaluate(Page), 4U);
+
+		// Asynchronous calls share the same ids
+		const ScriptCall Call = Page->EvaluateJavaScriptAsync(ToTCHAR(QString("5")).c_str());
+		QCOMPARE(Call.GetCallId(), 5U);
+		QCOMPARE(ScriptSources(Scripts).Evaluate(Page), 6U);
+
+		PageCommands Commands;
+		Page->GetData()->Commands.Drain(Commands);
+		QCOMPARE(Commands.ScriptBatches.size(), 4);
+		QCOMPARE(Commands.ScriptBatches[0].FirstCallId, 1U);
+		QVERIFY(Commands.ScriptBatches[0].Scripts == Scripts);
+		QCOMPARE(Commands.ScriptBatches[3].FirstCallId, 6U);
+
+		DestroyPage(Page);
+	}
+
+	void concurrentBatchesDontShareIds()
+	{
+		static const int ThreadsNum = 4;
+		static const int BatchesNum = 50;
+		static const int BatchSize = 3;
+
+		VaQuoleWebUI* Page = CreatePage();
+		QVector< QVector<unsigned int> > FirstIds(ThreadsNum);
+
+		std::vector<std::thread> Threads;
+		for (int t = 0; t < ThreadsNum; t++)
+		{
+			Threads.push_back(std::thread([Page, &FirstIds, t]()
+			{
+				for (int b = 0; b < BatchesNum; b++)
+				{
+					QStringList Scripts;
+					for (int i = 0; i < BatchSize; i++)
+					{
+						Scripts.append(QString("%1:%2:%3").arg(t).arg(b).arg(i));
+					}
+
+					FirstIds[t].append(ScriptSources(Scripts).Evaluate(Page));
+				}
+			}));
+		}
+
+		for (int t = 0; t < ThreadsNum; t++)
+		{
+			Threads[t].join();
+		}
+
+		// Ids of all batches make one range without gaps and overlaps
+		std::vector<unsigned int> AllIds;
+		for (int t = 0; t < ThreadsNum; t++)
+		{
+			AllIds.insert(AllIds.end(), FirstIds[t].begin(), FirstIds[t].end());
+		}
+
+		std::sort(AllIds.begin(), AllIds.end());
+		for (size_t i = 0; i < AllIds.size(); i++)
+		{
+			QCOMPARE(AllIds[i], (unsigned int)(1 + i * BatchSize));
+		}
+
+		// Each queued batch has the id its caller got
+		PageCommands Commands;
+		Page->GetData()->Commands.Drain(Commands);
+		QCOMPARE(Commands.ScriptBatches.size(), ThreadsNum * BatchesNum);
+
+		foreach (const ScriptBatch& Batch, Commands.ScriptBatches)
+		{
+			const int Thread = Batch.Scripts[0].section(':', 0, 0).toInt();
+			const int Index = Batch.Scripts[0].section(':', 1, 1).toInt();
+			QCOMPARE(Batch.FirstCallId, FirstIds[Thread][Index]);
+			QCOMPARE(Batch.Scripts.size(), BatchSize);
+		}
+
+		DestroyPage(Page);
+	}
+
+	void batchesKeepOrderWithSingleScripts()
+	{
+		VaQuoleWebUI* Page = CreatePage();
+		TCHAR Uuid[VaQuoleWebUI::ScriptUuidLength];
+
+		// Batch, script, batch, script, script, batch
+		ScriptSources(QStringList(QString("b1"))).Evaluate(Page);
+		Page->EvaluateJavaScript(ToTCHAR(QString("s1")).c_str(), Uuid);
+		ScriptSources(QStringList(QString("b2"))).Evaluate(Page);
+		Page->EvaluateJavaScript(ToTCHAR(QString("s2")).c_str(), Uuid);
+		Page->EvaluateJavaScript(ToTCHAR(QString("s3")).c_str(), Uuid);
+		ScriptSources(QStringList(QString("b3"))).Evaluate(Page);
+
+		PageCommands Commands;
+		Page->GetData()->Commands.Drain(Commands);
+
+		QCOMPARE(Commands.ScriptCommands.size(), 3);
+		QVERIFY(Commands.ScriptCommands[0].second == QString("s1"));
+		QVERIFY(Commands.ScriptCommands[2].second == QString("s3"));
+
+		// UI thread evaluates batch before the single script with this index
+		QCOMPARE(Commands.ScriptBatches.size(), 3);
+		QCOMPARE(Commands.ScriptBatches[0].ScriptCommandsBefore, 0);
+		QCOMPARE(Commands.ScriptBatches[1].ScriptCommandsBefore, 1);
+		QCOMPARE(Commands.ScriptBatches[2].ScriptCommandsBefore, 3);
+
+		DestroyPage(Page);
+	}
+
+	void droppedBatchGetsResults()
+	{
+		VaQuoleWebUI* Page = CreatePage();
+
+		for (quint32 i = 0; i < CommandQueue::Capacity; i++)
+		{
+			QVERIFY(Page->GetData()->Commands.PushURL(QString("http://fill/")));
+		}
+
+		QStringList Scripts;
+		Scripts << QString("1") << QString("2") << QString("3");
+		const unsigned int FirstCallId = ScriptSources(Scripts).Evaluate(Page);
+		QCOMPARE(FirstCallId, 1U);
+
+		// Every call of the batch is answered at once, with empty result
+		std::vector<ScriptCallResult> Results;
+		Page->GetScriptCallResults(Results);
+		QCOMPARE((int)Results.size(), 3);
+		for (int i = 0; i < 3; i++)
+		{
+			QCOMPARE(Results[i].CallId, FirstCallId + i);
+			QVERIFY(FromTCHAR(Results[i].Result).isEmpty());
+		}
+
+		// Dropped asynchronous call gets the reason
+		const ScriptCall Call = Page->EvaluateJavaScriptAsync(ToTCHAR(QString("4")).c_str());
+		QVERIFY(Call.IsCompleted());
+		QVERIFY(Call.GetStatus() == EScriptCallStatus::Failed);
+		QVERIFY(FromTCHAR(Call.GetError()) == QString("Command queue is full"));
+
+		// Ids of dropped batch aren't reused
+		PageCommands Commands;
+		Page->GetData()->Commands.Drain(Commands);
+		QCOMPARE(ScriptSources(Scripts).Evaluate(Page), 5U);
+
+		Results.clear();
+		Page->GetScriptCallResults(Results);
+		QVERIFY(Results.empty());
+
+		DestroyPage(Page);
+	}
+};
+
+int RunScriptBatchTest(int argc, char** argv)
+{
+	ScriptBatchTest Test;
+	return QTest::qExec(&Test, argc, argv);
+}
+
+#include "ScriptBatchTest.moc"
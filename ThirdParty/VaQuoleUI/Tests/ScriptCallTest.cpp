@@ -0,0 +1,303 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#include "VaQuoleUITests.h"
+#include "VaQuoleAppThread.h"
+#include "VaQuoleScriptCall.h"
+#include "VaQuoleStringHelpers.h"
+#include "../Include/VaQuoleUILib.h"
+
+#ifdef Q_OS_UNIX
+#include "VaQuoleRemoteManager.h"
+#endif
+
+#include <QDateTime>
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+#include <QVariantList>
+#include <QVariantMap>
+#include <QtTest>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace VaQuole;
+
+/** Call that isn't bound to any page */
+static std::shared_ptr<ScriptCallState> CreateCall(ScriptCallback Callback = ScriptCallback(),
+	EScriptCallbackThread::Type CallbackThread = EScriptCallbackThread::Dispatched)
+{
+	std::shared_ptr<ScriptCallState> State = std::make_shared<ScriptCallState>();
+	State->CallId = 1;
+	State->Callback = Callback;
+	State->CallbackThread = CallbackThread;
+
+	return State;
+}
+
+static ScriptValue MakeString(const QString& Text)
+{
+	return ScriptValue::FromVariant(QVariant(Text));
+}
+
+/**
+ * Checks typed script values, completion of asynchronous calls and their callbacks
+ */
+class ScriptCallTest : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void valuesAreTyped()
+	{
+		const ScriptValue String = MakeString(QString("text"));
+		QVERIFY(String.Status == EScriptCallStatus::Succeeded);
+		QVERIFY(String.Type == EScriptValueType::String);
+		QVERIFY(String.Text == QString("text"));
+
+		const ScriptValue Bool = ScriptValue::FromVariant(QVariant(true));
+		QVERIFY(Bool.Type == EScriptValueType::Bool);
+		QVERIFY(Bool.BoolValue);
+		QVERIFY(Bool.Text == QString("true"));
+
+		const ScriptValue Integer = ScriptValue::FromVariant(QVariant(42));
+		QVERIFY(Integer.Type == EScriptValueType::Number);
+		QCOMPARE(Integer.NumberValue, 42.0);
+		QVERIFY(Integer.Text == QString("42"));
+
+		const ScriptValue Double = ScriptValue::FromVariant(QVariant(1.5));
+		QVERIFY(Double.Type == EScriptValueType::Number);
+		QCOMPARE(Double.NumberValue, 1.5);
+	}
+
+	void containersAreJson()
+	{
+		QVariantList List;
+		List << QVariant(1) << QVariant(QString("a"));
+		const ScriptValue Array = ScriptValue::FromVariant(QVariant(List));
+		QVERIFY(Array.Type == EScriptValueType::Array);
+		QVERIFY(Array.Text == QString("[1,\"a\"]"));
+
+		const ScriptValue Strings = ScriptValue::FromVariant(QVariant(QStringList(QString("b"))));
+		QVERIFY(Strings.Type == EScriptValueType::Array);
+		QVERIFY(Strings.Text == QString("[\"b\"]"));
+
+		QVariantMap Map;
+		Map.insert(QString("a"), QVariant(1));
+		const ScriptValue Object = ScriptValue::FromVariant(QVariant(Map));
+		QVERIFY(Object.Type == EScriptValueType::Object);
+		QVERIFY(Object.Text == QString("{\"a\":1}"));
+	}
+
+	void undefinedIsNull()
+	{
+		// WebKit returns undefined as invalid value and null as null pointer
+		const ScriptValue Undefined = ScriptValue::FromVariant(QVariant());
+		QVERIFY(Undefined.Status == EScriptCallStatus::Succeeded);
+		QVERIFY(Undefined.Type == EScriptValueType::Null);
+		QVERIFY(Undefined.Text.isEmpty());
+
+		const ScriptValue Null = ScriptValue::FromVariant(QVariant::fromValue((QObject*)NULL));
+		QVERIFY(Null.Type == EScriptValueType::Null);
+
+		// Other types are passed as text
+		const ScriptValue Date = ScriptValue::FromVariant(QVariant(QDateTime(QDate(2014, 1, 2))));
+		QVERIFY(Date.Type == EScriptValueType::String);
+		QVERIFY(!Date.Text.isEmpty());
+	}
+
+	void errorHasNoValue()
+	{
+		const ScriptValue Error = ScriptValue::FromError(QString("ReferenceError"));
+		QVERIFY(Error.Status == EScriptCallStatus::Failed);
+		QVERIFY(Error.Text == QString("ReferenceError"));
+		QVERIFY(Error.ToString().isEmpty());
+	}
+
+	void callIsCompletedOnce()
+	{
+		int CallbacksRun = 0;
+		std::shared_ptr<ScriptCallState> State = CreateCall([&CallbacksRun](const ScriptCall&) { CallbacksRun++; },
+			EScriptCallbackThread::Immediate);
+		const ScriptCall Call(State);
+
+		QVERIFY(Call.GetStatus() == EScriptCallStatus::Pending);
+		QVERIFY(!Call.IsCompleted());
+		QVERIFY(!Call.Wait(0));
+
+		ScriptCallState::Complete(State, MakeString(QString("first")));
+		ScriptCallState::Complete(State, ScriptValue::FromError(QString("second")));
+
+		// Late results (e.g. cancellation after the real result) are ignored
+		QVERIFY(Call.IsCompleted());
+		QVERIFY(Call.GetStatus() == EScriptCallStatus::Succeeded);
+		QVERIFY(FromTCHAR(Call.GetString()) == QString("first"));
+		QVERIFY(FromTCHAR(Call.GetError()).isEmpty());
+		QCOMPARE(CallbacksRun, 1);
+	}
+
+	void immediateCallbackRunsInline()
+	{
+		std::thread::id CallbackThread;
+		bool bCompletedInCallback = false;
+
+		std::shared_ptr<ScriptCallState> State = CreateCall([&CallbackThread, &bCompletedInCallback](const ScriptCall& Call)
+		{
+			CallbackThread = std::this_thread::get_id();
+			bCompletedInCallback = Call.IsCompleted();
+		}, EScriptCallbackThread::Immediate);
+
+		std::thread Completer([State]()
+		{
+			ScriptCallState::Complete(State, MakeString(QString("done")));
+		});
+		const std::thread::id CompleterThread = Completer.get_id();
+		Completer.join();
+
+		QVERIFY(CallbackThread == CompleterThread);
+		QVERIFY(bCompletedInCallback);
+
+		// Callback is released, so handles it keeps don't hold the call forever
+		QVERIFY(!State->Callback);
+	}
+
+	void dispatchedCallbackWaitsForDispatch()
+	{
+		// Callbacks left by other cases
+		DispatchScriptCallbacks();
+
+		std::vector<QString> Results;
+		ScriptCallback Callback = [&Results](const ScriptCall& Call) { Results.push_back(FromTCHAR(Call.GetString())); };
+
+		std::shared_ptr<ScriptCallState> First = CreateCall(Callback);
+		std::shared_ptr<ScriptCallState> Second = CreateCall(Callback);
+
+		std::thread Completer([First, Second]()
+		{
+			ScriptCallState::Complete(First, MakeString(QString("1")));
+			ScriptCallState::Complete(Second, MakeString(QString("2")));
+		});
+		Completer.join();
+
+		// Nothing is run until the engine asks for it, then callbacks come in order
+		QVERIFY(Results.empty());
+		QVERIFY(ScriptCall(First).IsCompleted());
+
+		QCOMPARE(DispatchScriptCallbacks(1), 1);
+		QCOMPARE((int)Results.size(), 1);
+		QVERIFY(Results[0] == QString("1"));
+
+		QCOMPARE(DispatchScriptCallbacks(), 1);
+		QCOMPARE((int)Results.size(), 2);
+		QVERIFY(Results[1] == QString("2"));
+
+		QCOMPARE(DispatchScriptCallbacks(), 0);
+	}
+
+	void waiterIsWokenUp()
+	{
+		std::shared_ptr<ScriptCallState> State = CreateCall();
+		const ScriptCall Call(State);
+
+		std::thread Completer([State]()
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			ScriptCallState::Complete(State, ScriptValue::FromVariant(QVariant(7)));
+		});
+
+		QVERIFY(Call.Wait(-1));
+		Completer.join();
+
+		QVERIFY(Call.GetType() == EScriptValueType::Number);
+		QCOMPARE(Call.GetNumber(), 7.0);
+	}
+
+	void destroyedPageCancelsCalls()
+	{
+		int CallbacksRun = 0;
+		ScriptCallback Callback = [&CallbacksRun](const ScriptCall& Call)
+		{
+			if (Call.GetStatus() == EScriptCallStatus::Failed)
+			{
+				CallbacksRun++;
+			}
+		};
+
+		QList< std::shared_ptr<ScriptCallState> > Calls;
+		Calls.append(CreateCall(Callback, EScriptCallbackThread::Immediate));
+		Calls.append(CreateCall(Callback, EScriptCallbackThread::Immediate));
+
+		// Call that already has its result keeps it
+		ScriptCallState::Complete(Calls[1], MakeString(QString("done")));
+		CallbacksRun = 0;
+
+		CancelScriptCalls(Calls);
+
+		QVERIFY(ScriptCall(Calls[0]).GetStatus() == EScriptCallStatus::Failed);
+		QVERIFY(FromTCHAR(ScriptCall(Calls[0]).GetError()) == QString("Page was destroyed"));
+		QVERIFY(ScriptCall(Calls[1]).GetStatus() == EScriptCallStatus::Succeeded);
+		QCOMPARE(CallbacksRun, 1);
+	}
+
+	void stoppedHostFailsLostScripts()
+	{
+#ifdef Q_OS_UNIX
+		VaQuoleWebUI* Page = new VaQuoleWebUI();
+
+		// Asynchronous call is registered by the page, batch calls and single scripts are polled
+		QString Error;
+		const ScriptCall Call = Page->EvaluateJavaScriptAsync(ToTCHAR(QString("1")).c_str(),
+			[&Error](const ScriptCall& Completed) { Error = FromTCHAR(Completed.GetError()); },
+			EScriptCallbackThread::Immediate);
+
+		RemotePage Remote;
+		Remote.InFlightCallIds.insert(Call.GetCallId());
+		Remote.InFlightCallIds.insert(100);
+		Remote.InFlightScripts.insert(QString("{uuid}"));
+
+		// Host has stopped, so nothing sent to it will be answered
+		Remote.ResetHostState();
+		QVERIFY(Remote.InFlightCallIds.isEmpty());
+		QCOMPARE(Remote.LostCallIds.size(), 2);
+
+		FailLostPageScripts(Page, &Remote);
+
+		QVERIFY(Call.GetStatus() == EScriptCallStatus::Failed);
+		QVERIFY(Error == QString("UI host has stopped"));
+
+		std::vector<ScriptCallResult> CallResults;
+		Page->GetScriptCallResults(CallResults);
+		QCOMPARE((int)CallResults.size(), 1);
+		QCOMPARE(CallResults[0].CallId, 100U);
+		QVERIFY(FromTCHAR(CallResults[0].Result).isEmpty());
+
+		std::vector<ScriptEval> Evals;
+		Page->GetScriptResults(Evals);
+		QCOMPARE((int)Evals.size(), 1);
+		QVERIFY(FromTCHAR(Evals[0].ScriptUuid) == QString("{uuid}"));
+		QVERIFY(FromTCHAR(Evals[0].ScriptResult).isEmpty());
+
+		// Lost scripts are failed once
+		QVERIFY(Remote.LostCallIds.isEmpty());
+		QVERIFY(Remote.LostScripts.isEmpty());
+
+		delete Page->GetData();
+		delete Page;
+#else
+		QSKIP("UI hosts are used on Unix only");
+#endif
+	}
+};
+
+int RunScriptCallTest(int argc, char** argv)
+{
+	ScriptCallTest Test;
+	return QTest::qExec(&Test, argc, argv);
+}
+
+#include "ScriptCallTest.moc"
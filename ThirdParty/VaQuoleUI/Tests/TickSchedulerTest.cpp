@@ -0,0 +1,93 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#include "VaQuoleUITests.h"
+#include "VaQuoleAppThread.h"
+
+#include <QObject>
+#include <QtTest>
+
+using namespace VaQuole;
+
+static const qint64 BudgetUs = VaQuoleUIManager::DefaultTickBudgetUs;
+
+/** Run ticks that are all over budget, returns ticks in which page was serviced */
+static QList<int> RunBusyTicks(EPagePriority::Type Priority, int TicksNum)
+{
+	QList<int> ServicedTicks;
+	int DeferredTicks = 0;
+
+	for (int Tick = 0; Tick < TicksNum; Tick++)
+	{
+		if (VaQuoleUIManager::ShouldDeferPage(Priority, DeferredTicks, BudgetUs, BudgetUs))
+		{
+			DeferredTicks++;
+			continue;
+		}
+
+		DeferredTicks = 0;
+		ServicedTicks.append(Tick);
+	}
+
+	return ServicedTicks;
+}
+
+/**
+ * Checks how long pages of each priority can be postponed when tick budget is spent
+ */
+class TickSchedulerTest : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void pagesInBudgetAreServiced()
+	{
+		for (int Priority = EPagePriority::Focused; Priority <= EPagePriority::Hidden; Priority++)
+		{
+			QVERIFY(!VaQuoleUIManager::ShouldDeferPage((EPagePriority::Type)Priority, 0, 0, BudgetUs));
+			QVERIFY(!VaQuoleUIManager::ShouldDeferPage((EPagePriority::Type)Priority, 0, BudgetUs - 1, BudgetUs));
+		}
+	}
+
+	void shownPagesAreNeverDeferred()
+	{
+		QCOMPARE(RunBusyTicks(EPagePriority::Focused, 20).size(), 20);
+		QCOMPARE(RunBusyTicks(EPagePriority::Visible, 20).size(), 20);
+
+		// Even when there is no budget at all
+		QVERIFY(!VaQuoleUIManager::ShouldDeferPage(EPagePriority::Visible, 0, 0, 0));
+	}
+
+	void backgroundPageWaitsFourTicks()
+	{
+		const QList<int> ServicedTicks = RunBusyTicks(EPagePriority::Background, 20);
+
+		QCOMPARE(ServicedTicks.size(), 4);
+		QCOMPARE(ServicedTicks[0], 4);
+		QCOMPARE(ServicedTicks[1], 9);
+		QCOMPARE(ServicedTicks[3], 19);
+	}
+
+	void hiddenPageWaitsSixteenTicks()
+	{
+		const QList<int> ServicedTicks = RunBusyTicks(EPagePriority::Hidden, 40);
+
+		QCOMPARE(ServicedTicks.size(), 2);
+		QCOMPARE(ServicedTicks[0], 16);
+		QCOMPARE(ServicedTicks[1], 33);
+	}
+
+	void zeroBudgetDefersLowPriority()
+	{
+		QVERIFY(VaQuoleUIManager::ShouldDeferPage(EPagePriority::Background, 0, 0, 0));
+		QVERIFY(VaQuoleUIManager::ShouldDeferPage(EPagePriority::Hidden, 15, 0, 0));
+		QVERIFY(!VaQuoleUIManager::ShouldDeferPage(EPagePriority::Hidden, 16, 0, 0));
+	}
+};
+
+int RunTickSchedulerTest(int argc, char** argv)
+{
+	TickSchedulerTest Test;
+	return QTest::qExec(&Test, argc, argv);
+}
+
+#include "TickSchedulerTest.moc"
@@ -0,0 +1,172 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#include "VaQuoleUITests.h"
+#include "VaQuoleTileHash.h"
+
+#include <QObject>
+#include <QRect>
+#include <QRegion>
+#include <QSize>
+#include <QVector>
+#include <QtTest>
+
+using namespace VaQuole;
+
+/** Neither side is a multiple of tile size, so the last column and row are narrow */
+static const int ImageWidth = 200;
+static const int ImageHeight = 150;
+static const int ImageStride = ImageWidth * 4;
+
+/**
+ * View image with pixels that can be changed one by one
+ */
+struct TileImage
+{
+	QVector<uchar> Bits;
+
+	TileImage()
+		: Bits(ImageStride * ImageHeight, 0)
+	{
+	}
+
+	void SetPixel(int X, int Y, uchar Value)
+	{
+		Bits[Y * ImageStride + X * 4] = Value;
+	}
+
+	QRegion Filter(TileHashGrid& Grid, const QRegion& PaintedRegion) const
+	{
+		return Grid.FilterChangedTiles(Bits.constData(), ImageStride, QSize(ImageWidth, ImageHeight), PaintedRegion);
+	}
+};
+
+/**
+ * Checks that only tiles with changed pixels are published
+ */
+class TileHashTest : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void tilesCoverImage()
+	{
+		const QVector<QRect> Tiles = TileHashGrid::SplitToTiles(QRegion(0, 0, ImageWidth, ImageHeight), QSize(ImageWidth, ImageHeight));
+
+		QCOMPARE(Tiles.size(), 4 * 3);
+		QVERIFY(Tiles.first() == QRect(0, 0, 64, 64));
+		QVERIFY(Tiles[3] == QRect(192, 0, 8, 64));
+		QVERIFY(Tiles.last() == QRect(192, 128, 8, 22));
+
+		// Region outside the image has no tiles
+		QVERIFY(TileHashGrid::SplitToTiles(QRegion(ImageWidth, 0, 10, 10), QSize(ImageWidth, ImageHeight)).isEmpty());
+	}
+
+	void firstFrameIsChanged()
+	{
+		TileHashGrid Grid;
+		TileImage Image;
+		const QRegion ImageRegion(0, 0, ImageWidth, ImageHeight);
+
+		QVERIFY(Image.Filter(Grid, ImageRegion) == ImageRegion);
+
+		// Repaint without changes publishes nothing
+		QVERIFY(Image.Filter(Grid, ImageRegion).isEmpty());
+	}
+
+	void onePixelMarksOneTile()
+	{
+		TileHashGrid Grid;
+		TileImage Image;
+		const QRegion ImageRegion(0, 0, ImageWidth, ImageHeight);
+		Image.Filter(Grid, ImageRegion);
+
+		// WebKit repaints the whole view, but only one pixel has changed
+		Image.SetPixel(100, 70, 1);
+		QVERIFY(Image.Filter(Grid, ImageRegion) == QRegion(64, 64, 64, 64));
+
+		// The same value again is no change
+		QVERIFY(Image.Filter(Grid, ImageRegion).isEmpty());
+	}
+
+	void edgeTilesAreHashed()
+	{
+		TileHashGrid Grid;
+		TileImage Image;
+		const QRegion ImageRegion(0, 0, ImageWidth, ImageHeight);
+		Image.Filter(Grid, ImageRegion);
+
+		Image.SetPixel(ImageWidth - 1, 10, 1);
+		QVERIFY(Image.Filter(Grid, ImageRegion) == QRegion(192, 0, 8, 64));
+
+		Image.SetPixel(10, ImageHeight - 1, 1);
+		QVERIFY(Image.Filter(Grid, ImageRegion) == QRegion(0, 128, 64, 22));
+
+		Image.SetPixel(ImageWidth - 1, ImageHeight - 1, 1);
+		QVERIFY(Image.Filter(Grid, ImageRegion) == QRegion(192, 128, 8, 22));
+	}
+
+	void runsDontJoinUnchangedTiles()
+	{
+		TileHashGrid Grid;
+		TileImage Image;
+		const QRegion ImageRegion(0, 0, ImageWidth, ImageHeight);
+		Image.Filter(Grid, ImageRegion);
+
+		// Two neighbours are merged into one run, the unchanged tile after them breaks it
+		Image.SetPixel(10, 10, 1);
+		Image.SetPixel(70, 10, 1);
+		Image.SetPixel(195, 10, 1);
+
+		// The last tile of the row and the first one of the next row are never merged
+		Image.SetPixel(195, 70, 1);
+		Image.SetPixel(10, 140, 1);
+
+		QRegion Expected;
+		Expected += QRect(0, 0, 128, 64);
+		Expected += QRect(192, 0, 8, 64);
+		Expected += QRect(192, 64, 8, 64);
+		Expected += QRect(0, 128, 64, 22);
+
+		QRegion Unexpected;
+		Unexpected += QRect(128, 0, 64, 64);
+		Unexpected += QRect(0, 64, 192, 64);
+		Unexpected += QRect(64, 128, 136, 22);
+
+		const QRegion Changed = Image.Filter(Grid, ImageRegion);
+		QVERIFY(Changed.subtracted(Expected).isEmpty());
+		QVERIFY(Expected.subtracted(Changed).isEmpty());
+		QVERIFY(Changed.intersected(Unexpected).isEmpty());
+	}
+
+	void onlyPaintedTilesAreHashed()
+	{
+		TileHashGrid Grid;
+		TileImage Image;
+		const QRegion ImageRegion(0, 0, ImageWidth, ImageHeight);
+		Image.Filter(Grid, ImageRegion);
+
+		// Change outside painted region isn't seen until its tile is painted
+		Image.SetPixel(10, 10, 1);
+		QVERIFY(Image.Filter(Grid, QRegion(100, 100, 10, 10)).isEmpty());
+		QVERIFY(Image.Filter(Grid, QRegion(5, 5, 1, 1)) == QRegion(0, 0, 64, 64));
+	}
+
+	void resizeDropsHashes()
+	{
+		TileHashGrid Grid;
+		TileImage Image;
+		Image.Filter(Grid, QRegion(0, 0, ImageWidth, ImageHeight));
+
+		// The same pixels in a smaller view are all published again
+		const QRegion Changed = Grid.FilterChangedTiles(Image.Bits.constData(), ImageStride, QSize(100, 100), QRegion(0, 0, 100, 100));
+		QVERIFY(Changed == QRegion(0, 0, 100, 100));
+	}
+};
+
+int RunTileHashTest(int argc, char** argv)
+{
+	TileHashTest Test;
+	return QTest::qExec(&Test, argc, argv);
+}
+
+#include "TileHashTest.moc"
@@ -0,0 +1,213 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#include "VaQuoleUITests.h"
+#include "VaQuoleTrace.h"
+
+#include <QByteArray>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QtTest>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace VaQuole;
+
+/** Ring size used by all cases: recorder is shared, and its ring is allocated once */
+static const int RingSize = 1024;
+
+/** Recorded events of desired phase */
+static QList<QJsonObject> GetTraceEvents(const QString& Phase)
+{
+	const QJsonDocument Trace = QJsonDocument::fromJson(TraceRecorder::Get().ToChromeTrace());
+
+	QList<QJsonObject> Events;
+	foreach (const QJsonValue& Value, Trace.object().value("traceEvents").toArray())
+	{
+		if (Value.toObject().value("ph").toString() == Phase)
+		{
+			Events.append(Value.toObject());
+		}
+	}
+
+	return Events;
+}
+
+/**
+ * Checks the lock-free event ring, its sessions and JSON output
+ */
+class TraceRecorderTest : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void eventsAreRecorded()
+	{
+		TraceRecorder& Recorder = TraceRecorder::Get();
+		const int PageMarker = 0;
+
+		Recorder.Start(RingSize);
+		QVERIFY(Recorder.IsEnabled());
+		Recorder.Record("Paint", 100, 20, &PageMarker);
+		Recorder.Record("Script", 130, 5);
+		Recorder.Stop();
+		QVERIFY(!Recorder.IsEnabled());
+
+		const QList<QJsonObject> Events = GetTraceEvents("X");
+		QCOMPARE(Events.size(), 2);
+
+		QVERIFY(Events[0].value("name").toString() == QString("Paint"));
+		QCOMPARE(Events[0].value("ts").toDouble(), 100.0);
+		QCOMPARE(Events[0].value("dur").toDouble(), 20.0);
+		QCOMPARE(Events[0].value("tid").toDouble(), (double)TraceRecorder::GetThreadId());
+		QVERIFY(Events[0].value("args").toObject().value("page").toString() == QString("0x%1").arg((quintptr)&PageMarker, 0, 16));
+
+		QVERIFY(Events[1].value("name").toString() == QString("Script"));
+		QVERIFY(!Events[1].contains("args"));
+	}
+
+	void scopeIsRecordedWhileEnabled()
+	{
+		TraceRecorder& Recorder = TraceRecorder::Get();
+
+		Recorder.Start(RingSize);
+		{
+			TraceScope Scope("Enabled");
+		}
+		Recorder.Stop();
+
+		{
+			TraceScope Scope("Disabled");
+		}
+
+		const QList<QJsonObject> Events = GetTraceEvents("X");
+		QCOMPARE(Events.size(), 1);
+		QVERIFY(Events[0].value("name").toString() == QString("Enabled"));
+	}
+
+	void restartSkipsPreviousSession()
+	{
+		TraceRecorder& Recorder = TraceRecorder::Get();
+
+		Recorder.Start(RingSize);
+		for (int i = 0; i < 10; i++)
+		{
+			Recorder.Record("Old", i, 1);
+		}
+		Recorder.Stop();
+
+		// Slots of old events are still in the ring, but they don't belong to the new session
+		Recorder.Start(RingSize);
+		for (int i = 0; i < 3; i++)
+		{
+			Recorder.Record("New", i, 1);
+		}
+		Recorder.Stop();
+
+		const QList<QJsonObject> Events = GetTraceEvents("X");
+		QCOMPARE(Events.size(), 3);
+		foreach (const QJsonObject& Event, Events)
+		{
+			QVERIFY(Event.value("name").toString() == QString("New"));
+		}
+	}
+
+	void overflowKeepsNewest()
+	{
+		TraceRecorder& Recorder = TraceRecorder::Get();
+
+		Recorder.Start(RingSize);
+		for (int i = 0; i < RingSize + 100; i++)
+		{
+			Recorder.Record("Tick", i, 1);
+		}
+		Recorder.Stop();
+
+		const QList<QJsonObject> Events = GetTraceEvents("X");
+		QCOMPARE(Events.size(), RingSize);
+		QCOMPARE(Events.first().value("ts").toDouble(), 100.0);
+		QCOMPARE(Events.last().value("ts").toDouble(), (double)(RingSize + 99));
+	}
+
+	void readerNeverSeesTornEvents()
+	{
+		// Writers wrap the ring many times while it's read, each event has its duration derived from start
+		static const int WritersNum = 4;
+		static const int EventsNum = 50000;
+
+		TraceRecorder& Recorder = TraceRecorder::Get();
+		Recorder.Start(RingSize);
+
+		std::atomic<int> WritersDone(0);
+		std::vector<std::thread> Writers;
+		for (int w = 0; w < WritersNum; w++)
+		{
+			Writers.push_back(std::thread([&Recorder, &WritersDone, w]()
+			{
+				for (int i = 0; i < EventsNum; i++)
+				{
+					const quint64 StartUs = (quint64)w * EventsNum + i;
+					Recorder.Record("Concurrent", StartUs, StartUs + 1);
+				}
+
+				WritersDone++;
+			}));
+		}
+
+		int Reads = 0;
+		int Broken = 0;
+		while (WritersDone.load() < WritersNum || Reads == 0)
+		{
+			foreach (const QJsonObject& Event, GetTraceEvents("X"))
+			{
+				if (Event.value("dur").toDouble() != Event.value("ts").toDouble() + 1 ||
+					Event.value("name").toString() != QString("Concurrent"))
+				{
+					Broken++;
+				}
+			}
+
+			Reads++;
+		}
+
+		for (int w = 0; w < WritersNum; w++)
+		{
+			Writers[w].join();
+		}
+
+		Recorder.Stop();
+
+		QCOMPARE(Broken, 0);
+		QCOMPARE(GetTraceEvents("X").size(), RingSize);
+	}
+
+	void threadsAreNamed()
+	{
+		TraceRecorder::Get().SetThreadName(QString("TestThread"));
+
+		bool bNamed = false;
+		foreach (const QJsonObject& Event, GetTraceEvents("M"))
+		{
+			if (Event.value("tid").toDouble() == (double)TraceRecorder::GetThreadId())
+			{
+				bNamed = (Event.value("args").toObject().value("name").toString() == QString("TestThread"));
+			}
+		}
+
+		QVERIFY(bNamed);
+	}
+};
+
+int RunTraceRecorderTest(int argc, char** argv)
+{
+	TraceRecorderTest Test;
+	return QTest::qExec(&Test, argc, argv);
+}
+
+#include "TraceRecorderTest.moc"
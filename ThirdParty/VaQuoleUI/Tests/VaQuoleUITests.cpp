@@ -0,0 +1,27 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#include "VaQuoleUITests.h"
+
+#include <QCoreApplication>
+
+int main(int argc, char** argv)
+{
+	QCoreApplication App(argc, argv);
+
+	int Failed = 0;
+	Failed += RunBlockCompressionTest(argc, argv);
+	Failed += RunFrameExchangeTest(argc, argv);
+	Failed += RunPixelKernelTest(argc, argv);
+	Failed += RunCommandQueueTest(argc, argv);
+	Failed += RunLatencyHistogramTest(argc, argv);
+	Failed += RunTileHashTest(argc, argv);
+	Failed += RunFramePoolTest(argc, argv);
+	Failed += RunTickSchedulerTest(argc, argv);
+	Failed += RunFramePacingTest(argc, argv);
+	Failed += RunPageStatsTest(argc, argv);
+	Failed += RunTraceRecorderTest(argc, argv);
+	Failed += RunScriptBatchTest(argc, argv);
+	Failed += RunScriptCallTest(argc, argv);
+
+	return (Failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,21 @@
+// Copyright 2014 Vladimir Alyamkin. All Rights Reserved.
+
+#ifndef VAQUOLEUITESTS_H
+#define VAQUOLEUITESTS_H
+
+/** Test suites, each of them returns number of failed tests */
+int RunBlockCompressionTest(int argc, char** argv);
+int RunFrameExchangeTest(int argc, char** argv);
+int RunPixelKernelTest(int argc, char** argv);
+int RunCommandQueueTest(int argc, char** argv);
+int RunLatencyHistogramTest(int argc, char** argv);
+int RunTileHashTest(int argc, char** argv);
+int RunFramePoolTest(int argc, char** argv);
+int RunTickSchedulerTest(int argc, char** argv);
+int RunFramePacingTest(int argc, char** argv);
+int RunPageStatsTest(int argc, char** argv);
+int RunTraceRecorderTest(int argc, char** argv);
+int RunScriptBatchTest(int argc, char** argv);
+int RunScriptCallTest(int argc, char** argv);
+
+#endif // VAQUOLEUITESTS_H
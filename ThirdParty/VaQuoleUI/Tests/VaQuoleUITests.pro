@@ -0,0 +1,52 @@
+#-------------------------------------------------
+#
+# Unit tests of the library parts that don't need WebKit,
+# run them with "make check"
+#
+#-------------------------------------------------
+
+QT       += network webkit webkitwidgets testlib
+
+TARGET = VaQuoleUITests
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+DEFINES += UNICODE _UNICODE NOT_UE
+
+INCLUDEPATH += $$PWD/../Include \
+    $$PWD/../Private
+
+SOURCES += VaQuoleUITests.cpp \
+    BlockCompressionTest.cpp \
+    FrameExchangeTest.cpp \
+    PixelKernelTest.cpp \
+    CommandQueueTest.cpp \
+    LatencyHistogramTest.cpp \
+    TileHashTest.cpp \
+    FramePoolTest.cpp \
+    TickSchedulerTest.cpp \
+    FramePacingTest.cpp \
+    PageStatsTest.cpp \
+    TraceRecorderTest.cpp \
+    ScriptBatchTest.cpp \
+    ScriptCallTest.cpp
+
+HEADERS += VaQuoleUITests.h
+
+win32 {
+    !contains(QMAKE_TARGET.arch, x86_64) {
+	DESTDIR = $$PWD/../Lib/Win32
+    } else {
+	DESTDIR = $$PWD/../Lib/Win64
+    }
+
+    LIBS += -L$$DESTDIR -lVaQuoleUILib
+}
+
+unix {
+    DESTDIR = $$PWD/../Lib/Linux
+
+    LIBS += -L$$DESTDIR -lVaQuoleUILib -lrt
+    PRE_TARGETDEPS += $$DESTDIR/libVaQuoleUILib.a
+}
@@ -0,0 +1,19 @@
+#-------------------------------------------------
+#
+# Library, renderer host, benchmark and tests, run "qmake && make"
+# on Linux to get them in Lib/Linux (use QT_QPA_PLATFORM=offscreen
+# or InitHeadless() on machines without display)
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS = UILib UIHost UIBenchmark UITests
+
+UILib.file = VaQuoleUILib.pro
+UIHost.file = Host/VaQuoleUIHost.pro
+UIHost.depends = UILib
+UIBenchmark.file = Benchmark/VaQuoleUIBenchmark.pro
+UIBenchmark.depends = UILib
+UITests.file = Tests/VaQuoleUITests.pro
+UITests.depends = UILib
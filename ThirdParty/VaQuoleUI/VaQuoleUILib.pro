@@ -10,7 +10,8 @@ TARGET = VaQuoleUILib
 TEMPLATE = lib
 CONFIG += staticlib
 
-DEFINES += _UNICODE NOT_UE #VA_DEBUG
+# TCHAR is wchar_t on all platforms, as it is in the engine
+DEFINES += UNICODE _UNICODE NOT_UE #VA_DEBUG
 
 win32 {
     !contains(QMAKE_TARGET.arch, x86_64) {
@@ -30,16 +31,45 @@ SOURCES += Private/VaQuoleUILib.cpp \
     Private/VaQuoleWebView.cpp \
     Private/VaQuoleInputHelpers.cpp \
     Private/VaQuoleAppThread.cpp \
-    Private/VaQuoleWebPage.cpp
+    Private/VaQuoleWebPage.cpp \
+    Private/VaQuoleFrameExchange.cpp \
+    Private/VaQuolePixelFormat.cpp \
+    Private/VaQuoleBlockCompression.cpp \
+    Private/VaQuoleTileHash.cpp \
+    Private/VaQuoleFramePool.cpp \
+    Private/VaQuoleCommandQueue.cpp \
+    Private/VaQuoleTrace.cpp \
+    Private/VaQuoleLatency.cpp \
+    Private/VaQuoleFramePacing.cpp \
+    Private/VaQuoleScriptCall.cpp
 
 HEADERS += Include/VaQuoleUILib.h \
     Private/VaQuoleWebView.h \
     Include/VaQuolePublicPCH.h \
     Private/VaQuoleInputHelpers.h \
     Private/VaQuoleAppThread.h \
-    Private/VaQuoleWebPage.h
+    Private/VaQuoleWebPage.h \
+    Private/VaQuoleFrameExchange.h \
+    Private/VaQuolePixelFormat.h \
+    Private/VaQuoleBlockCompression.h \
+    Private/VaQuoleTileHash.h \
+    Private/VaQuoleFramePool.h \
+    Private/VaQuoleCommandQueue.h \
+    Private/VaQuoleStringHelpers.h \
+    Private/VaQuoleTrace.h \
+    Private/VaQuoleLatency.h \
+    Private/VaQuoleFramePacing.h \
+    Private/VaQuoleScriptCall.h
 
 unix {
+    DESTDIR = $$PWD/Lib/Linux
+
+    SOURCES += Private/VaQuoleRemoteProtocol.cpp \
+        Private/VaQuoleRemoteManager.cpp
+
+    HEADERS += Private/VaQuoleRemoteProtocol.h \
+        Private/VaQuoleRemoteManager.h
+
     target.path = /usr/lib
     INSTALLS += target
 }